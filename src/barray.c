@@ -13,11 +13,13 @@
 //
 //  You should have received a copy of the GNU General Public License
 //  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+#include <stddef.h>
+#include <string.h>
+#include <sys/ioctl.h>
+
 #include "util.h"
 #include "barray.h"
-
-#define BITS_PER_LONG        (sizeof(unsigned long) * 8)
-#define BITS_TO_LONGS(n)     (((n) + BITS_PER_LONG - 1) / BITS_PER_LONG)
+#include "trace.h"
 
 struct barray
 {
@@ -26,6 +28,9 @@ struct barray
     unsigned long data[0];
 };
 
+// BARRAY_DECLARE() relies on this layout
+_Static_assert(offsetof(struct barray, data) == 2 * sizeof(size_t), "barray layout");
+
 barray_t *barray_init(size_t num_bits)
 {
     size_t num_longs = BITS_TO_LONGS(num_bits);
@@ -61,7 +66,7 @@ void barray_set(barray_t *barray, bit_t bit)
     int index = bit / BITS_PER_LONG;
     int shift = bit % BITS_PER_LONG;
 
-    barray->data[index] |= (1 << shift);
+    barray->data[index] |= (1UL << shift);
 }
 
 void barray_clear(barray_t *barray, bit_t bit)
@@ -72,7 +77,7 @@ void barray_clear(barray_t *barray, bit_t bit)
     int index = bit / BITS_PER_LONG;
     int shift = bit % BITS_PER_LONG;
 
-    barray->data[index] &= ~(1 << shift);
+    barray->data[index] &= ~(1UL << shift);
 }
 
 bool barray_is_set(barray_t *barray, bit_t bit)
@@ -82,7 +87,7 @@ bool barray_is_set(barray_t *barray, bit_t bit)
 
     int index = bit / BITS_PER_LONG;
     int shift = bit % BITS_PER_LONG;
-    return (barray->data[index] & (1 << shift)) != 0;
+    return (barray->data[index] & (1UL << shift)) != 0;
 }
 
 void barray_foreach_set(barray_t *barray, barray_callback_t callback, void *arg)
@@ -96,4 +101,183 @@ void barray_foreach_set(barray_t *barray, barray_callback_t callback, void *arg)
             bits ^= (bits & -bits);
         }
     }    
-}
\ No newline at end of file
+}
+
+void barray_foreach_diff(barray_t *a, barray_t *b, barray_callback_t callback, void *arg)
+{
+    ASSERT(a->num_longs == b->num_longs);
+
+    for (int i = 0; i < a->num_longs; i++)
+    {
+        unsigned long bits = a->data[i] ^ b->data[i];
+        while (bits != 0)
+        {
+            callback(i * BITS_PER_LONG + __builtin_ctzl(bits), arg);
+            bits &= bits - 1;
+        }
+    }
+}
+
+///////////////////////////////////////////////////////////////////////////////
+//
+// Word Functions
+//
+///////////////////////////////////////////////////////////////////////////////
+
+// The bulk operations work a long at a time on arrays of the same size
+
+void barray_zero(barray_t *barray)
+{
+    memset(barray->data, 0, sizeof(unsigned long) * barray->num_longs);
+}
+
+bool barray_is_empty(barray_t *barray)
+{
+    for (int i = 0; i < barray->num_longs; i++)
+    {
+        if (barray->data[i])
+            return false;
+    }
+    return true;
+}
+
+void barray_copy(barray_t *dst, barray_t *src)
+{
+    ASSERT(dst->num_longs == src->num_longs);
+
+    memcpy(dst->data, src->data, sizeof(unsigned long) * dst->num_longs);
+}
+
+bool barray_equal(barray_t *a, barray_t *b)
+{
+    ASSERT(a->num_longs == b->num_longs);
+
+    return memcmp(a->data, b->data, sizeof(unsigned long) * a->num_longs) == 0;
+}
+
+void barray_and(barray_t *dst, barray_t *src)
+{
+    ASSERT(dst->num_longs == src->num_longs);
+
+    for (int i = 0; i < dst->num_longs; i++)
+        dst->data[i] &= src->data[i];
+}
+
+void barray_or(barray_t *dst, barray_t *src)
+{
+    ASSERT(dst->num_longs == src->num_longs);
+
+    for (int i = 0; i < dst->num_longs; i++)
+        dst->data[i] |= src->data[i];
+}
+
+void barray_xor(barray_t *dst, barray_t *src)
+{
+    ASSERT(dst->num_longs == src->num_longs);
+
+    for (int i = 0; i < dst->num_longs; i++)
+        dst->data[i] ^= src->data[i];
+}
+
+void barray_andnot(barray_t *dst, barray_t *src)
+{
+    ASSERT(dst->num_longs == src->num_longs);
+
+    for (int i = 0; i < dst->num_longs; i++)
+        dst->data[i] &= ~src->data[i];
+}
+
+///////////////////////////////////////////////////////////////////////////////
+//
+// Rank Functions
+//
+///////////////////////////////////////////////////////////////////////////////
+
+struct barray_rank
+{
+    size_t first;
+    size_t num_longs;
+    struct
+    {
+        unsigned long bits;
+        unsigned long rank;
+    } word[0];
+};
+
+barray_rank_t *barray_rank_init(barray_t *barray)
+{
+    size_t first = 0;
+    while (first < barray->num_longs && barray->data[first] == 0)
+        first++;
+
+    size_t last = barray->num_longs;
+    while (last > first && barray->data[last - 1] == 0)
+        last--;
+
+    size_t num_longs = last - first;
+    barray_rank_t *rank = xalloc(sizeof(rank->word[0]) * num_longs + sizeof(barray_rank_t));
+    rank->first = first;
+    rank->num_longs = num_longs;
+
+    unsigned long count = 0;
+    for (int i = 0; i < num_longs; i++)
+    {
+        rank->word[i].bits = barray->data[first + i];
+        rank->word[i].rank = count;
+        count += __builtin_popcountl(rank->word[i].bits);
+    }
+
+    return rank;
+}
+
+void barray_rank_free(barray_rank_t *rank)
+{
+    xfree(rank);
+}
+
+// Returns -1 for a bit that is not set
+int barray_rank(barray_rank_t *rank, bit_t bit)
+{
+    // Bits before the first kept long wrap around to a large index
+    size_t index = bit / BITS_PER_LONG - rank->first;
+    if (index >= rank->num_longs)
+        return -1;
+
+    unsigned long bits = rank->word[index].bits;
+    unsigned long mask = 1UL << (bit % BITS_PER_LONG);
+    if (!(bits & mask))
+        return -1;
+
+    return rank->word[index].rank + __builtin_popcountl(bits & (mask - 1));
+}
+
+///////////////////////////////////////////////////////////////////////////////
+//
+// Ioctl Functions
+//
+///////////////////////////////////////////////////////////////////////////////
+
+// Read a kernel bitmap such as EVIOCGBIT or EVIOCGKEY into the array.  The
+// length encoded in the request is replaced with the size of the array so
+// the kernel can never write past it, and bits it did not write are clear.
+bool barray_ioctl(barray_t *barray, int fd, unsigned long request)
+{
+    size_t size = sizeof(unsigned long) * barray->num_longs;
+
+    request &= ~((unsigned long) _IOC_SIZEMASK << _IOC_SIZESHIFT);
+    request |= (unsigned long) size << _IOC_SIZESHIFT;
+
+    barray_zero(barray);
+
+    TRACE_BEGIN_ARG("ioctl", request);
+    int len = ioctl(fd, request, barray->data);
+    TRACE_END("ioctl");
+    if (len < 0)
+        return false;
+
+    // Drop any bits past the end of a partially used last long
+    if (barray->num_bits % BITS_PER_LONG)
+        barray->data[barray->num_longs - 1] &= (1UL << (barray->num_bits % BITS_PER_LONG)) - 1;
+
+    return true;
+}
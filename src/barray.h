@@ -21,6 +21,20 @@
 typedef struct barray barray_t;
 typedef unsigned bit_t;
 
+#define BITS_PER_LONG        (sizeof(unsigned long) * 8)
+#define BITS_TO_LONGS(n)     (((n) + BITS_PER_LONG - 1) / BITS_PER_LONG)
+
+// Declare a zeroed barray NAME of a compile time size with inline storage,
+// such as on the stack.  It has the layout of struct barray and must not be
+// passed to barray_free().
+#define BARRAY_DECLARE(name, bits) \
+    struct { \
+        size_t num_bits; \
+        size_t num_longs; \
+        unsigned long data[BITS_TO_LONGS(bits)]; \
+    } name##_storage = { .num_bits = (bits), .num_longs = BITS_TO_LONGS(bits) }; \
+    barray_t *name = (barray_t *) &name##_storage
+
 barray_t *barray_init(size_t num_bits);
 
 void barray_free(barray_t *barray);
@@ -38,3 +52,35 @@ bool barray_is_set(barray_t *barray, bit_t bit);
 typedef void (*barray_callback_t)(bit_t bit, void *arg);
 
 void barray_foreach_set(barray_t *barray, barray_callback_t callback, void *arg);
+
+void barray_foreach_diff(barray_t *a, barray_t *b, barray_callback_t callback, void *arg);
+
+void barray_zero(barray_t *barray);
+
+bool barray_is_empty(barray_t *barray);
+
+void barray_copy(barray_t *dst, barray_t *src);
+
+bool barray_equal(barray_t *a, barray_t *b);
+
+void barray_and(barray_t *dst, barray_t *src);
+
+void barray_or(barray_t *dst, barray_t *src);
+
+void barray_xor(barray_t *dst, barray_t *src);
+
+void barray_andnot(barray_t *dst, barray_t *src);
+
+bool barray_ioctl(barray_t *barray, int fd, unsigned long request);
+
+// A rank map turns a bit into its index among the set bits of a bitmap, so
+// that sparse ids can index a dense array.  Only the longs from the first to
+// the last one with a bit set are kept, each next to the number of bits set
+// before it, so a lookup is a compare, a load and a popcount.
+typedef struct barray_rank barray_rank_t;
+
+barray_rank_t *barray_rank_init(barray_t *barray);
+
+void barray_rank_free(barray_rank_t *rank);
+
+int barray_rank(barray_rank_t *rank, bit_t bit);
@@ -0,0 +1,357 @@
+//  evjs - Evdev Joystick Utilities
+//  Copyright (C) 2020 Scott Shumate <scott@shumatech.com>
+//
+//  This program is free software: you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation, either version 3 of the License, or
+//  (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+#define _GNU_SOURCE
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <time.h>
+#include <getopt.h>
+#include <err.h>
+#include <limits.h>
+#include <sys/wait.h>
+#include <linux/input.h>
+
+#include "util.h"
+#include "evdev.h"
+#include "uidev.h"
+#include "caldb.h"
+
+///////////////////////////////////////////////////////////////////////////////
+
+#define RUNS_DEFAULT        50
+#define AXES_DEFAULT        8
+#define BUTTON_NUM          8
+#define EVJSCAL_DEFAULT     "./evjscal"
+#define UINPUT_FILE         "/dev/uinput"
+#define COLUMN_MAX          32
+#define NAME_MAX_LEN        32
+
+// One column of the report, a phase of evjscal or a time seen from outside
+typedef struct column
+{
+    char        name[NAME_MAX_LEN];
+    double      *us;
+} column_t;
+
+static column_t     columns[COLUMN_MAX];
+static size_t       column_num;
+static int          runs = RUNS_DEFAULT;
+
+///////////////////////////////////////////////////////////////////////////////
+//
+// Results
+//
+///////////////////////////////////////////////////////////////////////////////
+
+static void result_add(const char *name, int run, double us)
+{
+    column_t *column = columns;
+    while (column < &columns[column_num] && strcmp(column->name, name) != 0)
+        column++;
+
+    if (column == &columns[column_num])
+    {
+        if (column_num == COLUMN_MAX)
+            return;
+
+        xsnprintf(column->name, sizeof(column->name), "%s", name);
+        column->us = xalloc(sizeof(double) * runs);
+        column_num++;
+    }
+
+    column->us[run] = us;
+}
+
+static void result_report(void)
+{
+    printf("%-12s %10s %10s %10s %10s\n", "# phase us", "first", "p50", "p90", "max");
+
+    for (column_t *column = columns; column < &columns[column_num]; column++)
+    {
+        double first = column->us[0];
+        sort_double(column->us, runs);
+
+        printf("%-12s %10.1f %10.1f %10.1f %10.1f\n", column->name, first,
+               column->us[percentile(runs, 50)], column->us[percentile(runs, 90)],
+               column->us[runs - 1]);
+
+        xfree(column->us);
+    }
+}
+
+///////////////////////////////////////////////////////////////////////////////
+//
+// Configure Runs
+//
+///////////////////////////////////////////////////////////////////////////////
+
+// Runs evjscal the way the udev rule does and collects its --timing table
+// along with the process creation and teardown that it cannot see itself
+static void config_run(int run, const char *evjscal, const char *db_file, const char *dev_file)
+{
+    int pipefd[2];
+    if (pipe(pipefd) < 0)
+        err(1, "pipe");
+
+    uint64_t start = now_ns();
+
+    pid_t pid = fork();
+    if (pid < 0)
+        err(1, "fork");
+
+    if (pid == 0)
+    {
+        int null = open("/dev/null", O_WRONLY);
+        dup2(null, STDOUT_FILENO);
+        dup2(pipefd[1], STDERR_FILENO);
+        close(pipefd[0]);
+
+        execl(evjscal, evjscal, "--timing", "-c", "-d", db_file, dev_file, (char *)NULL);
+        err(127, "%s", evjscal);
+    }
+
+    close(pipefd[1]);
+
+    FILE *file = fdopen(pipefd[0], "r");
+    char line[256];
+    double main_entry = 0, main_us = 0;
+    while (fgets(line, sizeof(line), file))
+    {
+        char name[NAME_MAX_LEN];
+        double value1, value2;
+
+        int fields = sscanf(line, "%31s %lf %lf", name, &value1, &value2);
+        if (fields == 3)
+        {
+            // The exec phase in the table only has clock tick resolution
+            if (strcmp(name, "exec") != 0)
+                result_add(name, run, value2);
+        }
+        else if (fields == 2)
+        {
+            if (strcmp(name, "main_entry") == 0)
+                main_entry = value1;
+            else
+            {
+                if (strcmp(name, "main") == 0)
+                    main_us = value1;
+                result_add(name, run, value1);
+            }
+        }
+        else if (fields < 1 || strcmp(name, "Phase") != 0)
+            fputs(line, stderr);
+    }
+    fclose(file);
+
+    int status;
+    if (waitpid(pid, &status, 0) < 0)
+        err(1, "waitpid");
+
+    uint64_t end = now_ns();
+
+    if (!WIFEXITED(status) || WEXITSTATUS(status) != 0 || main_entry == 0)
+        errx(1, "%s failed on run %d", evjscal, run + 1);
+
+    double spawn = main_entry - start / 1000.0;
+    result_add("spawn", run, spawn);
+    result_add("exit", run, (end - start) / 1000.0 - spawn - main_us);
+    result_add("wall", run, (end - start) / 1000.0);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+//
+// Virtual Device
+//
+///////////////////////////////////////////////////////////////////////////////
+
+static uidev_t *virtual_create(int axes)
+{
+    evdev_id_t id = { .bus = BUS_VIRTUAL, .vendor = 0x1209, .product = 0xb0c0 };
+    uidev_t *uidev = uidev_init("evjs bench_config", &id);
+
+    evcal_t cal = { .min = 0, .max = 1023, .fuzz = 0, .flat = 0 };
+    for (int i = 0; i < axes; i++)
+        uidev_abs_add(uidev, ABS_X + i, &cal);
+
+    // Joystick buttons so that joydev binds and JSIOCSCORR is exercised
+    for (int i = 0; i < BUTTON_NUM; i++)
+        uidev_key_add(uidev, BTN_TRIGGER + i);
+
+    uidev_create(uidev);
+
+    return uidev;
+}
+
+typedef struct db_fill
+{
+    evdev_t *evdev;
+    evidx_t index;
+} db_fill_t;
+
+static bool db_writer(caldb_record_t *rec, void *arg)
+{
+    db_fill_t *fill = arg;
+
+    if (fill->index == evabs_num(fill->evdev))
+        return false;
+
+    rec->axis = evabs_id(fill->evdev, fill->index);
+    evabs_cal_get(fill->evdev, fill->index, &rec->cal);
+    fill->index++;
+
+    return true;
+}
+
+// A database with the current calibration of every axis, so that each run
+// does a full configuration without changing what a real device reports
+static void db_create(const char *db_file, const char *dev_file)
+{
+    char *err_msg = NULL;
+
+    db_fill_t fill = { .evdev = evdev_init(dev_file) };
+    evabs_init(fill.evdev);
+
+    evdev_id_t id;
+    evdev_id(fill.evdev, &id);
+
+    caldb_t *db = caldb_init(db_file, &err_msg);
+    if (!db)
+        errx(1, "%s: %s", db_file, err_msg);
+
+    if (!caldb_write(db, &id, db_writer, &fill, &err_msg))
+        errx(1, "caldb_write: %s", err_msg);
+
+    caldb_free(db);
+    evdev_free(fill.evdev);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+
+static int usage(void)
+{
+    fprintf(stderr,
+        "Usage: bench_config [OPTION]... [DEVICE]\n"
+        "Time the phases of 'evjscal -c' as run by the udev rule when a device\n"
+        "is plugged in. Without a DEVICE a virtual joystick is created with uinput.\n"
+        "\n"
+        "Options:\n"
+        "  -h, --help            Print this help\n"
+        "  -n, --runs NUM        Number of evjscal runs (default %d)\n"
+        "  -a, --axes NUM        Axes of the virtual joystick (default %d)\n"
+        "  -e, --evjscal FILE    The evjscal to run (default %s)\n"
+        "\n"
+        "  Each line is a phase from 'evjscal --timing' with the time of the\n"
+        "  first run, when the caches are coldest, and the median, 90th\n"
+        "  percentile and maximum of all runs in microseconds.  spawn is the\n"
+        "  fork and exec up to main(), exit is the teardown until the parent\n"
+        "  is woken and wall is the total seen by the parent.\n"
+        "\n"
+        "Examples:\n"
+        "  Time 200 runs against a virtual joystick:\n"
+        "    bench_config -n 200\n"
+        "  Time an installed evjscal against a real device:\n"
+        "    bench_config -e /usr/bin/evjscal /dev/input/event11\n",
+        RUNS_DEFAULT, AXES_DEFAULT, EVJSCAL_DEFAULT
+    );
+
+    return 1;
+}
+
+int main(int argc, char *argv[])
+{
+    static struct option long_options[] = {
+        { "help",       no_argument,       NULL,  'h' },
+        { "runs",       required_argument, NULL,  'n' },
+        { "axes",       required_argument, NULL,  'a' },
+        { "evjscal",    required_argument, NULL,  'e' },
+        { 0,            0,                 NULL,  0   }
+    };
+    int axes = AXES_DEFAULT;
+    const char *evjscal = EVJSCAL_DEFAULT;
+
+    while (1)
+    {
+        int option_index = 0;
+        int c = getopt_long(argc, argv, "hn:a:e:", long_options, &option_index);
+        if (c == -1)
+            break;
+
+        switch (c)
+        {
+            case 'n':
+                runs = atoi(optarg);
+                if (runs < 1)
+                    errx(1, "Invalid number of runs");
+                break;
+            case 'a':
+                axes = atoi(optarg);
+                if (axes < 1 || axes > ABS_MISC)
+                    errx(1, "Invalid number of axes");
+                break;
+            case 'e':
+                evjscal = optarg;
+                break;
+            default:
+            case 'h':
+                return usage();
+        }
+    }
+
+    if (optind < argc - 1)
+        return usage();
+
+    uidev_t *uidev = NULL;
+    char *dev_file;
+    if (optind < argc)
+        dev_file = xstrdup(argv[optind]);
+    else if (access(UINPUT_FILE, W_OK) != 0)
+    {
+        // Not a failure so that 'make bench' still runs in containers
+        printf("# bench_config skipped: %s is not writable\n", UINPUT_FILE);
+        return 0;
+    }
+    else
+    {
+        uidev = virtual_create(axes);
+        dev_file = uidev_evdev(uidev);
+    }
+
+    char db_file[] = "/tmp/bench_config_XXXXXX";
+    int fd = mkstemp(db_file);
+    if (fd < 0)
+        err(1, "mkstemp");
+    close(fd);
+
+    db_create(db_file, dev_file);
+
+    printf("# %s -c %s, %d runs\n", evjscal, dev_file, runs);
+
+    for (int run = 0; run < runs; run++)
+        config_run(run, evjscal, db_file, dev_file);
+
+    result_report();
+
+    unlink(db_file);
+    xfree(dev_file);
+    if (uidev)
+        uidev_free(uidev);
+
+    return 0;
+}
@@ -0,0 +1,556 @@
+//  evjs - Evdev Joystick Utilities
+//  Copyright (C) 2020 Scott Shumate <scott@shumatech.com>
+//
+//  This program is free software: you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation, either version 3 of the License, or
+//  (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+#define _GNU_SOURCE
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <time.h>
+#include <getopt.h>
+#include <err.h>
+#include <linux/input.h>
+
+#include "util.h"
+#include "barray.h"
+#include "evdev.h"
+#include "device.h"
+#include "caldb.h"
+
+///////////////////////////////////////////////////////////////////////////////
+
+typedef struct bench bench_t;
+
+typedef size_t (*bench_run_t)(bench_t *bench, size_t size);
+
+struct bench
+{
+    const char  *name;
+    const char  *unit;
+    bench_run_t run;
+    size_t      size;
+    uint64_t    ns;
+};
+
+#define REPEAT_DEFAULT      5
+#define AXIS_NUM            6
+#define BUTTON_NUM          12
+#define PIPE_SIZE           (1024 * 1024)
+#define STREAM_EVENTS       (1000 * 1000)
+#define BARRAY_LOOPS        100000
+#define NORMALIZE_LOOPS     1000000
+#define CALDB_AXES          8
+
+static volatile uint64_t sink;
+
+///////////////////////////////////////////////////////////////////////////////
+//
+// Timing
+//
+///////////////////////////////////////////////////////////////////////////////
+
+static void bench_start(bench_t *bench)
+{
+    bench->ns -= now_ns();
+}
+
+static void bench_stop(bench_t *bench)
+{
+    bench->ns += now_ns();
+}
+
+///////////////////////////////////////////////////////////////////////////////
+//
+// Event Dispatch
+//
+///////////////////////////////////////////////////////////////////////////////
+
+// Frames of every axis moving plus a button every few frames, as written
+// by a busy 1 kHz stick
+static struct input_event *stream_synth(size_t *num)
+{
+    size_t count = 0;
+    size_t size = STREAM_EVENTS + AXIS_NUM + 2;
+    struct input_event *events = xalloc(sizeof(struct input_event) * size);
+    uint32_t seed = 0x2545f491;
+
+    for (int frame = 0; count < STREAM_EVENTS; frame++)
+    {
+        for (int a = 0; a < AXIS_NUM; a++)
+        {
+            seed = seed * 1103515245 + 12345;
+            events[count].type = EV_ABS;
+            events[count].code = a;
+            events[count].value = (int)(seed >> 16) - 32768;
+            count++;
+        }
+
+        if (frame % 8 == 0)
+        {
+            events[count].type = EV_KEY;
+            events[count].code = BTN_JOYSTICK + frame / 8 % BUTTON_NUM;
+            events[count].value = frame / 8 / BUTTON_NUM % 2;
+            count++;
+        }
+
+        events[count].type = EV_SYN;
+        events[count].code = SYN_REPORT;
+        count++;
+    }
+
+    *num = count;
+    return events;
+}
+
+// Only the reads are timed, the pipe is refilled between them
+static size_t stream_run(bench_t *bench, int fd, evdev_t *evdev, void (*read_fn)(void *), void *arg)
+{
+    size_t num;
+    struct input_event *events = stream_synth(&num);
+    size_t chunk = PIPE_SIZE / sizeof(struct input_event);
+    evdev_stats_enable(evdev);
+    const evstats_t *stats = evdev_stats(evdev);
+
+    for (size_t done = 0; done < num; done += chunk)
+    {
+        size_t count = num - done < chunk ? num - done : chunk;
+        size_t len = count * sizeof(struct input_event);
+        if (write(fd, &events[done], len) != len)
+            err(1, "write");
+
+        uint64_t target = stats->events + count;
+
+        bench_start(bench);
+        while (stats->events < target)
+            read_fn(arg);
+        bench_stop(bench);
+    }
+
+    xfree(events);
+    return num;
+}
+
+static void pipe_open(int fds[2])
+{
+    if (pipe2(fds, O_NONBLOCK | O_CLOEXEC) < 0)
+        err(1, "pipe");
+
+    if (fcntl(fds[1], F_SETPIPE_SZ, PIPE_SIZE) < 0)
+        err(1, "F_SETPIPE_SZ");
+}
+
+static void abs_count(evidx_t index, int value, void *arg)
+{
+    sink += value;
+}
+
+static void key_count(evidx_t index, bool value, void *arg)
+{
+    sink += value;
+}
+
+static void evdev_run(void *arg)
+{
+    evdev_read(arg);
+}
+
+static size_t bench_evdev_read(bench_t *bench, size_t size)
+{
+    int fds[2];
+    pipe_open(fds);
+
+    evdev_t *evdev = evdev_synth(fds[0], AXIS_NUM, BUTTON_NUM);
+    evdev_read_cb(evdev, abs_count, NULL, key_count, NULL);
+
+    size_t num = stream_run(bench, fds[1], evdev, evdev_run, evdev);
+
+    evdev_free(evdev);
+    close(fds[1]);
+
+    return num;
+}
+
+static void axis_count(axis_t *axis, void *arg)
+{
+    sink += axis->value;
+}
+
+static void device_run(void *arg)
+{
+    device_read(arg);
+}
+
+static size_t bench_device_read(bench_t *bench, filter_type_t type)
+{
+    int fds[2];
+    pipe_open(fds);
+
+    device_t *dev = device_init_synth(fds[0], AXIS_NUM, BUTTON_NUM);
+    device_read_cb(dev, axis_count, NULL, NULL);
+    AXIS_FOREACH(dev, axis)
+        filter_init(&axis->filter, type, 0, 0);
+
+    size_t num = stream_run(bench, fds[1], dev->evdev, device_run, dev);
+
+    device_free(dev);
+    close(fds[1]);
+
+    return num;
+}
+
+static size_t bench_device_read_none(bench_t *bench, size_t size)
+{
+    return bench_device_read(bench, FILTER_NONE);
+}
+
+static size_t bench_device_read_euro(bench_t *bench, size_t size)
+{
+    return bench_device_read(bench, FILTER_EURO);
+}
+
+// A frame of axes with the 16-bit synthetic calibration and values spread
+// over the range
+static size_t bench_device_normalize(bench_t *bench, size_t size)
+{
+    int fds[2];
+    pipe_open(fds);
+
+    device_t *dev = device_init_synth(fds[0], size, 0);
+    uint32_t seed = 1;
+    AXIS_FOREACH(dev, axis)
+    {
+        seed = seed * 1103515245 + 12345;
+        dev->axis_soa.value[axis->index] = (int)(seed >> 16) - 32768;
+    }
+
+    int32_t out[size];
+
+    bench_start(bench);
+    for (int i = 0; i < NORMALIZE_LOOPS; i++)
+    {
+        device_normalize(dev, out);
+        sink += out[i % size];
+    }
+    bench_stop(bench);
+
+    device_free(dev);
+    close(fds[1]);
+
+    return NORMALIZE_LOOPS;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+//
+// Bit Arrays
+//
+///////////////////////////////////////////////////////////////////////////////
+
+// A joystick's worth of keys spread over the KEY_CNT range
+static void barray_synth(barray_t *barray, uint32_t seed)
+{
+    for (int i = 0; i < 64; i++)
+    {
+        seed = seed * 1103515245 + 12345;
+        barray_set(barray, (seed >> 16) % KEY_CNT);
+    }
+}
+
+static void bit_count(bit_t bit, void *arg)
+{
+    sink += bit;
+}
+
+static size_t bench_barray_count(bench_t *bench, size_t size)
+{
+    BARRAY_DECLARE(keys, KEY_CNT);
+    barray_synth(keys, 1);
+
+    bench_start(bench);
+    for (int i = 0; i < BARRAY_LOOPS; i++)
+        sink += barray_count_set(keys);
+    bench_stop(bench);
+
+    return BARRAY_LOOPS;
+}
+
+static size_t bench_barray_foreach(bench_t *bench, size_t size)
+{
+    BARRAY_DECLARE(keys, KEY_CNT);
+    barray_synth(keys, 1);
+
+    bench_start(bench);
+    for (int i = 0; i < BARRAY_LOOPS; i++)
+        barray_foreach_set(keys, bit_count, NULL);
+    bench_stop(bench);
+
+    return BARRAY_LOOPS;
+}
+
+static size_t bench_barray_diff(bench_t *bench, size_t size)
+{
+    BARRAY_DECLARE(a, KEY_CNT);
+    BARRAY_DECLARE(b, KEY_CNT);
+    barray_synth(a, 1);
+    barray_copy(b, a);
+    barray_set(b, BTN_TRIGGER);
+    barray_clear(b, BTN_THUMB);
+
+    bench_start(bench);
+    for (int i = 0; i < BARRAY_LOOPS; i++)
+        barray_foreach_diff(a, b, bit_count, NULL);
+    bench_stop(bench);
+
+    return BARRAY_LOOPS;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+//
+// Calibration Database
+//
+///////////////////////////////////////////////////////////////////////////////
+
+typedef struct caldb_bench
+{
+    evdev_id_t  id;
+    size_t      count;
+} caldb_bench_t;
+
+static bool bench_writer(caldb_record_t *rec, void *arg)
+{
+    caldb_bench_t *cb = arg;
+
+    if (cb->count == CALDB_AXES)
+        return false;
+
+    rec->axis = cb->count;
+    rec->cal.min = -32768 + cb->count;
+    rec->cal.max = 32767 - cb->count;
+    rec->cal.fuzz = 16;
+    rec->cal.flat = 128;
+    cb->count++;
+
+    return true;
+}
+
+static bool bench_reader(const evdev_id_t *dev, const caldb_record_t *rec, void *arg)
+{
+    caldb_bench_t *cb = arg;
+
+    cb->count++;
+    sink += rec->cal.min;
+
+    return true;
+}
+
+static caldb_t *caldb_open(char *file)
+{
+    char *err_msg = NULL;
+
+    int fd = mkstemp(file);
+    if (fd < 0)
+        err(1, "mkstemp");
+    close(fd);
+
+    caldb_t *db = caldb_init(file, &err_msg);
+    if (!db)
+        errx(1, "%s: %s", file, err_msg);
+
+    return db;
+}
+
+// The database is filled with SIZE calibration records, CALDB_AXES per
+// device, and each device is written the way evjscal and evjstest save it
+static size_t caldb_fill(bench_t *bench, caldb_t *db, size_t size)
+{
+    size_t dev_num = (size + CALDB_AXES - 1) / CALDB_AXES;
+    char *err_msg = NULL;
+
+    for (size_t i = 0; i < dev_num; i++)
+    {
+        caldb_bench_t cb = { .id = { .bus = 3, .vendor = i >> 16, .product = i & 0xffff } };
+
+        if (bench)
+            bench_start(bench);
+        if (!caldb_write(db, &cb.id, bench_writer, &cb, &err_msg))
+            errx(1, "caldb_write: %s", err_msg);
+        if (bench)
+            bench_stop(bench);
+    }
+
+    return dev_num;
+}
+
+static size_t bench_caldb_write(bench_t *bench, size_t size)
+{
+    char file[] = "/tmp/bench_caldb_XXXXXX";
+    caldb_t *db = caldb_open(file);
+
+    size_t dev_num = caldb_fill(bench, db, size);
+
+    caldb_free(db);
+    unlink(file);
+
+    return dev_num;
+}
+
+static size_t bench_caldb_read(bench_t *bench, size_t size)
+{
+    char file[] = "/tmp/bench_caldb_XXXXXX";
+    caldb_t *db = caldb_open(file);
+    char *err_msg = NULL;
+
+    size_t dev_num = caldb_fill(NULL, db, size);
+
+    // Reads look up single devices, as done when a device is plugged in
+    size_t lookups = 1000;
+    for (size_t i = 0; i < lookups; i++)
+    {
+        size_t n = (i * 7919) % dev_num;
+        caldb_bench_t cb = { .id = { .bus = 3, .vendor = n >> 16, .product = n & 0xffff } };
+
+        bench_start(bench);
+        if (!caldb_read(db, &cb.id, bench_reader, &cb, &err_msg))
+            errx(1, "caldb_read: %s", err_msg);
+        bench_stop(bench);
+
+        if (cb.count != CALDB_AXES)
+            errx(1, "caldb_read: %zu records", cb.count);
+    }
+
+    caldb_free(db);
+    unlink(file);
+
+    return lookups;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+
+static bench_t benches[] =
+{
+    { "evdev_read",         "event",  bench_evdev_read,      0 },
+    { "device_read",        "event",  bench_device_read_none, 0 },
+    { "device_read_euro",   "event",  bench_device_read_euro, 0 },
+    { "device_normalize",   "frame",  bench_device_normalize, AXIS_NUM },
+    { "device_normalize",   "frame",  bench_device_normalize, ABS_CNT },
+    { "barray_count",       "array",  bench_barray_count,    0 },
+    { "barray_foreach",     "array",  bench_barray_foreach,  0 },
+    { "barray_diff",        "array",  bench_barray_diff,     0 },
+    { "caldb_write",        "device", bench_caldb_write,     10 },
+    { "caldb_write",        "device", bench_caldb_write,     1000 },
+    { "caldb_write",        "device", bench_caldb_write,     100000 },
+    { "caldb_read",         "device", bench_caldb_read,      10 },
+    { "caldb_read",         "device", bench_caldb_read,      1000 },
+    { "caldb_read",         "device", bench_caldb_read,      100000 },
+};
+
+#define BENCH_NUM           (sizeof(benches) / sizeof(benches[0]))
+
+static int usage(void)
+{
+    fprintf(stderr,
+        "Usage: bench_core [OPTION]... [NAME]...\n"
+        "Run the microbenchmarks of the event, device, bit array and database\n"
+        "hot paths, or only those whose name starts with one of the NAMEs.\n"
+        "\n"
+        "Options:\n"
+        "  -h, --help            Print this help\n"
+        "  -r, --repeat NUM      Report the median of NUM runs (default %d)\n"
+        "  -q, --quick           Skip the 100k record database runs\n"
+        "\n"
+        "  Each line is the benchmark name, the number of database records or\n"
+        "  axes, the unit of one operation, the median ns/op and the\n"
+        "  corresponding ops/s.\n"
+        "  device_read includes evdev_read, so the difference between the two is\n"
+        "  the cost of the device layer and its axis filters.\n",
+        REPEAT_DEFAULT
+    );
+
+    return 1;
+}
+
+int main(int argc, char *argv[])
+{
+    static struct option long_options[] = {
+        { "help",       no_argument,       NULL,  'h' },
+        { "repeat",     required_argument, NULL,  'r' },
+        { "quick",      no_argument,       NULL,  'q' },
+        { 0,            0,                 NULL,  0   }
+    };
+    int repeat = REPEAT_DEFAULT;
+    bool quick = false;
+
+    while (1)
+    {
+        int option_index = 0;
+        int c = getopt_long(argc, argv, "hr:q", long_options, &option_index);
+        if (c == -1)
+            break;
+
+        switch (c)
+        {
+            case 'r':
+                repeat = atoi(optarg);
+                if (repeat < 1)
+                    errx(1, "Invalid repeat count");
+                break;
+            case 'q':
+                quick = true;
+                break;
+            default:
+            case 'h':
+                return usage();
+        }
+    }
+
+    double *ns_op = xalloc(sizeof(double) * repeat);
+
+    printf("%-20s %8s %-8s %12s %14s\n", "# name", "size", "unit", "ns/op", "ops/s");
+
+    // Bring the CPU clock up before the first measurement
+    benches[0].run(&benches[0], 0);
+
+    for (bench_t *bench = benches; bench < &benches[BENCH_NUM]; bench++)
+    {
+        if (quick && bench->size >= 100000)
+            continue;
+
+        bool selected = (optind == argc);
+        for (int i = optind; i < argc; i++)
+            selected |= strncmp(bench->name, argv[i], strlen(argv[i])) == 0;
+        if (!selected)
+            continue;
+
+        // The median of several runs is stable against scheduling noise
+        for (int i = 0; i < repeat; i++)
+        {
+            bench->ns = 0;
+            size_t ops = bench->run(bench, bench->size);
+            ns_op[i] = (double)bench->ns / ops;
+        }
+        sort_double(ns_op, repeat);
+
+        double median = ns_op[percentile(repeat, 50)];
+        printf("%-20s %8zu %-8s %12.1f %14.0f\n",
+               bench->name, bench->size, bench->unit, median, 1e9 / median);
+        fflush(stdout);
+    }
+
+    xfree(ns_op);
+
+    return 0;
+}
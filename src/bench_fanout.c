@@ -0,0 +1,390 @@
+//  evjs - Evdev Joystick Utilities
+//  Copyright (C) 2020 Scott Shumate <scott@shumatech.com>
+//
+//  This program is free software: you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation, either version 3 of the License, or
+//  (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+#define _GNU_SOURCE
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <time.h>
+#include <getopt.h>
+#include <err.h>
+#include <poll.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+#include <linux/input.h>
+
+#include "util.h"
+#include "device.h"
+#include "fanout.h"
+#include "evjs_sock.h"
+
+///////////////////////////////////////////////////////////////////////////////
+
+#define CLIENTS_DEFAULT     16
+#define SLOW_DEFAULT        2
+#define FRAMES_DEFAULT      20000
+#define QUEUE_DEFAULT       64
+#define AXES_DEFAULT        8
+#define BUTTONS_DEFAULT     16
+#define SLOW_US             1000
+#define CONNECT_TIMEOUT_MS  5000
+#define DRAIN_TIMEOUT_MS    30000
+
+// Filled in by each subscriber process in a shared mapping
+typedef struct client
+{
+    uint64_t    frames;
+    uint64_t    dropped;
+    uint64_t    coalesced;
+    uint64_t    bad;
+    uint64_t    ns;
+    bool        done;
+} client_t;
+
+///////////////////////////////////////////////////////////////////////////////
+
+///////////////////////////////////////////////////////////////////////////////
+//
+// Subscriber
+//
+///////////////////////////////////////////////////////////////////////////////
+
+// Every frame sets all buttons to the low bit of its number, so a frame is
+// bad if that does not match, if it is out of order or if the frames it
+// says were dropped do not account for a gap
+static bool frame_check(const evjs_sock_frame_t *frame, uint64_t last, evjs_sock_policy_t policy,
+                        unsigned button_num)
+{
+    if (frame->frame <= last)
+        return false;
+
+    if (!(frame->flags & EVJS_SOCK_REMOVED))
+    {
+        for (unsigned i = 0; i < button_num; i++)
+            if (evjs_sock_button(frame, i) != (frame->frame & 1))
+                return false;
+    }
+
+    if (policy == EVJS_SOCK_DROP_OLDEST)
+        return frame->frame - last - 1 == frame->dropped;
+    else
+        return frame->frame - last - 1 >= frame->dropped;
+}
+
+static void client_run(const char *path, evjs_sock_policy_t policy, bool slow, client_t *client)
+{
+    int fd = evjs_sock_connect(path, policy);
+    if (fd < 0)
+        err(1, "%s", path);
+
+    evjs_sock_msg_t msg;
+    unsigned button_num = 0;
+    uint64_t last = 0;
+    uint64_t start = 0;
+
+    while (recv(fd, &msg, sizeof(msg), 0) > 0)
+    {
+        if (msg.type == EVJS_SOCK_DEVICE)
+        {
+            button_num = msg.device.button_num;
+            continue;
+        }
+        if (msg.type != EVJS_SOCK_FRAME)
+            continue;
+
+        if (!start)
+            start = now_ns();
+
+        if (!frame_check(&msg.frame, last, policy, button_num))
+            client->bad++;
+        client->dropped += msg.frame.dropped;
+        if (msg.frame.flags & EVJS_SOCK_COALESCED)
+            client->coalesced++;
+        last = msg.frame.frame;
+
+        if (msg.frame.flags & EVJS_SOCK_REMOVED)
+            break;
+
+        client->frames++;
+        if (slow)
+            usleep(SLOW_US);
+    }
+
+    client->ns = now_ns() - start;
+    client->done = true;
+    close(fd);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+//
+// Server
+//
+///////////////////////////////////////////////////////////////////////////////
+
+static void server_wait(fanout_t *fanout, int timeout_ms)
+{
+    struct pollfd pfd = { .fd = fanout_fileno(fanout), .events = POLLIN };
+    if (poll(&pfd, 1, timeout_ms) > 0)
+        fanout_poll(fanout);
+    fanout_flush(fanout);
+}
+
+static uint64_t server_run(fanout_t *fanout, device_t *dev, unsigned device, int frames, int rate)
+{
+    uint64_t period = rate ? 1000000000 / rate : 0;
+    uint64_t start = now_ns();
+    uint64_t next = start;
+
+    for (int n = 1; n <= frames; n++)
+    {
+        if (period)
+        {
+            next += period;
+            while (now_ns() < next)
+                ;
+        }
+
+        AXIS_FOREACH(dev, axis)
+            dev->axis_soa.value[axis->index] = (int32_t) ((n + axis->index) & 0x7fff);
+        BUTTON_FOREACH(dev, button)
+            button->value = n & 1;
+
+        fanout_frame(fanout, device, n);
+        fanout_flush(fanout);
+        fanout_poll(fanout);
+    }
+
+    return now_ns() - start;
+}
+
+static void result_print(const char *name, client_t *clients, int first, int last, int frames)
+{
+    client_t sum = { 0 };
+    int num = last - first;
+
+    if (num == 0)
+        return;
+
+    for (client_t *client = &clients[first]; client < &clients[last]; client++)
+    {
+        sum.frames += client->frames;
+        sum.dropped += client->dropped;
+        sum.coalesced += client->coalesced;
+        sum.bad += client->bad;
+        sum.ns += client->ns;
+        if (!client->done)
+            sum.bad++;
+    }
+
+    double per_sec = 1e9 * sum.frames / sum.ns;
+    printf("%-8s %7d %12.0f %12.0f %9.1f %10llu %10llu %6llu\n", name, num, per_sec, per_sec * num,
+           100.0 * sum.frames / ((double) frames * num),
+           (unsigned long long) sum.dropped, (unsigned long long) sum.coalesced,
+           (unsigned long long) sum.bad);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+
+static int usage(void)
+{
+    fprintf(stderr,
+        "Usage: bench_fanout [OPTION]...\n"
+        "Measure the frames served to subscribers on a Unix socket the way\n"
+        "'evjsd -S' does, with fast and slow subscriber processes.\n"
+        "\n"
+        "Options:\n"
+        "  -h, --help            Print this help\n"
+        "  -c, --clients NUM     Number of subscribers (default %d)\n"
+        "  -s, --slow NUM        How many of them sleep %d us per frame (default %d)\n"
+        "  -p, --policy POLICY   drop or coalesce when a queue is full (default drop)\n"
+        "  -q, --queue NUM       Frames queued per subscriber (default %d)\n"
+        "  -n, --frames NUM      Frames served (default %d)\n"
+        "  -r, --rate HZ         Serve HZ frames per second (default unlimited)\n"
+        "  -a, --axes NUM        Number of axes (default %d)\n"
+        "  -b, --buttons NUM     Number of buttons (default %d)\n"
+        "\n"
+        "  Each line gives the frames per second received by one subscriber\n"
+        "  and by all of them, the percentage of the frames served that were\n"
+        "  received, the frames reported dropped and coalesced, and the frames\n"
+        "  that were out of order or miscounted, which must be 0.  The server\n"
+        "  line is the cost of a frame and the rate the server kept up.\n"
+        "\n"
+        "Examples:\n"
+        "  Serve 32 subscribers at 1 kHz with coalescing:\n"
+        "    bench_fanout -c 32 -r 1000 -n 5000 -p coalesce\n",
+        CLIENTS_DEFAULT, SLOW_US, SLOW_DEFAULT, QUEUE_DEFAULT, FRAMES_DEFAULT,
+        AXES_DEFAULT, BUTTONS_DEFAULT
+    );
+
+    return 1;
+}
+
+int main(int argc, char *argv[])
+{
+    static struct option long_options[] = {
+        { "help",       no_argument,       NULL,  'h' },
+        { "clients",    required_argument, NULL,  'c' },
+        { "slow",       required_argument, NULL,  's' },
+        { "policy",     required_argument, NULL,  'p' },
+        { "queue",      required_argument, NULL,  'q' },
+        { "frames",     required_argument, NULL,  'n' },
+        { "rate",       required_argument, NULL,  'r' },
+        { "axes",       required_argument, NULL,  'a' },
+        { "buttons",    required_argument, NULL,  'b' },
+        { 0,            0,                 NULL,  0   }
+    };
+    int clients = CLIENTS_DEFAULT;
+    int slow = SLOW_DEFAULT;
+    evjs_sock_policy_t policy = EVJS_SOCK_DROP_OLDEST;
+    int queue_len = QUEUE_DEFAULT;
+    int frames = FRAMES_DEFAULT;
+    int rate = 0;
+    int axes = AXES_DEFAULT;
+    int buttons = BUTTONS_DEFAULT;
+
+    while (1)
+    {
+        int option_index = 0;
+        int c = getopt_long(argc, argv, "hc:s:p:q:n:r:a:b:", long_options, &option_index);
+        if (c == -1)
+            break;
+
+        switch (c)
+        {
+            case 'c':
+                clients = atoi(optarg);
+                if (clients < 1 || clients > 1024)
+                    errx(1, "Invalid number of clients");
+                break;
+            case 's':
+                slow = atoi(optarg);
+                if (slow < 0)
+                    errx(1, "Invalid number of slow clients");
+                break;
+            case 'p':
+                if (strcmp(optarg, "drop") == 0)
+                    policy = EVJS_SOCK_DROP_OLDEST;
+                else if (strcmp(optarg, "coalesce") == 0)
+                    policy = EVJS_SOCK_COALESCE;
+                else
+                    errx(1, "Invalid policy");
+                break;
+            case 'q':
+                queue_len = atoi(optarg);
+                if (queue_len < 1)
+                    errx(1, "Invalid queue length");
+                break;
+            case 'n':
+                frames = atoi(optarg);
+                if (frames < 1)
+                    errx(1, "Invalid number of frames");
+                break;
+            case 'r':
+                rate = atoi(optarg);
+                if (rate < 0)
+                    errx(1, "Invalid rate");
+                break;
+            case 'a':
+                axes = atoi(optarg);
+                if (axes < 1 || axes > ABS_CNT)
+                    errx(1, "Invalid number of axes");
+                break;
+            case 'b':
+                buttons = atoi(optarg);
+                if (buttons < 0 || buttons > KEY_CNT - BTN_JOYSTICK)
+                    errx(1, "Invalid number of buttons");
+                break;
+            default:
+            case 'h':
+                return usage();
+        }
+    }
+
+    if (optind != argc)
+        return usage();
+    if (slow > clients)
+        slow = clients;
+
+    int fds[2];
+    if (pipe(fds) < 0)
+        err(1, "pipe");
+
+    char path[64];
+    xsnprintf(path, sizeof(path), "/tmp/bench_fanout-%d.sock", getpid());
+
+    device_t *dev = device_init_synth(fds[0], axes, buttons);
+    fanout_t *fanout = fanout_init(path, queue_len);
+    unsigned device = fanout_device_add(fanout, dev);
+
+    client_t *results = mmap(NULL, sizeof(client_t) * clients, PROT_READ | PROT_WRITE,
+                             MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    if (results == MAP_FAILED)
+        err(1, "mmap");
+    memset(results, 0, sizeof(client_t) * clients);
+
+    // The slow subscribers are the last ones
+    for (int i = 0; i < clients; i++)
+    {
+        pid_t pid = fork();
+        if (pid < 0)
+            err(1, "fork");
+        if (pid == 0)
+        {
+            client_run(path, policy, i >= clients - slow, &results[i]);
+            _exit(0);
+        }
+    }
+
+    uint64_t deadline = now_ns() + CONNECT_TIMEOUT_MS * 1000000ULL;
+    while (fanout_subscribers(fanout) < clients && now_ns() < deadline)
+        server_wait(fanout, 10);
+    if (fanout_subscribers(fanout) < clients)
+        errx(1, "Only %zu of %d clients connected", fanout_subscribers(fanout), clients);
+
+    printf("# %s: %d clients, %d slow, %s, queue %d, %d frames of %zu bytes\n", path, clients, slow,
+           policy == EVJS_SOCK_COALESCE ? "coalesce" : "drop", queue_len, frames,
+           sizeof(evjs_sock_frame_t));
+
+    uint64_t ns = server_run(fanout, dev, device, frames, rate);
+
+    // The removal ends every subscriber once it has the frames still queued
+    fanout_device_remove(fanout, device);
+    deadline = now_ns() + DRAIN_TIMEOUT_MS * 1000000ULL;
+    while (fanout_subscribers(fanout) > 0 && now_ns() < deadline)
+        server_wait(fanout, 10);
+
+    fanout_free(fanout);
+    for (int i = 0; i < clients; i++)
+        wait(NULL);
+
+    printf("%-8s %7s %12s %12s %9s %10s %10s %6s\n", "# group", "clients", "per client",
+           "all", "received", "dropped", "coalesced", "bad");
+    result_print("fast", results, 0, clients - slow, frames);
+    result_print("slow", results, clients - slow, clients, frames);
+    printf("%-8s %7s %12.0f %12.1f ns/frame\n", "server", "", 1e9 * frames / ns, (double) ns / frames);
+
+    bool bad = false;
+    for (int i = 0; i < clients; i++)
+        bad |= results[i].bad != 0 || !results[i].done;
+
+    munmap(results, sizeof(client_t) * clients);
+    device_free(dev);
+    close(fds[1]);
+
+    return bad;
+}
@@ -0,0 +1,347 @@
+//  evjs - Evdev Joystick Utilities
+//  Copyright (C) 2020 Scott Shumate <scott@shumatech.com>
+//
+//  This program is free software: you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation, either version 3 of the License, or
+//  (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+#define _GNU_SOURCE
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+#include <getopt.h>
+#include <err.h>
+
+#include "util.h"
+#include "filter.h"
+
+///////////////////////////////////////////////////////////////////////////////
+
+typedef struct sample
+{
+    evtime_t time;
+    int      value;
+    int      ref;
+} sample_t;
+
+typedef struct config
+{
+    filter_type_t type;
+    int           param1;
+    int           param2;
+} config_t;
+
+static const config_t configs[] =
+{
+    { FILTER_NONE,   0,    0  },
+    { FILTER_EMA,    128,  0  },
+    { FILTER_EMA,    64,   0  },
+    { FILTER_EMA,    32,   0  },
+    { FILTER_MEDIAN, 3,    0  },
+    { FILTER_MEDIAN, 5,    0  },
+    { FILTER_MEDIAN, 7,    0  },
+    { FILTER_EURO,   500,  5  },
+    { FILTER_EURO,   1000, 10 },
+    { FILTER_EURO,   2000, 20 },
+};
+
+#define CONFIG_NUM          (sizeof(configs) / sizeof(configs[0]))
+
+#define SYNTH_RATE          1000
+#define SYNTH_SECONDS       20
+#define SYNTH_NOISE         200
+#define SYNTH_SPIKE         2000
+
+#define REF_WINDOW          9
+#define LAG_MAX             200
+#define BENCH_SAMPLES       10000000
+
+///////////////////////////////////////////////////////////////////////////////
+//
+// Input Generation
+//
+///////////////////////////////////////////////////////////////////////////////
+
+static uint32_t rng_state = 0x12345678;
+
+static uint32_t rng(void)
+{
+    rng_state ^= rng_state << 13;
+    rng_state ^= rng_state >> 17;
+    rng_state ^= rng_state << 5;
+    return rng_state;
+}
+
+static int noise(int sigma)
+{
+    // Irwin-Hall approximation of a normal distribution
+    int sum = 0;
+    for (int i = 0; i < 12; i++)
+        sum += rng() % 1001;
+    return (sum - 6000) * sigma / 1000;
+}
+
+static sample_t *synth(size_t *num)
+{
+    size_t count = SYNTH_RATE * SYNTH_SECONDS;
+    sample_t *samples = xalloc(sizeof(sample_t) * count);
+
+    // Alternate between rests, fast sweeps and slow sweeps
+    for (size_t i = 0; i < count; i++)
+    {
+        double t = (double)i / SYNTH_RATE;
+        int phase = (int)t % 4;
+        double clean;
+
+        if (phase == 0)
+            clean = 0;
+        else if (phase == 1)
+            clean = 16000 * sin(2 * M_PI * 2 * t);
+        else if (phase == 2)
+            clean = 16000 * sin(2 * M_PI * 0.25 * t);
+        else
+            clean = 12000 * fmax(-1, fmin(1, 50 * sin(2 * M_PI * t)));
+
+        samples[i].time = i * 1000000 / SYNTH_RATE;
+        samples[i].ref = clean;
+        samples[i].value = clean + noise(SYNTH_NOISE);
+        if (rng() % 500 == 0)
+            samples[i].value += (rng() & 1) ? SYNTH_SPIKE : -SYNTH_SPIKE;
+    }
+
+    *num = count;
+    return samples;
+}
+
+static sample_t *replay(const char *file, size_t *num)
+{
+    FILE *fp = fopen(file, "r");
+    if (!fp)
+        err(1, "%s", file);
+
+    size_t count = 0;
+    size_t size = 1024;
+    sample_t *samples = xalloc(sizeof(sample_t) * size);
+
+    char line[256];
+    while (fgets(line, sizeof(line), fp))
+    {
+        unsigned long long time;
+        int value;
+        if (sscanf(line, "%llu%*[ ,\t]%d", &time, &value) != 2)
+            continue;
+
+        if (count == size)
+        {
+            size *= 2;
+            samples = xrealloc(samples, sizeof(sample_t) * size);
+        }
+
+        samples[count].time = time;
+        samples[count].value = value;
+        count++;
+    }
+
+    fclose(fp);
+
+    if (count < REF_WINDOW)
+        errx(1, "%s: not enough samples", file);
+
+    // Without a clean signal, a centered moving average is the reference
+    for (size_t i = 0; i < count; i++)
+    {
+        int64_t sum = 0;
+        int n = 0;
+        for (ssize_t j = (ssize_t)i - REF_WINDOW / 2; j <= (ssize_t)i + REF_WINDOW / 2; j++)
+        {
+            if (j >= 0 && j < count)
+            {
+                sum += samples[j].value;
+                n++;
+            }
+        }
+        samples[i].ref = sum / n;
+    }
+
+    *num = count;
+    return samples;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+//
+// Measurements
+//
+///////////////////////////////////////////////////////////////////////////////
+
+static double bench_ns(const config_t *config, const sample_t *samples, size_t num)
+{
+    filter_t filter;
+    filter_init(&filter, config->type, config->param1, config->param2);
+
+    volatile int sink = 0;
+    size_t total = 0;
+
+    uint64_t start = now_ns();
+    while (total < BENCH_SAMPLES)
+    {
+        evtime_t base = samples[num - 1].time * (total / num + 1);
+        for (size_t i = 0; i < num; i++)
+            sink += filter_apply(&filter, samples[i].value, base + samples[i].time);
+        total += num;
+    }
+    uint64_t ns = now_ns() - start;
+
+    (void)sink;
+
+    return (double)ns / total;
+}
+
+static double rms(const int *a, const sample_t *samples, size_t num, int lag)
+{
+    double sum = 0;
+    for (size_t i = lag; i < num; i++)
+    {
+        double d = a[i] - samples[i - lag].ref;
+        sum += d * d;
+    }
+    return sqrt(sum / (num - lag));
+}
+
+static void report(const config_t *config, const sample_t *samples, size_t num,
+                   double period, double target, const config_t **best, double *best_lag)
+{
+    filter_t filter;
+    filter_init(&filter, config->type, config->param1, config->param2);
+
+    int *out = xalloc(sizeof(int) * num);
+    int *in = xalloc(sizeof(int) * num);
+    for (size_t i = 0; i < num; i++)
+    {
+        in[i] = samples[i].value;
+        out[i] = filter_apply(&filter, samples[i].value, samples[i].time);
+    }
+
+    // The lag is the shift that best aligns the output with the reference
+    int lag = 0;
+    double noise_out = rms(out, samples, num, 0);
+    for (int k = 1; k <= LAG_MAX && k < num / 2; k++)
+    {
+        double r = rms(out, samples, num, k);
+        if (r < noise_out)
+        {
+            noise_out = r;
+            lag = k;
+        }
+    }
+
+    double noise_in = rms(in, samples, num, 0);
+    double lag_ms = lag * period / 1000;
+
+    printf("%-8s %6d %6d %10.1f %8.2f %10.1f %10.1f %8.1f\n",
+           filter_name(filter.type), filter.param1, filter.param2,
+           bench_ns(config, samples, num), lag_ms, noise_in, noise_out,
+           100 * (1 - noise_out / noise_in));
+
+    if (target > 0 && noise_out <= target && (!*best || lag_ms < *best_lag))
+    {
+        *best = config;
+        *best_lag = lag_ms;
+    }
+
+    xfree(in);
+    xfree(out);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+
+static int usage(void)
+{
+    fprintf(stderr,
+        "Usage: bench_filter [OPTION]... [REPLAY]\n"
+        "Benchmark the axis jitter filters against a REPLAY of axis samples or\n"
+        "a synthetic %d Hz stream when no REPLAY is given.\n"
+        "\n"
+        "Options:\n"
+        "  -h, --help            Print this help\n"
+        "  -j, --jitter RMS      Recommend the lowest lag filter with a residual\n"
+        "                        noise at or below RMS\n"
+        "\n"
+        "  REPLAY is a text file of [time in us],[raw value] lines.\n",
+        SYNTH_RATE
+    );
+
+    return 1;
+}
+
+int main(int argc, char *argv[])
+{
+    static struct option long_options[] = {
+        { "help",       no_argument,       NULL,  'h' },
+        { "jitter",     required_argument, NULL,  'j' },
+        { 0,            0,                 NULL,  0   }
+    };
+    double target = 0;
+
+    while (1)
+    {
+        int option_index = 0;
+        int c = getopt_long(argc, argv, "hj:", long_options, &option_index);
+        if (c == -1)
+            break;
+
+        switch (c)
+        {
+            case 'j':
+                target = atof(optarg);
+                break;
+            default:
+            case 'h':
+                return usage();
+        }
+    }
+
+    size_t num;
+    sample_t *samples;
+    if (optind == argc - 1)
+        samples = replay(argv[optind], &num);
+    else if (optind == argc)
+        samples = synth(&num);
+    else
+        return usage();
+
+    double period = (double)(samples[num - 1].time - samples[0].time) / (num - 1);
+
+    printf("# samples %zu period_us %.1f\n", num, period);
+    printf("%-8s %6s %6s %10s %8s %10s %10s %8s\n", "filter", "param1", "param2",
+           "ns/sample", "lag_ms", "noise_in", "noise_out", "removed%");
+
+    const config_t *best = NULL;
+    double best_lag = 0;
+    for (int i = 0; i < CONFIG_NUM; i++)
+        report(&configs[i], samples, num, period, target, &best, &best_lag);
+
+    if (target > 0)
+    {
+        if (best)
+            printf("# recommend %s %d %d lag_ms %.2f\n", filter_name(best->type),
+                   best->param1, best->param2, best_lag);
+        else
+            printf("# no filter meets jitter target %.1f\n", target);
+    }
+
+    xfree(samples);
+
+    return 0;
+}
@@ -0,0 +1,431 @@
+//  evjs - Evdev Joystick Utilities
+//  Copyright (C) 2020 Scott Shumate <scott@shumatech.com>
+//
+//  This program is free software: you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation, either version 3 of the License, or
+//  (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+#define _GNU_SOURCE
+#include <stdlib.h>
+#include <stdint.h>
+#include <inttypes.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <time.h>
+#include <poll.h>
+#include <sched.h>
+#include <getopt.h>
+#include <err.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+#include <sys/prctl.h>
+#include <linux/input.h>
+
+#include "util.h"
+#include "evdev.h"
+#include "uidev.h"
+#include "device.h"
+
+///////////////////////////////////////////////////////////////////////////////
+
+#define AXES_DEFAULT        6
+#define BUTTONS_DEFAULT     12
+#define RATE_DEFAULT        1000
+#define SECONDS_DEFAULT     5
+#define BUTTONS_MAX         16
+#define UINPUT_FILE         "/dev/uinput"
+
+// The frame sequence number is carried in the value of the first axis
+#define SEQ_RANGE           65536
+#define SEQ_MASK            (SEQ_RANGE - 1)
+
+// A button changes every few frames so that the key path is exercised
+#define BUTTON_PERIOD       8
+
+// Frames still in flight when the injector finishes get this long to arrive
+#define DRAIN_MS            200
+
+#define INJECT_SLACK_NS     1
+
+typedef enum stage
+{
+    STAGE_WRITE,
+    STAGE_DISPATCH,
+    STAGE_TOTAL,
+    STAGE_NUM
+} stage_t;
+
+// Shared between the injector and the receiver
+typedef struct shared
+{
+    uint64_t        send_ns[SEQ_RANGE];
+    uint64_t        sent;
+} shared_t;
+
+typedef struct receiver
+{
+    device_t        *dev;
+    shared_t        *shared;
+    uint64_t        next;
+    uint64_t        received;
+    uint64_t        lost;
+    uint64_t        *latency[STAGE_NUM];
+    size_t          latency_num;
+    size_t          latency_max;
+} receiver_t;
+
+static const char *stage_name[STAGE_NUM] = {
+    [STAGE_WRITE]    = "write",
+    [STAGE_DISPATCH] = "dispatch",
+    [STAGE_TOTAL]    = "total",
+};
+
+///////////////////////////////////////////////////////////////////////////////
+//
+// Injector
+//
+///////////////////////////////////////////////////////////////////////////////
+
+// Event timestamps come from the realtime clock, so the injection time is
+// taken from the same clock to split the latency at the kernel timestamp
+static uint64_t realtime_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_REALTIME, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+static void timespec_add(struct timespec *ts, long ns)
+{
+    ts->tv_nsec += ns;
+    while (ts->tv_nsec >= 1000000000)
+    {
+        ts->tv_nsec -= 1000000000;
+        ts->tv_sec++;
+    }
+}
+
+// Writes frames of every axis moving, as a busy stick does, at a fixed
+// rate from absolute wakeups so that a late frame does not shift the rest
+static void inject(uidev_t *uidev, shared_t *shared, int axes, int buttons, int rate, uint64_t frames)
+{
+    prctl(PR_SET_TIMERSLACK, INJECT_SLACK_NS);
+
+    struct timespec next;
+    clock_gettime(CLOCK_MONOTONIC, &next);
+
+    for (uint64_t seq = 0; seq < frames; seq++)
+    {
+        timespec_add(&next, 1000000000L / rate);
+        while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &next, NULL) == EINTR)
+            ;
+
+        uidev_abs(uidev, ABS_X, seq & SEQ_MASK);
+        for (int i = 1; i < axes; i++)
+            uidev_abs(uidev, ABS_X + i, (seq * (i + 1)) & SEQ_MASK);
+
+        if (buttons && seq % BUTTON_PERIOD == 0)
+        {
+            uint64_t press = seq / BUTTON_PERIOD;
+            uidev_key(uidev, BTN_TRIGGER + press / 2 % buttons, press % 2 == 0);
+        }
+
+        __atomic_store_n(&shared->send_ns[seq & SEQ_MASK], realtime_ns(), __ATOMIC_RELEASE);
+        uidev_syn(uidev, 0);
+        __atomic_store_n(&shared->sent, seq + 1, __ATOMIC_RELEASE);
+    }
+}
+
+///////////////////////////////////////////////////////////////////////////////
+//
+// Receiver
+//
+///////////////////////////////////////////////////////////////////////////////
+
+static void receive_syn(evtime_t time, void *arg)
+{
+    receiver_t *recv = arg;
+    uint64_t now = realtime_ns();
+
+    // Recover the full sequence number from the low bits carried by the
+    // axis, anything behind the expected frame is a resync repeat
+    axis_t *axis = device_axis_get(recv->dev, ABS_X);
+    uint64_t delta = (axis->raw - recv->next) & SEQ_MASK;
+    if (delta >= SEQ_RANGE / 2)
+        return;
+
+    uint64_t seq = recv->next + delta;
+    recv->lost += delta;
+    recv->next = seq + 1;
+    recv->received++;
+
+    if (recv->latency_num == recv->latency_max)
+        return;
+
+    uint64_t send = __atomic_load_n(&recv->shared->send_ns[seq & SEQ_MASK], __ATOMIC_ACQUIRE);
+    uint64_t kernel = time * 1000;
+    size_t n = recv->latency_num++;
+
+    recv->latency[STAGE_WRITE][n]    = kernel > send ? kernel - send : 0;
+    recv->latency[STAGE_DISPATCH][n] = now > kernel ? now - kernel : 0;
+    recv->latency[STAGE_TOTAL][n]    = now > send ? now - send : 0;
+}
+
+// Reads until the injector has exited and nothing arrived for a while
+static void receive(receiver_t *recv, pid_t injector)
+{
+    struct pollfd pfd = { .fd = device_fileno(recv->dev), .events = POLLIN };
+    bool exited = false;
+    int idle_ms = 0;
+
+    while (idle_ms < DRAIN_MS)
+    {
+        int ready = poll(&pfd, 1, 1);
+        if (ready < 0)
+        {
+            if (errno == EINTR)
+                continue;
+            xerr("poll");
+        }
+
+        if (ready > 0)
+        {
+            device_read(recv->dev);
+            idle_ms = 0;
+        }
+        else if (exited)
+            idle_ms++;
+        else
+        {
+            int status;
+            if (waitpid(injector, &status, WNOHANG) == injector)
+            {
+                if (!WIFEXITED(status) || WEXITSTATUS(status) != 0)
+                    errx(1, "injector failed");
+                exited = true;
+            }
+        }
+    }
+}
+
+///////////////////////////////////////////////////////////////////////////////
+//
+// Report
+//
+///////////////////////////////////////////////////////////////////////////////
+
+static void report(receiver_t *recv)
+{
+    size_t num = recv->latency_num;
+    uint64_t sent = recv->shared->sent;
+
+    printf("%-10s %10s %10s %10s %10s %10s %10s\n",
+           "# stage us", "mean", "p50", "p90", "p99", "p99.9", "max");
+
+    for (stage_t stage = 0; stage < STAGE_NUM && num > 0; stage++)
+    {
+        uint64_t *lat = recv->latency[stage];
+        uint64_t sum = 0;
+        for (size_t i = 0; i < num; i++)
+            sum += lat[i];
+
+        sort_u64(lat, num);
+
+        printf("%-10s %10.1f %10.1f %10.1f %10.1f %10.1f %10.1f\n", stage_name[stage],
+               sum / 1000.0 / num, lat[percentile(num, 50)] / 1000.0,
+               lat[percentile(num, 90)] / 1000.0, lat[percentile(num, 99)] / 1000.0,
+               lat[percentile(num, 99.9)] / 1000.0, lat[num - 1] / 1000.0);
+    }
+
+    // Frames at the end that never arrived are lost as well
+    uint64_t lost = recv->lost + (sent > recv->next ? sent - recv->next : 0);
+    const evstats_t *stats = evdev_stats(recv->dev->evdev);
+
+    printf("# frames sent %" PRIu64 " received %" PRIu64 " lost %" PRIu64 " (%.3f%%) "
+           "SYN_DROPPED %" PRIu64 " reads %" PRIu64 "\n",
+           sent, recv->received, lost, sent ? 100.0 * lost / sent : 0.0,
+           stats->dropped, stats->reads);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+
+static void realtime_set(int priority)
+{
+    if (priority == 0)
+        return;
+
+    if (mlockall(MCL_CURRENT | MCL_FUTURE) < 0)
+        warn("mlockall");
+
+    struct sched_param sp = { .sched_priority = priority };
+    if (sched_setscheduler(0, SCHED_FIFO, &sp) < 0)
+        warn("SCHED_FIFO");
+}
+
+static int usage(void)
+{
+    fprintf(stderr,
+        "Usage: bench_latency [OPTION]...\n"
+        "Measure the latency from writing events to a uinput joystick until they\n"
+        "reach the device layer callbacks through the normal evdev read path.\n"
+        "\n"
+        "Options:\n"
+        "  -h, --help            Print this help\n"
+        "  -a, --axes NUM        Number of axes (default %d)\n"
+        "  -b, --buttons NUM     Number of buttons (default %d)\n"
+        "  -r, --rate HZ         Frames written per second (default %d)\n"
+        "  -t, --time SECONDS    Length of the run (default %d)\n"
+        "  -p, --priority NUM    Run both sides at SCHED_FIFO priority NUM\n"
+        "\n"
+        "  write is the time from the write to uinput until the kernel event\n"
+        "  timestamp, dispatch is the time from the timestamp until the frame\n"
+        "  is complete in the device layer and total is the sum of both.  Frames\n"
+        "  that never arrived are reported as lost and SYN_DROPPED counts the\n"
+        "  kernel buffer overruns that the reader had to resync from.\n"
+        "\n"
+        "Examples:\n"
+        "  Measure a 16 axis device at 2 kHz with realtime priority:\n"
+        "    bench_latency -a 16 -r 2000 -p 50\n",
+        AXES_DEFAULT, BUTTONS_DEFAULT, RATE_DEFAULT, SECONDS_DEFAULT
+    );
+
+    return 1;
+}
+
+int main(int argc, char *argv[])
+{
+    static struct option long_options[] = {
+        { "help",       no_argument,       NULL,  'h' },
+        { "axes",       required_argument, NULL,  'a' },
+        { "buttons",    required_argument, NULL,  'b' },
+        { "rate",       required_argument, NULL,  'r' },
+        { "time",       required_argument, NULL,  't' },
+        { "priority",   required_argument, NULL,  'p' },
+        { 0,            0,                 NULL,  0   }
+    };
+    int axes = AXES_DEFAULT;
+    int buttons = BUTTONS_DEFAULT;
+    int rate = RATE_DEFAULT;
+    int seconds = SECONDS_DEFAULT;
+    int priority = 0;
+
+    while (1)
+    {
+        int option_index = 0;
+        int c = getopt_long(argc, argv, "ha:b:r:t:p:", long_options, &option_index);
+        if (c == -1)
+            break;
+
+        switch (c)
+        {
+            case 'a':
+                axes = atoi(optarg);
+                if (axes < 1 || axes > ABS_MISC)
+                    errx(1, "Invalid number of axes");
+                break;
+            case 'b':
+                buttons = atoi(optarg);
+                if (buttons < 0 || buttons > BUTTONS_MAX)
+                    errx(1, "Invalid number of buttons");
+                break;
+            case 'r':
+                rate = atoi(optarg);
+                if (rate < 1 || rate > 100000)
+                    errx(1, "Invalid rate");
+                break;
+            case 't':
+                seconds = atoi(optarg);
+                if (seconds < 1)
+                    errx(1, "Invalid time");
+                break;
+            case 'p':
+                priority = atoi(optarg);
+                if (priority < 0 || priority > 99)
+                    errx(1, "Invalid priority");
+                break;
+            default:
+            case 'h':
+                return usage();
+        }
+    }
+
+    if (optind != argc)
+        return usage();
+
+    if (access(UINPUT_FILE, W_OK) != 0)
+    {
+        // Not a failure so that 'make bench' still runs in containers
+        printf("# bench_latency skipped: %s is not writable\n", UINPUT_FILE);
+        return 0;
+    }
+
+    evdev_id_t id = { .bus = BUS_VIRTUAL, .vendor = 0x1209, .product = 0xb0c1 };
+    uidev_t *uidev = uidev_init("evjs bench_latency", &id);
+
+    evcal_t cal = { .min = 0, .max = SEQ_MASK };
+    for (int i = 0; i < axes; i++)
+        uidev_abs_add(uidev, ABS_X + i, &cal);
+    for (int i = 0; i < buttons; i++)
+        uidev_key_add(uidev, BTN_TRIGGER + i);
+    uidev_create(uidev);
+
+    char *dev_file = uidev_evdev(uidev);
+
+    shared_t *shared = mmap(NULL, sizeof(shared_t), PROT_READ | PROT_WRITE,
+                            MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    if (shared == MAP_FAILED)
+        xerr("mmap");
+
+    uint64_t frames = (uint64_t)rate * seconds;
+    receiver_t recv = {
+        .dev         = device_init(dev_file),
+        .shared      = shared,
+        .latency_max = frames,
+    };
+    for (stage_t stage = 0; stage < STAGE_NUM; stage++)
+        recv.latency[stage] = xalloc(sizeof(uint64_t) * frames);
+
+    device_syn_cb(recv.dev, receive_syn, &recv);
+    evdev_stats_enable(recv.dev->evdev);
+
+    printf("# %s: %d axes, %d buttons, %d Hz for %d s\n", dev_file, axes, buttons, rate, seconds);
+    fflush(stdout);
+
+    // The injector is a separate process, as a device driver would be, so
+    // the receiver wakes up from poll() the same way a real client does
+    pid_t pid = fork();
+    if (pid < 0)
+        xerr("fork");
+
+    if (pid == 0)
+    {
+        realtime_set(priority);
+        inject(uidev, shared, axes, buttons, rate, frames);
+        _exit(0);
+    }
+
+    realtime_set(priority);
+    receive(&recv, pid);
+
+    report(&recv);
+
+    for (stage_t stage = 0; stage < STAGE_NUM; stage++)
+        xfree(recv.latency[stage]);
+    device_free(recv.dev);
+    munmap(shared, sizeof(shared_t));
+    xfree(dev_file);
+    uidev_free(uidev);
+
+    return 0;
+}
@@ -0,0 +1,671 @@
+//  evjs - Evdev Joystick Utilities
+//  Copyright (C) 2020 Scott Shumate <scott@shumatech.com>
+//
+//  This program is free software: you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation, either version 3 of the License, or
+//  (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+#define _GNU_SOURCE
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <time.h>
+#include <getopt.h>
+#include <err.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+#include <sys/prctl.h>
+#include <sys/epoll.h>
+#include <sys/resource.h>
+#include <linux/input.h>
+
+#include "util.h"
+#include "evdev.h"
+#include "uidev.h"
+#include "device.h"
+#include "caldb.h"
+
+///////////////////////////////////////////////////////////////////////////////
+
+#define SIZES_DEFAULT       "1,5,10,20,40"
+#define RATE_DEFAULT        1000
+#define SECONDS_DEFAULT     5
+#define EVJSCAL_DEFAULT     "./evjscal"
+#define UINPUT_FILE         "/dev/uinput"
+#define DEVICES_MAX         128
+#define SCAN_RUNS           5
+
+// The frame sequence number is carried in the first axis of every device
+#define SEQ_RANGE           4096
+#define SEQ_MASK            (SEQ_RANGE - 1)
+
+// A button changes every few frames so that the key path is exercised
+#define BUTTON_PERIOD       16
+
+// Frames still in flight when the injector finishes get this long to arrive
+#define DRAIN_MS            200
+
+#define INJECT_SLACK_NS     1
+
+// Controls of the devices found in a simulator cockpit
+typedef struct profile
+{
+    const char  *name;
+    int         axes;
+    int         buttons;
+} profile_t;
+
+static const profile_t profiles[] = {
+    { "HOTAS stick",    4, 20 },
+    { "HOTAS throttle", 6, 32 },
+    { "Rudder pedals",  3,  0 },
+    { "Wheel",          4, 24 },
+    { "Button box",     2, 40 },
+};
+#define PROFILE_NUM (sizeof(profiles)/sizeof(profiles[0]))
+
+typedef struct virtual
+{
+    const profile_t *profile;
+    uidev_t         *uidev;
+    char            *file;
+} virtual_t;
+
+// Written by the injector and read by the monitor
+typedef struct shared
+{
+    uint64_t        send_ns[DEVICES_MAX][SEQ_RANGE];
+    uint64_t        sent;
+    uint64_t        late;
+} shared_t;
+
+typedef struct monitor monitor_t;
+
+typedef struct watched
+{
+    monitor_t       *mon;
+    device_t        *dev;
+    int             index;
+    uint64_t        next;
+} watched_t;
+
+struct monitor
+{
+    shared_t        *shared;
+    uint64_t        received;
+    uint64_t        lost;
+    uint64_t        *latency;
+    size_t          latency_num;
+    size_t          latency_max;
+};
+
+// One row of the report
+typedef struct result
+{
+    double          scan_ms;
+    double          config_ms;
+    double          config_cpu_ms;
+    double          cpu_percent;
+    double          wakeups;
+    long            rss_kb;
+    double          p50_us;
+    double          p99_us;
+    double          max_us;
+    double          lost_percent;
+    double          late_percent;
+} result_t;
+
+static virtual_t    virtuals[DEVICES_MAX];
+static size_t       virtual_num;
+static int          rate = RATE_DEFAULT;
+static int          seconds = SECONDS_DEFAULT;
+
+///////////////////////////////////////////////////////////////////////////////
+//
+// Measurement
+//
+///////////////////////////////////////////////////////////////////////////////
+
+// Event timestamps come from the realtime clock so the latency does too
+static uint64_t realtime_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_REALTIME, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+static double cpu_ms(const struct rusage *ru)
+{
+    return ru->ru_utime.tv_sec * 1e3 + ru->ru_utime.tv_usec / 1e3 +
+           ru->ru_stime.tv_sec * 1e3 + ru->ru_stime.tv_usec / 1e3;
+}
+
+static long rss_kb(void)
+{
+    FILE *file = fopen("/proc/self/status", "r");
+    if (!file)
+        return 0;
+
+    char line[128];
+    long rss = 0;
+    while (fgets(line, sizeof(line), file))
+        if (sscanf(line, "VmRSS: %ld", &rss) == 1)
+            break;
+
+    fclose(file);
+
+    return rss;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+//
+// Virtual Devices
+//
+///////////////////////////////////////////////////////////////////////////////
+
+static evkey_id_t button_id(int index)
+{
+    // The joystick range only has 16 buttons
+    if (index < 16)
+        return BTN_TRIGGER + index;
+    return BTN_TRIGGER_HAPPY1 + index - 16;
+}
+
+static void virtual_add(void)
+{
+    virtual_t *virt = &virtuals[virtual_num];
+    virt->profile = &profiles[virtual_num % PROFILE_NUM];
+
+    char name[64];
+    xsnprintf(name, sizeof(name), "evjs %s %zu", virt->profile->name, virtual_num + 1);
+
+    evdev_id_t id = { .bus = BUS_VIRTUAL, .vendor = 0x1209, .product = 0xb100 + virtual_num };
+    virt->uidev = uidev_init(name, &id);
+
+    evcal_t cal = { .min = 0, .max = SEQ_MASK };
+    for (int i = 0; i < virt->profile->axes; i++)
+        uidev_abs_add(virt->uidev, ABS_X + i, &cal);
+    for (int i = 0; i < virt->profile->buttons; i++)
+        uidev_key_add(virt->uidev, button_id(i));
+
+    uidev_create(virt->uidev);
+    virt->file = uidev_evdev(virt->uidev);
+
+    virtual_num++;
+}
+
+static void virtual_free(void)
+{
+    for (size_t i = 0; i < virtual_num; i++)
+    {
+        uidev_free(virtuals[i].uidev);
+        xfree(virtuals[i].file);
+    }
+    virtual_num = 0;
+}
+
+// Writes a frame to every device each period from absolute wakeups and
+// counts the periods that started late because the previous one overran
+static void inject(shared_t *shared, size_t num)
+{
+    prctl(PR_SET_TIMERSLACK, INJECT_SLACK_NS);
+
+    struct timespec next;
+    clock_gettime(CLOCK_MONOTONIC, &next);
+    uint64_t frames = (uint64_t)rate * seconds;
+    long period = 1000000000L / rate;
+
+    for (uint64_t seq = 0; seq < frames; seq++)
+    {
+        next.tv_nsec += period;
+        while (next.tv_nsec >= 1000000000)
+        {
+            next.tv_nsec -= 1000000000;
+            next.tv_sec++;
+        }
+
+        struct timespec now;
+        clock_gettime(CLOCK_MONOTONIC, &now);
+        if (now.tv_sec > next.tv_sec || (now.tv_sec == next.tv_sec && now.tv_nsec > next.tv_nsec))
+            shared->late++;
+        else
+            clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &next, NULL);
+
+        for (size_t d = 0; d < num; d++)
+        {
+            virtual_t *virt = &virtuals[d];
+
+            uidev_abs(virt->uidev, ABS_X, seq & SEQ_MASK);
+            for (int i = 1; i < virt->profile->axes; i++)
+                uidev_abs(virt->uidev, ABS_X + i, (seq * (i + 1)) & SEQ_MASK);
+
+            if (virt->profile->buttons && seq % BUTTON_PERIOD == 0)
+            {
+                uint64_t press = seq / BUTTON_PERIOD;
+                uidev_key(virt->uidev, button_id(press / 2 % virt->profile->buttons), press % 2 == 0);
+            }
+
+            __atomic_store_n(&shared->send_ns[d][seq & SEQ_MASK], realtime_ns(), __ATOMIC_RELEASE);
+            uidev_syn(virt->uidev, 0);
+        }
+
+        __atomic_store_n(&shared->sent, seq + 1, __ATOMIC_RELEASE);
+    }
+}
+
+///////////////////////////////////////////////////////////////////////////////
+//
+// Enumeration
+//
+///////////////////////////////////////////////////////////////////////////////
+
+static void scan_count(const char *file, const evdev_id_t *id, const char *name, void *arg)
+{
+    size_t *count = arg;
+    (*count)++;
+}
+
+// The scan that evjstest and evjsd do to list and match devices
+static double bench_scan(void)
+{
+    double ms[SCAN_RUNS];
+
+    for (int i = 0; i < SCAN_RUNS; i++)
+    {
+        size_t count = 0;
+        uint64_t start = now_ns();
+        device_scan(scan_count, &count);
+        ms[i] = (now_ns() - start) / 1e6;
+    }
+
+    sort_double(ms, SCAN_RUNS);
+
+    return ms[percentile(SCAN_RUNS, 50)];
+}
+
+///////////////////////////////////////////////////////////////////////////////
+//
+// Bulk Configuration
+//
+///////////////////////////////////////////////////////////////////////////////
+
+typedef struct db_fill
+{
+    evdev_t *evdev;
+    evidx_t index;
+} db_fill_t;
+
+static bool db_writer(caldb_record_t *rec, void *arg)
+{
+    db_fill_t *fill = arg;
+
+    if (fill->index == evabs_num(fill->evdev))
+        return false;
+
+    rec->axis = evabs_id(fill->evdev, fill->index);
+    evabs_cal_get(fill->evdev, fill->index, &rec->cal);
+    fill->index++;
+
+    return true;
+}
+
+static void db_add(const char *db_file, const char *dev_file)
+{
+    char *err_msg = NULL;
+
+    db_fill_t fill = { .evdev = evdev_init(dev_file) };
+    evabs_init(fill.evdev);
+
+    evdev_id_t id;
+    evdev_id(fill.evdev, &id);
+
+    caldb_t *db = caldb_init(db_file, &err_msg);
+    if (!db)
+        errx(1, "%s: %s", db_file, err_msg);
+
+    if (!caldb_write(db, &id, db_writer, &fill, &err_msg))
+        errx(1, "caldb_write: %s", err_msg);
+
+    caldb_free(db);
+    evdev_free(fill.evdev);
+}
+
+// Every device configured one after the other, as udev does at boot when
+// the whole cockpit is already plugged in
+static void bench_configure(const char *evjscal, const char *db_file, size_t num, result_t *result)
+{
+    struct rusage before, after;
+    getrusage(RUSAGE_CHILDREN, &before);
+    uint64_t start = now_ns();
+
+    for (size_t d = 0; d < num; d++)
+    {
+        pid_t pid = fork();
+        if (pid < 0)
+            err(1, "fork");
+
+        if (pid == 0)
+        {
+            execl(evjscal, evjscal, "-c", "-d", db_file, virtuals[d].file, (char *)NULL);
+            err(127, "%s", evjscal);
+        }
+
+        int status;
+        if (waitpid(pid, &status, 0) < 0)
+            err(1, "waitpid");
+        if (!WIFEXITED(status) || WEXITSTATUS(status) != 0)
+            errx(1, "%s -c %s failed", evjscal, virtuals[d].file);
+    }
+
+    result->config_ms = (now_ns() - start) / 1e6;
+    getrusage(RUSAGE_CHILDREN, &after);
+    result->config_cpu_ms = cpu_ms(&after) - cpu_ms(&before);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+//
+// Monitoring
+//
+///////////////////////////////////////////////////////////////////////////////
+
+static void monitor_syn(evtime_t time, void *arg)
+{
+    watched_t *watched = arg;
+    monitor_t *mon = watched->mon;
+    uint64_t now = realtime_ns();
+
+    // Recover the full sequence number from the low bits carried by the
+    // axis, anything behind the expected frame is a resync repeat
+    axis_t *axis = device_axis_get(watched->dev, ABS_X);
+    uint64_t delta = (axis->raw - watched->next) & SEQ_MASK;
+    if (delta >= SEQ_RANGE / 2)
+        return;
+
+    uint64_t seq = watched->next + delta;
+    mon->lost += delta;
+    watched->next = seq + 1;
+    mon->received++;
+
+    if (mon->latency_num == mon->latency_max)
+        return;
+
+    uint64_t send = __atomic_load_n(&mon->shared->send_ns[watched->index][seq & SEQ_MASK],
+                                    __ATOMIC_ACQUIRE);
+    mon->latency[mon->latency_num++] = now > send ? now - send : 0;
+}
+
+// A single threaded client of every device, as evjsd is when it merges a
+// cockpit, woken by epoll while the injector drives all of them
+static void bench_monitor(size_t num, result_t *result)
+{
+    shared_t *shared = mmap(NULL, sizeof(shared_t), PROT_READ | PROT_WRITE,
+                            MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    if (shared == MAP_FAILED)
+        xerr("mmap");
+
+    long rss_before = rss_kb();
+
+    monitor_t mon = {
+        .shared      = shared,
+        .latency_max = (uint64_t)rate * seconds * num,
+    };
+    mon.latency = xalloc(sizeof(uint64_t) * mon.latency_max);
+
+    int epfd = epoll_create1(EPOLL_CLOEXEC);
+    if (epfd < 0)
+        xerr("epoll_create1");
+
+    watched_t *watched = xalloc(sizeof(watched_t) * num);
+    for (size_t d = 0; d < num; d++)
+    {
+        watched[d] = (watched_t) {
+            .mon   = &mon,
+            .dev   = device_init(virtuals[d].file),
+            .index = d,
+        };
+        device_syn_cb(watched[d].dev, monitor_syn, &watched[d]);
+
+        struct epoll_event ev = { .events = EPOLLIN, .data.ptr = &watched[d] };
+        if (epoll_ctl(epfd, EPOLL_CTL_ADD, device_fileno(watched[d].dev), &ev) < 0)
+            xerr("epoll_ctl");
+    }
+
+    pid_t pid = fork();
+    if (pid < 0)
+        xerr("fork");
+
+    if (pid == 0)
+    {
+        inject(shared, num);
+        _exit(0);
+    }
+
+    struct rusage before, after;
+    getrusage(RUSAGE_SELF, &before);
+    uint64_t start = now_ns();
+
+    bool exited = false;
+    int idle_ms = 0;
+    while (idle_ms < DRAIN_MS)
+    {
+        struct epoll_event events[DEVICES_MAX];
+        int ready = epoll_wait(epfd, events, DEVICES_MAX, exited ? 1 : 100);
+        if (ready < 0)
+        {
+            if (errno == EINTR)
+                continue;
+            xerr("epoll_wait");
+        }
+
+        for (int i = 0; i < ready; i++)
+        {
+            watched_t *w = events[i].data.ptr;
+            device_read(w->dev);
+        }
+
+        if (ready > 0)
+            idle_ms = 0;
+        else if (exited)
+            idle_ms++;
+
+        int status;
+        if (!exited && waitpid(pid, &status, WNOHANG) == pid)
+        {
+            if (!WIFEXITED(status) || WEXITSTATUS(status) != 0)
+                errx(1, "injector failed");
+            exited = true;
+        }
+    }
+
+    double wall_ms = (now_ns() - start) / 1e6;
+    getrusage(RUSAGE_SELF, &after);
+
+    result->rss_kb = rss_kb() - rss_before;
+    result->cpu_percent = 100.0 * (cpu_ms(&after) - cpu_ms(&before)) / wall_ms;
+    result->wakeups = (after.ru_nvcsw - before.ru_nvcsw) * 1000.0 / wall_ms;
+
+    uint64_t sent = shared->sent * num;
+    uint64_t lost = mon.lost;
+    for (size_t d = 0; d < num; d++)
+        if (shared->sent > watched[d].next)
+            lost += shared->sent - watched[d].next;
+
+    result->lost_percent = sent ? 100.0 * lost / sent : 0;
+    result->late_percent = shared->sent ? 100.0 * shared->late / shared->sent : 0;
+
+    if (mon.latency_num > 0)
+    {
+        size_t n = mon.latency_num;
+        sort_u64(mon.latency, n);
+        result->p50_us = mon.latency[percentile(n, 50)] / 1000.0;
+        result->p99_us = mon.latency[percentile(n, 99)] / 1000.0;
+        result->max_us = mon.latency[n - 1] / 1000.0;
+    }
+
+    for (size_t d = 0; d < num; d++)
+        device_free(watched[d].dev);
+    xfree(watched);
+    xfree(mon.latency);
+    close(epfd);
+    munmap(shared, sizeof(shared_t));
+}
+
+///////////////////////////////////////////////////////////////////////////////
+
+static int usage(void)
+{
+    fprintf(stderr,
+        "Usage: bench_scale [OPTION]...\n"
+        "Measure how evjs scales with the number of input devices by creating\n"
+        "a cockpit of uinput sticks, throttles, pedals, wheels and button boxes.\n"
+        "\n"
+        "Options:\n"
+        "  -h, --help            Print this help\n"
+        "  -n, --devices LIST    Comma separated device counts (default %s)\n"
+        "  -r, --rate HZ         Reports per second from each device (default %d)\n"
+        "  -t, --time SECONDS    Length of each monitoring run (default %d)\n"
+        "  -e, --evjscal FILE    The evjscal for bulk configuration (default %s)\n"
+        "\n"
+        "  Each row is one device count.  scan is the median time to list\n"
+        "  /dev/input, config is the wall and CPU time to run 'evjscal -c' on\n"
+        "  every device and the remaining columns are for one process reading\n"
+        "  all devices with epoll: its CPU use, wakeups per second, added\n"
+        "  resident memory, latency from the write to the callback, the frames\n"
+        "  lost and the injector periods that started late.  A late injector\n"
+        "  means the rate was not reached and the other columns are optimistic.\n"
+        "\n"
+        "Examples:\n"
+        "  Measure up to 60 devices at 500 Hz:\n"
+        "    bench_scale -n 10,20,40,60 -r 500\n",
+        SIZES_DEFAULT, RATE_DEFAULT, SECONDS_DEFAULT, EVJSCAL_DEFAULT
+    );
+
+    return 1;
+}
+
+int main(int argc, char *argv[])
+{
+    static struct option long_options[] = {
+        { "help",       no_argument,       NULL,  'h' },
+        { "devices",    required_argument, NULL,  'n' },
+        { "rate",       required_argument, NULL,  'r' },
+        { "time",       required_argument, NULL,  't' },
+        { "evjscal",    required_argument, NULL,  'e' },
+        { 0,            0,                 NULL,  0   }
+    };
+    const char *sizes = SIZES_DEFAULT;
+    const char *evjscal = EVJSCAL_DEFAULT;
+
+    while (1)
+    {
+        int option_index = 0;
+        int c = getopt_long(argc, argv, "hn:r:t:e:", long_options, &option_index);
+        if (c == -1)
+            break;
+
+        switch (c)
+        {
+            case 'n':
+                sizes = optarg;
+                break;
+            case 'r':
+                rate = atoi(optarg);
+                if (rate < 1 || rate > 100000)
+                    errx(1, "Invalid rate");
+                break;
+            case 't':
+                seconds = atoi(optarg);
+                if (seconds < 1)
+                    errx(1, "Invalid time");
+                break;
+            case 'e':
+                evjscal = optarg;
+                break;
+            default:
+            case 'h':
+                return usage();
+        }
+    }
+
+    if (optind != argc)
+        return usage();
+
+    // Validate the whole list before creating any devices
+    size_t size_list[DEVICES_MAX];
+    size_t size_num = 0;
+    for (const char *str = sizes; *str != '\0' && size_num < DEVICES_MAX; )
+    {
+        char *end;
+        long size = strtol(str, &end, 10);
+        if (end == str || size < 1 || size > DEVICES_MAX ||
+            (size_num > 0 && size <= size_list[size_num - 1]))
+            errx(1, "Invalid device counts: %s", sizes);
+        size_list[size_num++] = size;
+        str = (*end == ',') ? end + 1 : end;
+    }
+
+    if (access(UINPUT_FILE, W_OK) != 0)
+    {
+        // Not a failure so that 'make bench' still runs in containers
+        printf("# bench_scale skipped: %s is not writable\n", UINPUT_FILE);
+        return 0;
+    }
+
+    bool config = access(evjscal, X_OK) == 0;
+    if (!config)
+        warnx("%s not found, skipping bulk configuration", evjscal);
+
+    char db_file[] = "/tmp/bench_scale_XXXXXX";
+    int fd = mkstemp(db_file);
+    if (fd < 0)
+        err(1, "mkstemp");
+    close(fd);
+
+    printf("# %d Hz per device for %d s\n", rate, seconds);
+    printf("%4s %8s %10s %10s %6s %10s %8s %8s %8s %9s %7s %7s\n",
+           "# N", "scan ms", "config ms", "config cpu", "cpu %", "wakeups/s",
+           "rss kB", "p50 us", "p99 us", "max us", "lost %", "late %");
+
+    for (size_t s = 0; s < size_num; s++)
+    {
+        size_t num = size_list[s];
+        result_t result = { 0 };
+
+        while (virtual_num < num)
+        {
+            virtual_add();
+            if (config)
+                db_add(db_file, virtuals[virtual_num - 1].file);
+        }
+
+        result.scan_ms = bench_scan();
+        if (config)
+            bench_configure(evjscal, db_file, num, &result);
+        bench_monitor(num, &result);
+
+        printf("%4zu %8.2f %10.1f %10.1f %6.1f %10.0f %8ld %8.1f %8.1f %9.1f %7.3f %7.2f\n",
+               num, result.scan_ms, result.config_ms, result.config_cpu_ms,
+               result.cpu_percent, result.wakeups, result.rss_kb,
+               result.p50_us, result.p99_us, result.max_us,
+               result.lost_percent, result.late_percent);
+        fflush(stdout);
+    }
+
+    virtual_free();
+    unlink(db_file);
+
+    return 0;
+}
@@ -0,0 +1,253 @@
+//  evjs - Evdev Joystick Utilities
+//  Copyright (C) 2020 Scott Shumate <scott@shumatech.com>
+//
+//  This program is free software: you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation, either version 3 of the License, or
+//  (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+#define _GNU_SOURCE
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <time.h>
+#include <getopt.h>
+#include <err.h>
+#include <pthread.h>
+#include <linux/input.h>
+
+#include "util.h"
+#include "device.h"
+#include "shm.h"
+#include "evjs_shm.h"
+
+///////////////////////////////////////////////////////////////////////////////
+
+#define AXES_DEFAULT        8
+#define BUTTONS_DEFAULT     16
+#define SNAPSHOTS_DEFAULT   1000000
+
+typedef struct writer
+{
+    device_t        *dev;
+    shm_t           *shm;
+    volatile bool   running;
+    uint64_t        frames;
+    uint64_t        ns;
+} writer_t;
+
+typedef struct result
+{
+    uint64_t    ns;
+    uint64_t    taken;
+    uint64_t    failed;
+    uint64_t    torn;
+    uint64_t    frames;
+} result_t;
+
+///////////////////////////////////////////////////////////////////////////////
+
+// Every frame sets all axes to the number of the frame before it and all
+// buttons to its low bit, so a snapshot that mixes two frames stands out
+static void *writer_run(void *arg)
+{
+    writer_t *writer = arg;
+    device_t *dev = writer->dev;
+    uint64_t start = now_ns();
+
+    for (uint64_t n = 1; writer->running; n++)
+    {
+        AXIS_FOREACH(dev, axis)
+            dev->axis_soa.value[axis->index] = (int32_t) n;
+        BUTTON_FOREACH(dev, button)
+            button->value = n & 1;
+
+        shm_publish(writer->shm, n);
+        writer->frames++;
+    }
+
+    writer->ns = now_ns() - start;
+    return NULL;
+}
+
+static bool snapshot_check(const evjs_shm_t *shm, const evjs_shm_state_t *state)
+{
+    int32_t expect = (int32_t) (state->frame - 1);
+
+    for (int i = 0; i < shm->axis_num; i++)
+        if (state->axis[i] != expect)
+            return false;
+
+    for (int i = 0; i < shm->button_num; i++)
+        if (evjs_shm_button(state, i) != (expect & 1))
+            return false;
+
+    return true;
+}
+
+static void snapshot_run(const evjs_shm_t *shm, int snapshots, result_t *result)
+{
+    evjs_shm_state_t state;
+    uint64_t start = now_ns();
+
+    for (int i = 0; i < snapshots; i++)
+    {
+        if (!evjs_shm_read(shm, &state))
+            result->failed++;
+        else if (!snapshot_check(shm, &state))
+            result->torn++;
+        else
+            result->taken++;
+    }
+
+    result->ns = now_ns() - start;
+}
+
+static void result_print(const char *name, int snapshots, const result_t *result)
+{
+    double ns = (double) result->ns / snapshots;
+    printf("%-12s %10.1f %12.0f %10llu %8llu %8llu\n", name, ns, 1e9 / ns,
+           (unsigned long long) result->frames,
+           (unsigned long long) result->failed,
+           (unsigned long long) result->torn);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+
+static int usage(void)
+{
+    fprintf(stderr,
+        "Usage: bench_shm [OPTION]...\n"
+        "Measure snapshots of controller state published in shared memory the\n"
+        "way 'evjsd -P' does, and check that no snapshot mixes two frames.\n"
+        "\n"
+        "Options:\n"
+        "  -h, --help            Print this help\n"
+        "  -a, --axes NUM        Number of axes (default %d)\n"
+        "  -b, --buttons NUM     Number of buttons (default %d)\n"
+        "  -n, --snapshots NUM   Snapshots taken per run (default %d)\n"
+        "\n"
+        "  idle takes snapshots of a region that does not change, busy takes\n"
+        "  them while another thread publishes frames as fast as it can.  Each\n"
+        "  line gives the ns and rate of snapshots, the frames published during\n"
+        "  the run, the snapshots that gave up and the ones that were torn,\n"
+        "  which must be 0.  The publish line is the cost of one frame.\n"
+        "\n"
+        "Examples:\n"
+        "  Measure a 32 axis device:\n"
+        "    bench_shm -a 32\n",
+        AXES_DEFAULT, BUTTONS_DEFAULT, SNAPSHOTS_DEFAULT
+    );
+
+    return 1;
+}
+
+int main(int argc, char *argv[])
+{
+    static struct option long_options[] = {
+        { "help",       no_argument,       NULL,  'h' },
+        { "axes",       required_argument, NULL,  'a' },
+        { "buttons",    required_argument, NULL,  'b' },
+        { "snapshots",  required_argument, NULL,  'n' },
+        { 0,            0,                 NULL,  0   }
+    };
+    int axes = AXES_DEFAULT;
+    int buttons = BUTTONS_DEFAULT;
+    int snapshots = SNAPSHOTS_DEFAULT;
+
+    while (1)
+    {
+        int option_index = 0;
+        int c = getopt_long(argc, argv, "ha:b:n:", long_options, &option_index);
+        if (c == -1)
+            break;
+
+        switch (c)
+        {
+            case 'a':
+                axes = atoi(optarg);
+                if (axes < 1 || axes > ABS_CNT)
+                    errx(1, "Invalid number of axes");
+                break;
+            case 'b':
+                buttons = atoi(optarg);
+                if (buttons < 0 || buttons > KEY_CNT - BTN_JOYSTICK)
+                    errx(1, "Invalid number of buttons");
+                break;
+            case 'n':
+                snapshots = atoi(optarg);
+                if (snapshots < 1)
+                    errx(1, "Invalid number of snapshots");
+                break;
+            default:
+            case 'h':
+                return usage();
+        }
+    }
+
+    if (optind != argc)
+        return usage();
+
+    if (access(EVJS_SHM_DIR, W_OK) != 0)
+    {
+        // Not a failure so that 'make bench' still runs in containers
+        printf("# bench_shm skipped: %s is not writable\n", EVJS_SHM_DIR);
+        return 0;
+    }
+
+    int fds[2];
+    if (pipe(fds) < 0)
+        err(1, "pipe");
+
+    char file[32];
+    xsnprintf(file, sizeof(file), "bench_shm-%d", getpid());
+
+    writer_t writer = { .dev = device_init_synth(fds[0], axes, buttons) };
+    writer.dev->file = file;
+    writer.shm = shm_init(writer.dev);
+
+    evjs_shm_t *shm = evjs_shm_open(shm_path(writer.shm));
+    if (!shm)
+        errx(1, "%s: cannot open", shm_path(writer.shm));
+
+    printf("# %s: %d axes, %d buttons, %zu byte region\n", shm_path(writer.shm),
+           axes, buttons, sizeof(evjs_shm_t));
+    printf("%-12s %10s %12s %10s %8s %8s\n", "# run", "ns", "per sec", "frames", "failed", "torn");
+
+    result_t idle = { 0 };
+    snapshot_run(shm, snapshots, &idle);
+    result_print("idle", snapshots, &idle);
+
+    writer.running = true;
+    pthread_t thread;
+    if (pthread_create(&thread, NULL, writer_run, &writer) != 0)
+        errx(1, "pthread_create");
+
+    result_t busy = { 0 };
+    snapshot_run(shm, snapshots, &busy);
+
+    writer.running = false;
+    pthread_join(thread, NULL);
+    busy.frames = writer.frames;
+    result_print("busy", snapshots, &busy);
+
+    printf("%-12s %10.1f %12.0f %10llu\n", "publish", (double) writer.ns / writer.frames,
+           1e9 * writer.frames / writer.ns, (unsigned long long) writer.frames);
+
+    evjs_shm_close(shm);
+    shm_free(writer.shm);
+    device_free(writer.dev);
+    close(fds[1]);
+
+    return busy.torn != 0;
+}
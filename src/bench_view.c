@@ -0,0 +1,398 @@
+//  evjs - Evdev Joystick Utilities
+//  Copyright (C) 2020 Scott Shumate <scott@shumatech.com>
+//
+//  This program is free software: you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation, either version 3 of the License, or
+//  (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+#define _GNU_SOURCE
+#include <stdlib.h>
+#include <stdint.h>
+#include <inttypes.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <math.h>
+#include <time.h>
+#include <getopt.h>
+#include <err.h>
+#include <sys/ioctl.h>
+#include <linux/input.h>
+
+#include "util.h"
+#include "device.h"
+#include "view.h"
+
+///////////////////////////////////////////////////////////////////////////////
+
+typedef struct event
+{
+    evtime_t time;
+    int      axis;
+    int      value;
+} event_t;
+
+typedef struct bench
+{
+    int         master;
+    FILE        *out;
+    size_t      frame_num;
+    uint64_t    *frame_bytes;
+    uint64_t    frame_ns;
+} bench_t;
+
+#define AXIS_NUM_DEFAULT    6
+#define BUTTON_NUM_DEFAULT  12
+#define EVENT_RATE_DEFAULT  1000
+#define FRAME_RATE_DEFAULT  60
+#define SECONDS_DEFAULT     10
+#define TERM_COLS           120
+#define TERM_ROWS           40
+
+static const char *axis_names[] = {
+    "X", "Y", "Z", "RX", "RY", "RZ", "THROTTLE", "RUDDER",
+};
+
+#define AXIS_NAME_NUM       (sizeof(axis_names) / sizeof(axis_names[0]))
+
+///////////////////////////////////////////////////////////////////////////////
+//
+// Input Generation
+//
+///////////////////////////////////////////////////////////////////////////////
+
+static event_t *synth(int axis_num, int rate, int seconds, size_t *num)
+{
+    size_t count = (size_t)rate * seconds * axis_num;
+    event_t *events = xalloc(sizeof(event_t) * count);
+    uint32_t seed = 0x2545f491;
+
+    // Each report moves every axis along its own slow sweep plus sensor noise
+    size_t n = 0;
+    for (int i = 0; i < rate * seconds; i++)
+    {
+        double t = (double)i / rate;
+        for (int a = 0; a < axis_num; a++)
+        {
+            seed = seed * 1103515245 + 12345;
+            events[n].time = (evtime_t)i * 1000000 / rate;
+            events[n].axis = a;
+            events[n].value = 30000 * sin(2 * M_PI * t * (0.2 + 0.1 * a)) +
+                              (int)((seed >> 16) % 64) - 32;
+            n++;
+        }
+    }
+
+    *num = n;
+    return events;
+}
+
+static event_t *replay(const char *file, int axis_num, size_t *num)
+{
+    FILE *fp = fopen(file, "r");
+    if (!fp)
+        err(1, "%s", file);
+
+    size_t count = 0;
+    size_t size = 1024;
+    event_t *events = xalloc(sizeof(event_t) * size);
+
+    char line[256];
+    while (fgets(line, sizeof(line), fp))
+    {
+        unsigned long long time;
+        int axis, value;
+        if (sscanf(line, "%llu%*[ ,\t]%d%*[ ,\t]%d", &time, &axis, &value) != 3)
+            continue;
+        if (axis < 0 || axis >= axis_num)
+            continue;
+
+        if (count == size)
+        {
+            size *= 2;
+            events = xrealloc(events, sizeof(event_t) * size);
+        }
+
+        events[count++] = (event_t) { .time = time, .axis = axis, .value = value };
+    }
+
+    fclose(fp);
+
+    if (count == 0)
+        errx(1, "%s: no events", file);
+
+    *num = count;
+    return events;
+}
+
+static device_t *device_synth(int axis_num, int button_num)
+{
+    device_t *dev = xalloc(sizeof(device_t));
+
+    dev->file = "/dev/input/bench";
+    dev->name = xstrdup("Synthetic Joystick");
+
+    dev->axis_num = axis_num;
+    dev->axis_array = xalloc(sizeof(axis_t) * axis_num);
+    for (int i = 0; i < axis_num; i++)
+    {
+        axis_t *axis = &dev->axis_array[i];
+        axis->id = i;
+        axis->index = i;
+        axis->name = axis_names[i % AXIS_NAME_NUM];
+        axis->cal.min = -32768;
+        axis->cal.max = 32767;
+        filter_init(&axis->filter, FILTER_NONE, 0, 0);
+    }
+
+    dev->button_num = button_num;
+    if (button_num > 0)
+        dev->button_array = xalloc(sizeof(button_t) * button_num);
+    for (int i = 0; i < button_num; i++)
+    {
+        dev->button_array[i].id = BTN_JOYSTICK + i;
+        dev->button_array[i].index = i;
+    }
+
+    return dev;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+//
+// Terminal Capture
+//
+///////////////////////////////////////////////////////////////////////////////
+
+static void pty_open(bench_t *bench)
+{
+    bench->master = posix_openpt(O_RDWR | O_NOCTTY);
+    if (bench->master < 0 || grantpt(bench->master) < 0 || unlockpt(bench->master) < 0)
+        err(1, "pty");
+
+    int slave = open(ptsname(bench->master), O_RDWR | O_NOCTTY);
+    if (slave < 0)
+        err(1, "%s", ptsname(bench->master));
+
+    struct winsize ws = { .ws_row = TERM_ROWS, .ws_col = TERM_COLS };
+    if (ioctl(slave, TIOCSWINSZ, &ws) < 0)
+        err(1, "TIOCSWINSZ");
+
+    fcntl(bench->master, F_SETFL, O_NONBLOCK);
+
+    // The view draws on stdin/stdout so point them at the pty and keep
+    // the original stdout for the report
+    bench->out = fdopen(dup(STDOUT_FILENO), "w");
+    if (!bench->out)
+        err(1, "stdout");
+
+    dup2(slave, STDIN_FILENO);
+    dup2(slave, STDOUT_FILENO);
+    close(slave);
+
+    setenv("TERM", "xterm", 1);
+    unsetenv("LINES");
+    unsetenv("COLUMNS");
+}
+
+static size_t pty_drain(bench_t *bench)
+{
+    char buf[4096];
+    size_t total = 0;
+    ssize_t got;
+
+    while ((got = read(bench->master, buf, sizeof(buf))) > 0)
+        total += got;
+
+    return total;
+}
+
+static void frame(bench_t *bench, view_t *view)
+{
+    uint64_t start = now_ns();
+    view_frame(view);
+    bench->frame_ns += now_ns() - start;
+
+    bench->frame_bytes[bench->frame_num++] = pty_drain(bench);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+
+static int usage(void)
+{
+    fprintf(stderr,
+        "Usage: bench_view [OPTION]... [REPLAY]\n"
+        "Render an axis event stream through the evjstest view into a pty and\n"
+        "count the terminal bytes written per frame.\n"
+        "\n"
+        "Options:\n"
+        "  -h, --help            Print this help\n"
+        "  -a, --axes NUM        Number of axes (default %d)\n"
+        "  -b, --buttons NUM     Number of buttons (default %d)\n"
+        "  -r, --rate HZ         Synthetic report rate (default %d)\n"
+        "  -f, --fps RATE        Frame rate (default %d)\n"
+        "  -s, --seconds SECS    Synthetic stream length (default %d)\n"
+        "  -c, --cursors         Show the calibration cursors\n"
+        "  -n, --devices NUM     Stream to NUM devices in a dashboard (default 1)\n"
+        "\n"
+        "  REPLAY is a text file of [time in us],[axis index],[value] lines.\n",
+        AXIS_NUM_DEFAULT, BUTTON_NUM_DEFAULT, EVENT_RATE_DEFAULT,
+        FRAME_RATE_DEFAULT, SECONDS_DEFAULT
+    );
+
+    return 1;
+}
+
+int main(int argc, char *argv[])
+{
+    static struct option long_options[] = {
+        { "help",       no_argument,       NULL,  'h' },
+        { "axes",       required_argument, NULL,  'a' },
+        { "buttons",    required_argument, NULL,  'b' },
+        { "rate",       required_argument, NULL,  'r' },
+        { "fps",        required_argument, NULL,  'f' },
+        { "seconds",    required_argument, NULL,  's' },
+        { "cursors",    no_argument,       NULL,  'c' },
+        { "devices",    required_argument, NULL,  'n' },
+        { 0,            0,                 NULL,  0   }
+    };
+    int axis_num = AXIS_NUM_DEFAULT;
+    int button_num = BUTTON_NUM_DEFAULT;
+    int rate = EVENT_RATE_DEFAULT;
+    int fps = FRAME_RATE_DEFAULT;
+    int seconds = SECONDS_DEFAULT;
+    bool cursors = false;
+    int dev_num = 1;
+
+    while (1)
+    {
+        int option_index = 0;
+        int c = getopt_long(argc, argv, "ha:b:r:f:s:cn:", long_options, &option_index);
+        if (c == -1)
+            break;
+
+        switch (c)
+        {
+            case 'a':
+                axis_num = atoi(optarg);
+                break;
+            case 'b':
+                button_num = atoi(optarg);
+                break;
+            case 'r':
+                rate = atoi(optarg);
+                break;
+            case 'f':
+                fps = atoi(optarg);
+                break;
+            case 's':
+                seconds = atoi(optarg);
+                break;
+            case 'c':
+                cursors = true;
+                break;
+            case 'n':
+                dev_num = atoi(optarg);
+                break;
+            default:
+            case 'h':
+                return usage();
+        }
+    }
+
+    if (axis_num < 1 || button_num < 0 || rate < 1 || fps < 1 || seconds < 1 || dev_num < 1)
+        return usage();
+
+    size_t event_num;
+    event_t *events;
+    if (optind == argc - 1)
+        events = replay(argv[optind], axis_num, &event_num);
+    else if (optind == argc)
+        events = synth(axis_num, rate, seconds, &event_num);
+    else
+        return usage();
+
+    bench_t bench = { 0 };
+    evtime_t period = 1000000 / fps;
+    evtime_t start = events[0].time;
+    size_t frame_max = (events[event_num - 1].time - start) / period + 2;
+    bench.frame_bytes = xalloc(sizeof(uint64_t) * frame_max);
+
+    pty_open(&bench);
+
+    device_t **dev_array = xalloc(sizeof(device_t *) * dev_num);
+    for (int i = 0; i < dev_num; i++)
+        dev_array[i] = device_synth(axis_num, button_num);
+    view_t *view = view_init(dev_array, dev_num, "bench.db");
+    size_t setup_bytes = pty_drain(&bench);
+
+    if (cursors)
+        view_axis_cursors_set(view, true);
+
+    // Replay the events and render a frame at every frame boundary
+    evtime_t next = start + period;
+    for (size_t i = 0; i < event_num; i++)
+    {
+        event_t *ev = &events[i];
+
+        while (ev->time >= next && bench.frame_num < frame_max - 1)
+        {
+            frame(&bench, view);
+            next += period;
+        }
+
+        // Every device streams the same events
+        for (int d = 0; d < dev_num; d++)
+        {
+            device_t *dev = dev_array[d];
+            axis_t *axis = &dev->axis_array[ev->axis];
+            axis->value = ev->value;
+            if (axis->value > axis->maximum)
+                axis->maximum = axis->value;
+            if (axis->value < axis->minimum)
+                axis->minimum = axis->value;
+            view_axis_value(view, axis, axis->value);
+
+            // Press a button every so often so the button window is exercised
+            if (button_num > 0 && ev->axis == 0 && (i / axis_num) % 250 == 0)
+            {
+                button_t *button = &dev->button_array[(i / 250) % button_num];
+                button->value = !button->value;
+                view_button_value(view, button, button->value);
+            }
+        }
+    }
+    frame(&bench, view);
+
+    view_free(view);
+    pty_drain(&bench);
+
+    size_t total = 0;
+    for (size_t i = 0; i < bench.frame_num; i++)
+        total += bench.frame_bytes[i];
+    sort_u64(bench.frame_bytes, bench.frame_num);
+
+    fprintf(bench.out, "devices %d events %zu frames %zu setup_bytes %zu total_bytes %zu\n",
+            dev_num, event_num * dev_num, bench.frame_num, setup_bytes, total);
+    fprintf(bench.out, "bytes/frame mean %.1f p50 %" PRIu64 " p99 %" PRIu64 " max %" PRIu64 "\n",
+            (double)total / bench.frame_num,
+            bench.frame_bytes[percentile(bench.frame_num, 50)],
+            bench.frame_bytes[percentile(bench.frame_num, 99)],
+            bench.frame_bytes[bench.frame_num - 1]);
+    fprintf(bench.out, "ns/frame %.0f\n", (double)bench.frame_ns / bench.frame_num);
+    fclose(bench.out);
+
+    xfree(bench.frame_bytes);
+    xfree(events);
+
+    return 0;
+}
@@ -23,6 +23,7 @@
 
 #include "caldb.h"
 #include "util.h"
+#include "trace.h"
 
 struct caldb
 {
@@ -31,6 +32,8 @@ struct caldb
 
 bool caldb_write(caldb_t *db, const evdev_id_t *dev, caldb_writer_t writer, void *arg, char **err_msg)
 {
+    TRACE_SCOPE("caldb_write");
+
     if (err_msg)
         *err_msg = NULL;
 
@@ -103,6 +106,8 @@ static int caldb_read_callback(void **data, int argc, char **argv, char **col_na
 
 bool caldb_read(caldb_t *db, const evdev_id_t *dev, caldb_reader_t reader, void *arg, char **err_msg)
 {
+    TRACE_SCOPE("caldb_read");
+
     if (err_msg)
         *err_msg = NULL;
 
@@ -132,6 +137,8 @@ bool caldb_read(caldb_t *db, const evdev_id_t *dev, caldb_reader_t reader, void
 
 bool caldb_delete(caldb_t *db, const evdev_id_t *dev, char **err_msg)
 {
+    TRACE_SCOPE("caldb_delete");
+
     if (err_msg)
         *err_msg = NULL;
 
@@ -154,6 +161,287 @@ bool caldb_delete(caldb_t *db, const evdev_id_t *dev, char **err_msg)
 
 }
 
+bool caldb_filter_write(caldb_t *db, const evdev_id_t *dev, caldb_filter_writer_t writer, void *arg, char **err_msg)
+{
+    TRACE_SCOPE("caldb_filter_write");
+
+    if (err_msg)
+        *err_msg = NULL;
+
+    if (sqlite3_exec(db->sqlite3, "BEGIN;", NULL, 0, err_msg) != SQLITE_OK)
+        return false;
+
+    caldb_filter_record_t rec;
+    while (writer(&rec, arg))
+    {
+        char *sql = NULL;
+        xasprintf(&sql,
+            "REPLACE INTO filter "
+            "VALUES(%d,%d,%d,%d,%d,%d,%d);",
+            dev->bus, dev->vendor, dev->product, rec.axis,
+            rec.type, rec.param1, rec.param2);
+
+        int rc = sqlite3_exec(db->sqlite3, sql, NULL, 0, err_msg);
+        xfree(sql);
+
+        if (rc != SQLITE_OK)
+        {
+            sqlite3_exec(db->sqlite3, "ROLLBACK;", NULL, 0, NULL);
+            return false;
+        }
+    }
+
+    if (sqlite3_exec(db->sqlite3, "COMMIT;", NULL, 0, err_msg) != SQLITE_OK)
+        return false;
+
+    if (err_msg && *err_msg) {
+        xfree(*err_msg);
+        *err_msg = NULL;
+    }
+
+    return true;
+}
+
+static int caldb_filter_read_callback(void **data, int argc, char **argv, char **col_name)
+{
+    caldb_filter_reader_t reader = data[0];
+    void *arg = data[1];
+    caldb_filter_record_t rec = { 0 };
+
+    for (int i = 0; i < argc; i++)
+    {
+        if (strcmp(col_name[i], "axis") == 0)
+            rec.axis = atoi(argv[i]);
+        else if (strcmp(col_name[i], "type") == 0)
+            rec.type = atoi(argv[i]);
+        else if (strcmp(col_name[i], "param1") == 0)
+            rec.param1 = atoi(argv[i]);
+        else if (strcmp(col_name[i], "param2") == 0)
+            rec.param2 = atoi(argv[i]);
+    }
+
+    if (!reader(&rec, arg))
+        return -1;
+
+    return 0;
+}
+
+bool caldb_filter_read(caldb_t *db, const evdev_id_t *dev, caldb_filter_reader_t reader, void *arg, char **err_msg)
+{
+    TRACE_SCOPE("caldb_filter_read");
+
+    if (err_msg)
+        *err_msg = NULL;
+
+    char *sql = NULL;
+    xasprintf(&sql, "SELECT * FROM filter WHERE bus=%d and vendor=%d AND product=%d;",
+              dev->bus, dev->vendor, dev->product);
+
+    void *data[] = { reader, arg };
+    int rc = sqlite3_exec(db->sqlite3, sql, (void*)caldb_filter_read_callback, data, err_msg);
+    xfree(sql);
+
+    if (rc != SQLITE_OK && rc != SQLITE_ABORT)
+        return false;
+
+    if (err_msg && *err_msg) {
+        xfree(*err_msg);
+        *err_msg = NULL;
+    }
+
+    return true;
+}
+
+bool caldb_map_write(caldb_t *db, const char *name, caldb_map_writer_t writer, void *arg, char **err_msg)
+{
+    TRACE_SCOPE("caldb_map_write");
+
+    if (err_msg)
+        *err_msg = NULL;
+
+    if (sqlite3_exec(db->sqlite3, "BEGIN;", NULL, 0, err_msg) != SQLITE_OK)
+        return false;
+
+    caldb_map_record_t rec;
+    while (writer(&rec, arg))
+    {
+        char *sql = sqlite3_mprintf(
+            "REPLACE INTO composite "
+            "VALUES(%Q,%d,%d,%d,%d,%d,%d);",
+            name, rec.dev.bus, rec.dev.vendor, rec.dev.product,
+            rec.type, rec.code, rec.target);
+
+        int rc = sqlite3_exec(db->sqlite3, sql, NULL, 0, err_msg);
+        sqlite3_free(sql);
+
+        if (rc != SQLITE_OK)
+        {
+            sqlite3_exec(db->sqlite3, "ROLLBACK;", NULL, 0, NULL);
+            return false;
+        }
+    }
+
+    if (sqlite3_exec(db->sqlite3, "COMMIT;", NULL, 0, err_msg) != SQLITE_OK)
+        return false;
+
+    if (err_msg && *err_msg) {
+        xfree(*err_msg);
+        *err_msg = NULL;
+    }
+
+    return true;
+}
+
+static int caldb_map_read_callback(void **data, int argc, char **argv, char **col_name)
+{
+    caldb_map_reader_t reader = data[0];
+    void *arg = data[1];
+    caldb_map_record_t rec = { 0 };
+
+    for (int i = 0; i < argc; i++)
+    {
+        if (strcmp(col_name[i], "bus") == 0)
+            rec.dev.bus = atoi(argv[i]);
+        else if (strcmp(col_name[i], "vendor") == 0)
+            rec.dev.vendor = atoi(argv[i]);
+        else if (strcmp(col_name[i], "product") == 0)
+            rec.dev.product = atoi(argv[i]);
+        else if (strcmp(col_name[i], "type") == 0)
+            rec.type = atoi(argv[i]);
+        else if (strcmp(col_name[i], "code") == 0)
+            rec.code = atoi(argv[i]);
+        else if (strcmp(col_name[i], "target") == 0)
+            rec.target = atoi(argv[i]);
+    }
+
+    if (!reader(&rec, arg))
+        return -1;
+
+    return 0;
+}
+
+bool caldb_map_read(caldb_t *db, const char *name, caldb_map_reader_t reader, void *arg, char **err_msg)
+{
+    TRACE_SCOPE("caldb_map_read");
+
+    if (err_msg)
+        *err_msg = NULL;
+
+    char *sql = sqlite3_mprintf("SELECT * FROM composite WHERE name=%Q "
+                                "ORDER BY bus, vendor, product, type, code;", name);
+
+    void *data[] = { reader, arg };
+    int rc = sqlite3_exec(db->sqlite3, sql, (void*)caldb_map_read_callback, data, err_msg);
+    sqlite3_free(sql);
+
+    if (rc != SQLITE_OK && rc != SQLITE_ABORT)
+        return false;
+
+    if (err_msg && *err_msg) {
+        xfree(*err_msg);
+        *err_msg = NULL;
+    }
+
+    return true;
+}
+
+bool caldb_map_delete(caldb_t *db, const char *name, char **err_msg)
+{
+    TRACE_SCOPE("caldb_map_delete");
+
+    if (err_msg)
+        *err_msg = NULL;
+
+    char *sql = sqlite3_mprintf("DELETE FROM composite WHERE name=%Q;", name);
+
+    int rc = sqlite3_exec(db->sqlite3, sql, NULL, NULL, err_msg);
+    sqlite3_free(sql);
+
+    if (rc != SQLITE_OK && rc != SQLITE_ABORT)
+        return false;
+
+    if (err_msg && *err_msg) {
+        xfree(*err_msg);
+        *err_msg = NULL;
+    }
+
+    return true;
+}
+
+static int caldb_map_list_callback(void **data, int argc, char **argv, char **col_name)
+{
+    caldb_map_lister_t lister = data[0];
+    void *arg = data[1];
+
+    if (argc < 1 || !lister(argv[0], arg))
+        return -1;
+
+    return 0;
+}
+
+bool caldb_map_list(caldb_t *db, caldb_map_lister_t lister, void *arg, char **err_msg)
+{
+    TRACE_SCOPE("caldb_map_list");
+
+    if (err_msg)
+        *err_msg = NULL;
+
+    void *data[] = { lister, arg };
+    int rc = sqlite3_exec(db->sqlite3, "SELECT DISTINCT name FROM composite ORDER BY name;",
+                          (void*)caldb_map_list_callback, data, err_msg);
+
+    if (rc != SQLITE_OK && rc != SQLITE_ABORT)
+        return false;
+
+    if (err_msg && *err_msg) {
+        xfree(*err_msg);
+        *err_msg = NULL;
+    }
+
+    return true;
+}
+
+
+bool caldb_drift_write(caldb_t *db, const evdev_id_t *dev, caldb_drift_writer_t writer, void *arg, char **err_msg)
+{
+    TRACE_SCOPE("caldb_drift_write");
+
+    if (err_msg)
+        *err_msg = NULL;
+
+    if (sqlite3_exec(db->sqlite3, "BEGIN;", NULL, 0, err_msg) != SQLITE_OK)
+        return false;
+
+    caldb_drift_record_t rec;
+    while (writer(&rec, arg))
+    {
+        char *sql = NULL;
+        xasprintf(&sql,
+            "REPLACE INTO drift "
+            "VALUES(%d,%d,%d,%d,%lld,%d,%d,%d,%d,%d);",
+            dev->bus, dev->vendor, dev->product, rec.axis, (long long)rec.time,
+            rec.min, rec.max, rec.rest, rec.range_drift, rec.center_drift);
+
+        int rc = sqlite3_exec(db->sqlite3, sql, NULL, 0, err_msg);
+        xfree(sql);
+
+        if (rc != SQLITE_OK)
+        {
+            sqlite3_exec(db->sqlite3, "ROLLBACK;", NULL, 0, NULL);
+            return false;
+        }
+    }
+
+    if (sqlite3_exec(db->sqlite3, "COMMIT;", NULL, 0, err_msg) != SQLITE_OK)
+        return false;
+
+    if (err_msg && *err_msg) {
+        xfree(*err_msg);
+        *err_msg = NULL;
+    }
+
+    return true;
+}
 
 void caldb_err_free(char *err_msg)
 {
@@ -162,6 +450,8 @@ void caldb_err_free(char *err_msg)
 
 caldb_t *caldb_init(const char *file, char **err_msg)
 {
+    TRACE_SCOPE("caldb_init");
+
     if (err_msg)
         *err_msg = NULL;
 
@@ -186,6 +476,39 @@ caldb_t *caldb_init(const char *file, char **err_msg)
         "fuzz    INT,"
         "flat    INT,"
         "PRIMARY KEY (bus, vendor, product, axis)"
+        ");"
+        "CREATE TABLE IF NOT EXISTS composite("
+        "name    TEXT NOT NULL,"
+        "bus     INT NOT NULL,"
+        "vendor  INT NOT NULL,"
+        "product INT NOT NULL,"
+        "type    INT NOT NULL,"
+        "code    INT NOT NULL,"
+        "target  INT,"
+        "PRIMARY KEY (name, bus, vendor, product, type, code)"
+        ");"
+        "CREATE TABLE IF NOT EXISTS filter("
+        "bus     INT NOT NULL,"
+        "vendor  INT NOT NULL,"
+        "product INT NOT NULL,"
+        "axis    INT NOT NULL,"
+        "type    INT,"
+        "param1  INT,"
+        "param2  INT,"
+        "PRIMARY KEY (bus, vendor, product, axis)"
+        ");"
+        "CREATE TABLE IF NOT EXISTS drift("
+        "bus          INT NOT NULL,"
+        "vendor       INT NOT NULL,"
+        "product      INT NOT NULL,"
+        "axis         INT NOT NULL,"
+        "time         INT NOT NULL,"
+        "min          INT,"
+        "max          INT,"
+        "rest         INT,"
+        "range_drift  INT,"
+        "center_drift INT,"
+        "PRIMARY KEY (bus, vendor, product, axis, time)"
         ");";
 
     rc = sqlite3_exec(db->sqlite3, sql, NULL, 0, err_msg);
@@ -15,6 +15,7 @@
 //  along with this program.  If not, see <http://www.gnu.org/licenses/>.
 #pragma once
 
+#include <stdint.h>
 #include <stdbool.h>
 
 #include "config.h"
@@ -41,6 +42,59 @@ bool caldb_write(caldb_t *db, const evdev_id_t *dev, caldb_writer_t writer, void
 
 bool caldb_delete(caldb_t *db, const evdev_id_t *dev, char **err_msg);
 
+typedef struct caldb_filter_record
+{
+    int        axis;
+    int        type;
+    int        param1;
+    int        param2;
+} caldb_filter_record_t;
+
+typedef bool (*caldb_filter_reader_t)(const caldb_filter_record_t *rec, void *arg);
+
+bool caldb_filter_read(caldb_t *db, const evdev_id_t *dev, caldb_filter_reader_t reader, void *arg, char **err_msg);
+
+typedef bool (*caldb_filter_writer_t)(caldb_filter_record_t *rec, void *arg);
+
+bool caldb_filter_write(caldb_t *db, const evdev_id_t *dev, caldb_filter_writer_t writer, void *arg, char **err_msg);
+
+typedef struct caldb_map_record
+{
+    evdev_id_t dev;
+    int        type;
+    int        code;
+    int        target;
+} caldb_map_record_t;
+
+typedef bool (*caldb_map_reader_t)(const caldb_map_record_t *rec, void *arg);
+
+bool caldb_map_read(caldb_t *db, const char *name, caldb_map_reader_t reader, void *arg, char **err_msg);
+
+typedef bool (*caldb_map_writer_t)(caldb_map_record_t *rec, void *arg);
+
+bool caldb_map_write(caldb_t *db, const char *name, caldb_map_writer_t writer, void *arg, char **err_msg);
+
+bool caldb_map_delete(caldb_t *db, const char *name, char **err_msg);
+
+typedef bool (*caldb_map_lister_t)(const char *name, void *arg);
+
+bool caldb_map_list(caldb_t *db, caldb_map_lister_t lister, void *arg, char **err_msg);
+
+typedef struct caldb_drift_record
+{
+    int     axis;
+    int64_t time;
+    int     min;
+    int     max;
+    int     rest;
+    int     range_drift;
+    int     center_drift;
+} caldb_drift_record_t;
+
+typedef bool (*caldb_drift_writer_t)(caldb_drift_record_t *rec, void *arg);
+
+bool caldb_drift_write(caldb_t *db, const evdev_id_t *dev, caldb_drift_writer_t writer, void *arg, char **err_msg);
+
 void caldb_err_free(char *err_msg);
 
 caldb_t *caldb_init(const char *file, char **err_msg);
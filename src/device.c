@@ -25,6 +25,9 @@
 #include <sys/types.h>
 #include <sys/stat.h>
 #include <fcntl.h>
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#endif
 
 #include "device.h"
 #include "util.h"
@@ -35,6 +38,13 @@
 
 #define eprintf(...)        fprintf(stderr, __VA_ARGS__)
 
+// Every SoA array is an int32_t or a float per axis
+#define AXIS_SOA_ARRAYS     (sizeof(axis_soa_t) / sizeof(int32_t *))
+_Static_assert(sizeof(float) == sizeof(int32_t), "axis_soa_t layout");
+
+#define NORMALIZE_MIN       -32768.0f
+#define NORMALIZE_MAX       32767.0f
+
 ///////////////////////////////////////////////////////////////////////////////
 //
 // Button Functions
@@ -75,20 +85,52 @@ button_t *device_button_get(device_t *dev, int id)
 //
 ///////////////////////////////////////////////////////////////////////////////
 
+// Mirror the calibration of an axis into the SoA arrays
+static void axis_soa_cal(device_t *dev, axis_t *axis)
+{
+    axis_soa_t *soa = &dev->axis_soa;
+    const evcal_t *cal = &axis->cal;
+    int index = axis->index;
+
+    int center = cal->min + (cal->max - cal->min) / 2;
+    int neg = center - cal->flat - cal->min;
+    int pos = cal->max - center - cal->flat;
+
+    soa->min[index]       = cal->min;
+    soa->max[index]       = cal->max;
+    soa->flat[index]      = cal->flat;
+    soa->center[index]    = center;
+    soa->scale_neg[index] = neg > 0 ? 32768.0f / neg : 0.0f;
+    soa->scale_pos[index] = pos > 0 ? 32767.0f / pos : 0.0f;
+}
+
 static void axis_value(evidx_t index, int value, void *arg)
 {
     device_t *dev = arg;
     axis_t *axis = &dev->axis_array[index];
+    axis_soa_t *soa = &dev->axis_soa;
 
+    // Calibration tracks the raw extremes so a filter cannot hide them
     if (value > axis->maximum)
-        axis->maximum = value;
+        axis->maximum = soa->maximum[index] = value;
 
     if (value < axis->minimum)
-        axis->minimum = value;
+        axis->minimum = soa->minimum[index] = value;
 
-    axis->value = value;
+    evtime_t time = evdev_time(dev->evdev);
 
-    dev->axis_array[index].value = value;
+    axis->raw = value;
+    axis->value = filter_apply(&axis->filter, value, time);
+    soa->value[index] = axis->value;
+
+    if (axis->ring)
+    {
+        sample_t *sample = AXIS_RING_SAMPLE(axis->ring, axis->ring->head);
+        sample->time  = time;
+        sample->raw   = value;
+        sample->value = axis->value;
+        axis->ring->head++;
+    }
 
     if (dev->axis_cb)
         dev->axis_cb(axis, dev->arg_cb);
@@ -104,9 +146,16 @@ static void axis_add(evidx_t index, void *arg)
     axis->index = index;
     axis->name = evabs_name(dev->evdev, index);
     axis->value = evabs_value(dev->evdev, index);
+    axis->raw = axis->value;
     axis->minimum = axis->value;
     axis->maximum = axis->value;
     evabs_cal_get(dev->evdev, index, &axis->cal);
+    filter_init(&axis->filter, FILTER_NONE, 0, 0);
+
+    dev->axis_soa.value[index]   = axis->value;
+    dev->axis_soa.minimum[index] = axis->minimum;
+    dev->axis_soa.maximum[index] = axis->maximum;
+    axis_soa_cal(dev, axis);
 }
 
 axis_t *device_axis_get(device_t *dev, int id)
@@ -137,7 +186,7 @@ static void effect_add(evidx_t index, void *arg)
     device_t *dev = arg;
     effect_t *effect = &dev->effect_array[index];
 
-    effect->id = evff_map(dev->evdev, index);
+    effect->id = evff_id(dev->evdev, index);
     effect->index = index;
     effect->name = evff_name(dev->evdev, index);
     effect->type = evff_type(dev->evdev, index);
@@ -164,6 +213,135 @@ bool device_effect_periodic(device_t *dev, effect_t *effect, int level, unsigned
 }
 #endif
 
+///////////////////////////////////////////////////////////////////////////////
+//
+// Normalize Functions
+//
+///////////////////////////////////////////////////////////////////////////////
+
+// An axis is normalized to [-32768, 32767] around the center of its
+// calibration.  Values within flat of the center are 0 and the rest of each
+// side is scaled to its full range, like the joydev correction.  The vector
+// kernels do the same single precision operations in the same order as the
+// scalar one so that all of them give identical results.
+
+static int32_t normalize_axis(const axis_soa_t *soa, size_t i)
+{
+    int32_t d = soa->value[i] - soa->center[i];
+    int32_t m = (d < 0 ? -d : d) - soa->flat[i];
+    if (m < 0)
+        m = 0;
+
+    float f = (float) m * (d < 0 ? soa->scale_neg[i] : soa->scale_pos[i]);
+    if (d < 0)
+        f = -f;
+
+    if (f < NORMALIZE_MIN)
+        f = NORMALIZE_MIN;
+    if (f > NORMALIZE_MAX)
+        f = NORMALIZE_MAX;
+
+    return (int32_t) f;
+}
+
+// The kernels return how many axes they did, the scalar code does the rest
+typedef size_t (*normalize_kernel_t)(const axis_soa_t *soa, int32_t *out, size_t num);
+
+#if defined(__SSE2__)
+static size_t normalize_sse2(const axis_soa_t *soa, int32_t *out, size_t num)
+{
+    const __m128i zero = _mm_setzero_si128();
+    const __m128 lo = _mm_set1_ps(NORMALIZE_MIN);
+    const __m128 hi = _mm_set1_ps(NORMALIZE_MAX);
+
+    size_t i = 0;
+    for (; i + 4 <= num; i += 4)
+    {
+        __m128i d = _mm_sub_epi32(_mm_loadu_si128((const __m128i *) &soa->value[i]),
+                                  _mm_loadu_si128((const __m128i *) &soa->center[i]));
+
+        // SSE2 has no absolute value or signed min and max on integers
+        __m128i sign = _mm_srai_epi32(d, 31);
+        __m128i m = _mm_sub_epi32(_mm_sub_epi32(_mm_xor_si128(d, sign), sign),
+                                  _mm_loadu_si128((const __m128i *) &soa->flat[i]));
+        m = _mm_and_si128(m, _mm_cmpgt_epi32(m, zero));
+
+        __m128 neg = _mm_castsi128_ps(sign);
+        __m128 scale = _mm_or_ps(_mm_and_ps(neg, _mm_loadu_ps(&soa->scale_neg[i])),
+                                 _mm_andnot_ps(neg, _mm_loadu_ps(&soa->scale_pos[i])));
+
+        __m128 f = _mm_mul_ps(_mm_cvtepi32_ps(m), scale);
+        f = _mm_xor_ps(f, _mm_castsi128_ps(_mm_slli_epi32(sign, 31)));
+        f = _mm_min_ps(_mm_max_ps(f, lo), hi);
+
+        _mm_storeu_si128((__m128i *) &out[i], _mm_cvttps_epi32(f));
+    }
+
+    return i;
+}
+
+__attribute__((target("avx2")))
+static size_t normalize_avx2(const axis_soa_t *soa, int32_t *out, size_t num)
+{
+    const __m256 lo = _mm256_set1_ps(NORMALIZE_MIN);
+    const __m256 hi = _mm256_set1_ps(NORMALIZE_MAX);
+
+    size_t i = 0;
+    for (; i + 8 <= num; i += 8)
+    {
+        __m256i d = _mm256_sub_epi32(_mm256_loadu_si256((const __m256i *) &soa->value[i]),
+                                     _mm256_loadu_si256((const __m256i *) &soa->center[i]));
+
+        __m256i sign = _mm256_srai_epi32(d, 31);
+        __m256i m = _mm256_sub_epi32(_mm256_abs_epi32(d),
+                                     _mm256_loadu_si256((const __m256i *) &soa->flat[i]));
+        m = _mm256_max_epi32(m, _mm256_setzero_si256());
+
+        __m256 scale = _mm256_blendv_ps(_mm256_loadu_ps(&soa->scale_pos[i]),
+                                        _mm256_loadu_ps(&soa->scale_neg[i]),
+                                        _mm256_castsi256_ps(sign));
+
+        __m256 f = _mm256_mul_ps(_mm256_cvtepi32_ps(m), scale);
+        f = _mm256_xor_ps(f, _mm256_castsi256_ps(_mm256_slli_epi32(sign, 31)));
+        f = _mm256_min_ps(_mm256_max_ps(f, lo), hi);
+
+        _mm256_storeu_si256((__m256i *) &out[i], _mm256_cvttps_epi32(f));
+    }
+
+    // A device with an odd number of axes finishes with SSE2
+    return i + normalize_sse2(soa, out + i, num - i);
+}
+#else
+static size_t normalize_none(const axis_soa_t *soa, int32_t *out, size_t num)
+{
+    return 0;
+}
+#endif
+
+static normalize_kernel_t normalize_select(void)
+{
+#if defined(__SSE2__)
+    if (__builtin_cpu_supports("avx2"))
+        return normalize_avx2;
+    return normalize_sse2;
+#else
+    return normalize_none;
+#endif
+}
+
+// Normalize the current value of every axis into OUT, which has room for
+// axis_num values
+void device_normalize(device_t *dev, int32_t *out)
+{
+    static normalize_kernel_t kernel;
+    if (!kernel)
+        kernel = normalize_select();
+
+    const axis_soa_t *soa = &dev->axis_soa;
+    for (size_t i = kernel(soa, out, dev->axis_num); i < dev->axis_num; i++)
+        out[i] = normalize_axis(soa, i);
+}
+
 ///////////////////////////////////////////////////////////////////////////////
 //
 // Device Functions
@@ -187,9 +365,33 @@ void device_read_cb(device_t *dev, axis_cb_t axis_cb, button_cb_t button_cb, voi
     dev->arg_cb    = arg;
 }
 
+void device_syn_cb(device_t *dev, evsyn_cb_t syn_cb, void *arg)
+{
+    evdev_syn_cb(dev->evdev, syn_cb, arg);
+}
+
 void device_axis_calibrate(device_t *dev, axis_t *axis)
 {
     evabs_cal_set(dev->evdev, axis->index, &axis->cal);
+    axis_soa_cal(dev, axis);
+    filter_reset(&axis->filter);
+}
+
+void device_axis_filter(device_t *dev, axis_t *axis, filter_type_t type, int param1, int param2)
+{
+    filter_init(&axis->filter, type, param1, param2);
+    axis->value = axis->raw;
+    dev->axis_soa.value[axis->index] = axis->value;
+}
+
+// Restart tracking the extremes of every axis from its current raw value
+void device_axis_track_reset(device_t *dev)
+{
+    AXIS_FOREACH(dev, axis)
+    {
+        axis->maximum = dev->axis_soa.maximum[axis->index] = axis->raw;
+        axis->minimum = dev->axis_soa.minimum[axis->index] = axis->raw;
+    }
 }
 
 void device_calibrate(device_t *dev)
@@ -198,6 +400,8 @@ void device_calibrate(device_t *dev)
     AXIS_FOREACH(dev, axis)
     {
         evabs_cal_set(dev->evdev, axis->index, &axis->cal);
+        axis_soa_cal(dev, axis);
+        filter_reset(&axis->filter);
 #if ENABLE_JOYSTICK
         if (dev->jsdev)
         {
@@ -232,55 +436,93 @@ void device_free(device_t *dev)
     evdev_free(dev->evdev);
 
 #if ENABLE_JOYSTICK
-    jsdev_free(dev->jsdev);
+    if (dev->jsdev)
+        jsdev_free(dev->jsdev);
     xfree(dev->jsfile);
 #endif
 
-    xfree(dev->axis_array);
-    xfree(dev->button_array);
-#if ENABLE_EFFECTS
-    xfree(dev->effect_array);
-#endif
+    AXIS_FOREACH(dev, axis)
+        xfree(axis->ring);
 
     xfree(dev->name);
-    xfree(dev);
+
+    // The device itself is in the arena
+    arena_free(dev->arena);
 }
 
-device_t *device_init(const char *dev_file)
+static void device_controls(device_t *dev)
 {
-    device_t *dev = xalloc(sizeof(device_t));
-    dev->file = dev_file;
-
-    dev->evdev = evdev_init(dev_file);
-    evabs_init(dev->evdev);
-    evkey_init(dev->evdev);
-#if ENABLE_EFFECTS    
-    evff_init(dev->evdev);
-#endif
-    
     evdev_read_cb(dev->evdev, axis_value, dev, button_value, dev);
 
-    dev->name = evdev_name(dev->evdev);
-    evdev_id(dev->evdev, &dev->id);
-
     dev->axis_num = evabs_num(dev->evdev);
     if (!dev->axis_num)
         xerrx("Device does not have any axes");
-    dev->axis_array = xalloc(sizeof(axis_t) * dev->axis_num);
+    dev->axis_array = arena_alloc(dev->arena, sizeof(axis_t) * dev->axis_num);
+
+    axis_soa_t *soa = &dev->axis_soa;
+    size_t len = sizeof(int32_t) * dev->axis_num;
+    soa->value     = arena_alloc(dev->arena, len);
+    soa->min       = arena_alloc(dev->arena, len);
+    soa->max       = arena_alloc(dev->arena, len);
+    soa->flat      = arena_alloc(dev->arena, len);
+    soa->minimum   = arena_alloc(dev->arena, len);
+    soa->maximum   = arena_alloc(dev->arena, len);
+    soa->center    = arena_alloc(dev->arena, len);
+    soa->scale_neg = arena_alloc(dev->arena, sizeof(float) * dev->axis_num);
+    soa->scale_pos = arena_alloc(dev->arena, sizeof(float) * dev->axis_num);
+
     evabs_foreach(dev->evdev, axis_add, dev);
 
     dev->button_num = evkey_num(dev->evdev);
     if (dev->button_num > 0)
     {
-        dev->button_array = xalloc(sizeof(button_t) * dev->button_num);
+        dev->button_array = arena_alloc(dev->arena, sizeof(button_t) * dev->button_num);
         evkey_foreach(dev->evdev, button_add, dev);
     }
+}
+
+// The device and its control arrays are one arena allocation sized from the
+// capabilities of the evdev
+static device_t *device_alloc(evdev_t *evdev)
+{
+    size_t size = ARENA_SIZE(sizeof(device_t)) +
+                  ARENA_SIZE(sizeof(axis_t) * evabs_num(evdev)) +
+                  AXIS_SOA_ARRAYS * ARENA_SIZE(sizeof(int32_t) * evabs_num(evdev)) +
+                  ARENA_SIZE(sizeof(button_t) * evkey_num(evdev));
+#if ENABLE_EFFECTS
+    size += ARENA_SIZE(sizeof(effect_t) * evff_num(evdev));
+#endif
+
+    arena_t *arena = arena_init(size);
+    device_t *dev = arena_alloc(arena, sizeof(device_t));
+    dev->arena = arena;
+    dev->evdev = evdev;
+
+    return dev;
+}
+
+device_t *device_init(const char *dev_file)
+{
+    evdev_t *evdev = evdev_init(dev_file);
+    evabs_init(evdev);
+    evkey_init(evdev);
+#if ENABLE_EFFECTS    
+    evff_init(evdev);
+#endif
+
+    device_t *dev = device_alloc(evdev);
+    dev->file = dev_file;
+
+    dev->name = evdev_name(dev->evdev);
+    evdev_id(dev->evdev, &dev->id);
+
+    device_controls(dev);
 
 #if ENABLE_EFFECTS
     dev->effect_num = evff_num(dev->evdev);
     if (dev->effect_num)
     {
-        dev->effect_array = xalloc(sizeof(effect_t) * dev->effect_num);
+        dev->effect_array = arena_alloc(dev->arena, sizeof(effect_t) * dev->effect_num);
         evff_foreach(dev->evdev, effect_add, dev);
     }
 #endif
@@ -297,37 +539,45 @@ device_t *device_init(const char *dev_file)
     return dev;
 }
 
+// A device on a synthetic evdev, see evdev_synth()
+device_t *device_init_synth(int fd, size_t axis_num, size_t button_num)
+{
+    device_t *dev = device_alloc(evdev_synth(fd, axis_num, button_num));
+    dev->file = "synthetic";
+    dev->name = xstrdup("Synthetic Joystick");
+
+    device_controls(dev);
+
+    return dev;
+}
+
 static int event_filter(const struct dirent *entry)
 {
     int devnum;
     return (sscanf(entry->d_name, EVENT_PREFIX "%d", &devnum) == 1);
 }
 
-char *device_select(void)
+size_t device_scan(device_scan_cb_t scan_cb, void *arg)
 {
     struct dirent **dent;
 
-    eprintf("No device specified, scanning " DEV_INPUT "/" EVENT_PREFIX "*\n");
-
     int devices = scandir(DEV_INPUT, &dent, event_filter, versionsort);
     if (devices < 0)
         xerrx(DEV_INPUT);
 
-    int found = 0;
+    size_t found = 0;
     for (int i = 0; i < devices; i++)
     {
         char file[PATH_MAX];
+        evdev_id_t id;
 
         snprintf(file, sizeof(file), "%s/%s", DEV_INPUT, dent[i]->d_name);
         xfree(dent[i]);
 
         char *name;
-        if (evdev_info(file, NULL, &name))
+        if (evdev_info(file, &id, &name))
         {
-            if (!found)
-                eprintf("Available devices:\n");
-
-            eprintf("%-*s: %s\n", (int)(sizeof(DEV_INPUT) + sizeof(EVENT_PREFIX) + 3), file, name);
+            scan_cb(file, &id, name, arg);
 
             xfree(name);
 
@@ -337,6 +587,26 @@ char *device_select(void)
 
     xfree(dent);
 
+    return found;
+}
+
+static void select_list(const char *file, const evdev_id_t *id, const char *name, void *arg)
+{
+    size_t *found = arg;
+
+    if (!(*found)++)
+        eprintf("Available devices:\n");
+
+    eprintf("%-*s: %s\n", (int)(sizeof(DEV_INPUT) + sizeof(EVENT_PREFIX) + 3), file, name);
+}
+
+char *device_select(void)
+{
+    eprintf("No device specified, scanning " DEV_INPUT "/" EVENT_PREFIX "*\n");
+
+    size_t found = 0;
+    device_scan(select_list, &found);
+
     if (found == 0)
     {
         eprintf("No available devices\n");
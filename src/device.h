@@ -16,24 +16,65 @@
 #pragma once
 
 #include <stdlib.h>
+#include <stdint.h>
 #include <stdbool.h>
 
 #include "evdev.h"
+#include "filter.h"
+#include "util.h"
 #if ENABLE_JOYSTICK
 #include "jsdev.h"
 #endif
 
+// Number of samples kept for the axis in the scope, must be a power of two
+#define AXIS_RING_SIZE  8192
+
+typedef struct sample
+{
+    evtime_t    time;
+    int         raw;
+    int         value;
+} sample_t;
+
+typedef struct axis_ring
+{
+    size_t      head;
+    sample_t    sample[AXIS_RING_SIZE];
+} axis_ring_t;
+
+#define AXIS_RING_SAMPLE(ring, n)   (&(ring)->sample[(n) & (AXIS_RING_SIZE - 1)])
+
 typedef struct axis
 {
     int         id;
     int         index;
     const char  *name;
     int         value;
+    int         raw;
     int         minimum;
     int         maximum;
     evcal_t     cal;
+    filter_t    filter;
+    axis_ring_t *ring;
 } axis_t;
 
+// The axes as contiguous arrays in axis index order, mirrored from the
+// axis array so a whole frame can be processed with vector instructions.
+// The center and scales are derived from the calibration for
+// device_normalize().
+typedef struct axis_soa
+{
+    int32_t     *value;
+    int32_t     *min;
+    int32_t     *max;
+    int32_t     *flat;
+    int32_t     *minimum;
+    int32_t     *maximum;
+    int32_t     *center;
+    float       *scale_neg;
+    float       *scale_pos;
+} axis_soa_t;
+
 typedef struct button
 {
     int id;
@@ -61,6 +102,8 @@ typedef struct effect
 
 typedef struct device
 {
+    arena_t     *arena;
+
     const char  *file;
     char        *name;
     evdev_id_t  id;
@@ -78,6 +121,7 @@ typedef struct device
 
     size_t      axis_num;
     axis_t      *axis_array;
+    axis_soa_t  axis_soa;
 
     size_t      button_num;
     button_t    *button_array;
@@ -113,16 +157,30 @@ void device_read(device_t *dev);
 
 void device_read_cb(device_t *dev, axis_cb_t axis_cb, button_cb_t button_cb, void *arg);
 
+void device_syn_cb(device_t *dev, evsyn_cb_t syn_cb, void *arg);
+
 device_t *device_init(const char *dev_file);
 
+device_t *device_init_synth(int fd, size_t axis_num, size_t button_num);
+
 void device_free(device_t *dev);
 
+typedef void (*device_scan_cb_t)(const char *file, const evdev_id_t *id, const char *name, void *arg);
+
+size_t device_scan(device_scan_cb_t scan_cb, void *arg);
+
 char *device_select(void);
 
 axis_t *device_axis_get(device_t *dev, int id);
 
 void device_axis_calibrate(device_t *dev, axis_t *axis);
 
+void device_axis_filter(device_t *dev, axis_t *axis, filter_type_t type, int param1, int param2);
+
+void device_axis_track_reset(device_t *dev);
+
+void device_normalize(device_t *dev, int32_t *out);
+
 void device_calibrate(device_t *dev);
 
 button_t *device_button_get(device_t *dev, int id);
@@ -15,7 +15,10 @@
 //  along with this program.  If not, see <http://www.gnu.org/licenses/>.
 #include <stdlib.h>
 #include <unistd.h>
+#include <errno.h>
+#include <string.h>
 #include <fcntl.h>
+#include <time.h>
 #include <sys/types.h>
 #include <sys/stat.h>
 #include <sys/ioctl.h>
@@ -23,8 +26,12 @@
 
 #include "barray.h"
 #include "util.h"
+#include "trace.h"
 #include "evdev.h"
 
+// Maximum number of events consumed by a single read()
+#define EVDEV_READ_MAX  64
+
 typedef struct evabs
 {
     evabs_id_t           id;
@@ -42,29 +49,48 @@ typedef struct evff
     evkey_id_t id;
 } evff_t;
 
+typedef struct evff_slot
+{
+    struct ff_effect effect;
+    uint64_t         used;
+    uint64_t         playing;
+    bool             valid;
+} evff_slot_t;
+
+#define EVFF_ENDLESS        UINT64_MAX
+
 struct evdev
 {
     int         fd;
 
     evabs_t     *abs_array;
     size_t      abs_num;
-    evabs_id_t  abs_map[ABS_CNT];
+    barray_rank_t *abs_rank;
 
     evkey_t     *key_array;
     size_t      key_num;
-    evkey_id_t  key_map[KEY_CNT];
+    barray_rank_t *key_rank;
+    barray_t    *key_state;
 
 #if ENABLE_EFFECTS
     evff_t      *ff_array;
     size_t      ff_num;
-    evff_id_t   ff_map[FF_CNT];
-    int         ff_id;
+    barray_rank_t *ff_rank;
+    evff_slot_t *slot_array;
+    size_t      slot_num;
+    uint64_t    slot_clock;
 #endif
 
     evabs_value_cb_t abs_cb;
     void             *abs_arg;
     evkey_value_cb_t key_cb;
     void             *key_arg;
+    evsyn_cb_t       syn_cb;
+    void             *syn_arg;
+
+    evtime_t         time;
+    evstats_t        *stats;
+    bool             dropped;
 };
 
 ///////////////////////////////////////////////////////////////////////////////
@@ -116,7 +142,6 @@ static void abs_init(bit_t id, void *arg)
     evdev_t *dev = arg;
 
     dev->abs_array[dev->abs_num].id = id;
-    dev->abs_map[id] = dev->abs_num;
 
     xioctl(dev->fd, EVIOCGABS(id), &dev->abs_array[dev->abs_num].info);
 
@@ -125,14 +150,15 @@ static void abs_init(bit_t id, void *arg)
 
 void evabs_init(evdev_t *dev)
 {
-    if (dev->abs_num != 0)
+    if (dev->abs_rank)
         return;
 
-    for (int i = 0; i < ABS_CNT; i++)
-        dev->abs_map[i] = ABS_CNT;
+    BARRAY_DECLARE(abs_barray, ABS_CNT);
+    if (!barray_ioctl(abs_barray, dev->fd, EVIOCGBIT(EV_ABS, 0)))
+        xerr("EVIOCGBIT");
 
-    barray_t *abs_barray = barray_init(ABS_CNT);
-    xioctl(dev->fd, EVIOCGBIT(EV_ABS, ABS_CNT), barray_data(abs_barray));
+    // The indexes are in id order, so the index of an id is its rank
+    dev->abs_rank = barray_rank_init(abs_barray);
 
     dev->abs_num = barray_count_set(abs_barray);
     if (dev->abs_num > 0)
@@ -142,8 +168,6 @@ void evabs_init(evdev_t *dev)
         dev->abs_num = 0;
         barray_foreach_set(abs_barray, abs_init, dev);
     }
-
-    barray_free(abs_barray);
 }
 
 size_t evabs_num(evdev_t *dev)
@@ -198,10 +222,9 @@ int evabs_map(evdev_t *dev, evabs_id_t id)
 {
     ASSERT(id < ABS_CNT);
 
-    int index = dev->abs_map[id];
-    if (index >= ABS_CNT)
+    if (!dev->abs_rank)
         return -1;
-    return index;
+    return barray_rank(dev->abs_rank, id);
 }
 
 evabs_id_t evabs_id(evdev_t *dev, evidx_t index)
@@ -221,8 +244,6 @@ static void key_init(bit_t id, void *arg)
     evdev_t *dev = arg;
 
     dev->key_array[dev->key_num].id = id;
-    dev->key_map[id] = dev->key_num;
-    
     dev->key_num++;
 }
 
@@ -237,11 +258,14 @@ static void key_value_set(bit_t id, void *arg)
 
 void evkey_init(evdev_t *dev)
 {
-    if (dev->key_num != 0)
+    if (dev->key_rank)
         return;
 
-    barray_t *key_barray = barray_init(KEY_CNT);
-    xioctl(dev->fd, EVIOCGBIT(EV_KEY, KEY_CNT), barray_data(key_barray));
+    BARRAY_DECLARE(key_barray, KEY_CNT);
+    if (!barray_ioctl(key_barray, dev->fd, EVIOCGBIT(EV_KEY, 0)))
+        xerr("EVIOCGBIT");
+
+    dev->key_rank = barray_rank_init(key_barray);
 
     dev->key_num = barray_count_set(key_barray);
     if (dev->key_num > 0)
@@ -251,11 +275,12 @@ void evkey_init(evdev_t *dev)
         dev->key_num = 0;
         barray_foreach_set(key_barray, key_init, dev);
 
-        xioctl(dev->fd, EVIOCGKEY(KEY_CNT), barray_data(key_barray));
-        barray_foreach_set(key_barray, key_value_set, dev);
+        // The key state is kept as a bitmap so a resync is a word compare
+        dev->key_state = barray_init(KEY_CNT);
+        if (!barray_ioctl(dev->key_state, dev->fd, EVIOCGKEY(0)))
+            xerr("EVIOCGKEY");
+        barray_foreach_set(dev->key_state, key_value_set, dev);
     }
-
-    barray_free(key_barray);
 }
 
 size_t evkey_num(evdev_t *dev)
@@ -280,10 +305,9 @@ int evkey_map(evdev_t *dev, evkey_id_t id)
 {
     ASSERT(id < KEY_CNT);
 
-    int index = dev->key_map[id];
-    if (index >= KEY_CNT)
+    if (!dev->key_rank)
         return -1;
-    return index;
+    return barray_rank(dev->key_rank, id);
 }
 
 evkey_id_t evkey_id(evdev_t *dev, evidx_t index)
@@ -305,10 +329,7 @@ static void ff_init(bit_t id, void *arg)
     evdev_t *dev = arg;
 
     dev->ff_array[dev->ff_num].id = id;
-    dev->ff_map[id] = dev->ff_num;
-    
     dev->ff_num++;
-    dev->ff_id = -1;
 }
 
 const char *evff_name(evdev_t *dev, evidx_t index)
@@ -344,11 +365,14 @@ const char *evff_name(evdev_t *dev, evidx_t index)
 
 void evff_init(evdev_t *dev)
 {
-    if (dev->ff_num != 0)
+    if (dev->ff_rank)
         return;
 
-    barray_t *ff_barray = barray_init(FF_CNT);
-    xioctl(dev->fd, EVIOCGBIT(EV_FF, FF_CNT), barray_data(ff_barray));
+    BARRAY_DECLARE(ff_barray, FF_CNT);
+    if (!barray_ioctl(ff_barray, dev->fd, EVIOCGBIT(EV_FF, 0)))
+        xerr("EVIOCGBIT");
+
+    dev->ff_rank = barray_rank_init(ff_barray);
 
     dev->ff_num = barray_count_set(ff_barray);
     if (dev->ff_num > 0)
@@ -357,9 +381,15 @@ void evff_init(evdev_t *dev)
 
         dev->ff_num = 0;
         barray_foreach_set(ff_barray, ff_init, dev);
-    }
 
-    barray_free(ff_barray);
+        // The slot cache never holds more effects than the device can store
+        int slots = 0;
+        if (ioctl(dev->fd, EVIOCGEFFECTS, &slots) < 0 || slots < 1)
+            slots = 1;
+
+        dev->slot_num = slots;
+        dev->slot_array = xalloc(dev->slot_num * sizeof(dev->slot_array[0]));
+    }
 }
 
 size_t evff_num(evdev_t *dev)
@@ -377,10 +407,9 @@ int evff_map(evdev_t *dev, evff_id_t id)
 {
     ASSERT(id < FF_CNT);
 
-    int index = dev->ff_map[id];
-    if (index >= FF_CNT)
+    if (!dev->ff_rank)
         return -1;
-    return index;
+    return barray_rank(dev->ff_rank, id);
 }
 
 evff_id_t evff_id(evdev_t *dev, evidx_t index)
@@ -428,15 +457,195 @@ bool evff_property(evdev_t *dev, evidx_t index, unsigned value)
     return (write(dev->fd, &ie, sizeof(ie)) == sizeof(ie));
 }
 
-static bool effect_play(evdev_t *dev)
+///////////////////////////////////////////////////////////////////////////////
+//
+// Effect Slot Functions
+//
+///////////////////////////////////////////////////////////////////////////////
+
+// Uploaded effects are cached by their parameters so triggering the same
+// effect again costs a single play write instead of an EVIOCSFF round trip.
+// Effects must be zero initialized so that the padding compares equal.
+
+static bool slot_match(const struct ff_effect *a, const struct ff_effect *b)
+{
+    struct ff_effect key = *b;
+    key.id = a->id;
+
+    return memcmp(a, &key, sizeof(key)) == 0;
+}
+
+size_t evff_slots(evdev_t *dev)
+{
+    return dev->slot_num;
+}
+
+int evff_find(evdev_t *dev, const struct ff_effect *effect)
+{
+    for (size_t i = 0; i < dev->slot_num; i++)
+    {
+        evff_slot_t *slot = &dev->slot_array[i];
+
+        if (slot->valid && slot_match(&slot->effect, effect))
+            return i;
+    }
+
+    return -1;
+}
+
+// A slot is pinned from play until its replay ends or it is stopped so that
+// neither the LRU nor an eviction on ENOSPC takes an effect that is playing
+static bool slot_playing(const evff_slot_t *slot, uint64_t now)
+{
+    return slot->valid && slot->playing > now;
+}
+
+int evff_upload(evdev_t *dev, const struct ff_effect *effect)
+{
+    TRACE_SCOPE("evff_upload");
+
+    int slot = evff_find(dev, effect);
+    if (slot >= 0)
+    {
+        dev->slot_array[slot].used = ++dev->slot_clock;
+        return slot;
+    }
+
+    // Prefer an empty slot and otherwise the least recently used one that
+    // is not playing
+    uint64_t now = now_ns();
+    evff_slot_t *victim = NULL;
+    for (size_t i = 0; i < dev->slot_num; i++)
+    {
+        evff_slot_t *other = &dev->slot_array[i];
+
+        if (!other->valid)
+        {
+            victim = other;
+            break;
+        }
+
+        if (!slot_playing(other, now) && (!victim || other->used < victim->used))
+            victim = other;
+    }
+
+    if (!victim)
+        return -1;
+
+    slot = victim - dev->slot_array;
+    if (!evff_update(dev, slot, effect))
+        return -1;
+
+    return slot;
+}
+
+bool evff_update(evdev_t *dev, int slot, const struct ff_effect *effect)
+{
+    TRACE_SCOPE("evff_update");
+
+    ASSERT(slot >= 0 && slot < dev->slot_num);
+
+    evff_slot_t *entry = &dev->slot_array[slot];
+    struct ff_effect fe = *effect;
+
+    // The kernel only updates an effect in place if the type is unchanged
+    if (entry->valid && entry->effect.type != fe.type)
+        evff_erase(dev, slot);
+
+    fe.id = entry->valid ? entry->effect.id : -1;
+
+    while (ioctl(dev->fd, EVIOCSFF, &fe) == -1)
+    {
+        // Another client may hold the device memory so evict and retry
+        if (errno != ENOSPC || fe.id != -1)
+            return false;
+
+        uint64_t now = now_ns();
+        evff_slot_t *victim = NULL;
+        for (size_t i = 0; i < dev->slot_num; i++)
+        {
+            evff_slot_t *other = &dev->slot_array[i];
+            if (other != entry && other->valid && !slot_playing(other, now) &&
+                (!victim || other->used < victim->used))
+                victim = other;
+        }
+
+        if (!victim)
+            return false;
+
+        evff_erase(dev, victim - dev->slot_array);
+    }
+
+    entry->effect = fe;
+    entry->valid = true;
+    entry->used = ++dev->slot_clock;
+
+    return true;
+}
+
+bool evff_play(evdev_t *dev, int slot, int count)
 {
+    TRACE_SCOPE("evff_play");
+
+    ASSERT(slot >= 0 && slot < dev->slot_num);
+
+    evff_slot_t *entry = &dev->slot_array[slot];
+    if (!entry->valid)
+        return false;
+
     struct input_event ie = { 0 };
 
     ie.type = EV_FF;
-    ie.code = dev->ff_id;
-    ie.value = 1;
+    ie.code = entry->effect.id;
+    ie.value = count;
 
-    return (write(dev->fd, &ie, sizeof(ie)) == sizeof(ie));
+    entry->used = ++dev->slot_clock;
+
+    if (write(dev->fd, &ie, sizeof(ie)) != sizeof(ie))
+        return false;
+
+    // An effect without a length plays until it is stopped
+    const struct ff_replay *replay = &entry->effect.replay;
+    if (count == 0)
+        entry->playing = 0;
+    else if (replay->length == 0)
+        entry->playing = EVFF_ENDLESS;
+    else
+        entry->playing = now_ns() +
+                         (uint64_t) count * (replay->delay + replay->length) * 1000000;
+
+    return true;
+}
+
+bool evff_stop(evdev_t *dev, int slot)
+{
+    TRACE_SCOPE("evff_stop");
+
+    return evff_play(dev, slot, 0);
+}
+
+void evff_erase(evdev_t *dev, int slot)
+{
+    TRACE_SCOPE("evff_erase");
+
+    ASSERT(slot >= 0 && slot < dev->slot_num);
+
+    evff_slot_t *entry = &dev->slot_array[slot];
+    if (!entry->valid)
+        return;
+
+    ioctl(dev->fd, EVIOCRMFF, entry->effect.id);
+    entry->valid = false;
+    entry->playing = 0;
+}
+
+static bool effect_trigger(evdev_t *dev, const struct ff_effect *effect)
+{
+    int slot = evff_upload(dev, effect);
+    if (slot < 0)
+        return false;
+
+    return evff_play(dev, slot, 1);
 }
 
 bool evff_constant(evdev_t *dev, evidx_t index, int level, unsigned direction, unsigned length)
@@ -446,17 +655,11 @@ bool evff_constant(evdev_t *dev, evidx_t index, int level, unsigned direction, u
     struct ff_effect fe = { 0 };
 
     fe.type = FF_CONSTANT;
-    fe.id = dev->ff_id;
     fe.u.constant.level = 0x7fff * level / 100;
     fe.direction = 0x10000 * direction / 360;
     fe.replay.length = length * 1000;
 
-    if (ioctl(dev->fd, EVIOCSFF, &fe) == -1)
-        return false;
-
-    dev->ff_id = fe.id;
-
-    return effect_play(dev);
+    return effect_trigger(dev, &fe);
 }
 
 bool evff_rumble(evdev_t *dev, evidx_t index, unsigned strong, unsigned weak, unsigned length)
@@ -466,17 +669,11 @@ bool evff_rumble(evdev_t *dev, evidx_t index, unsigned strong, unsigned weak, un
     struct ff_effect fe = { 0 };
 
     fe.type = FF_RUMBLE;
-    fe.id = dev->ff_id;
     fe.u.rumble.strong_magnitude = 0xffff * strong / 100;
     fe.u.rumble.weak_magnitude = 0xffff * weak / 100;
     fe.replay.length = length * 1000;
 
-    if (ioctl(dev->fd, EVIOCSFF, &fe) == -1)
-        return false;
-
-    dev->ff_id = fe.id;
-
-    return effect_play(dev);
+    return effect_trigger(dev, &fe);
 }
 
 bool evff_periodic(evdev_t *dev, evidx_t index, int level, unsigned direction, unsigned length)
@@ -486,19 +683,13 @@ bool evff_periodic(evdev_t *dev, evidx_t index, int level, unsigned direction, u
     struct ff_effect fe = { 0 };
 
     fe.type = FF_PERIODIC;
-    fe.id = dev->ff_id;
     fe.u.periodic.waveform = FF_SINE;
     fe.u.periodic.period = 1000;
     fe.u.periodic.magnitude = 0x7fff * level / 100;
     fe.direction = 0x10000 * direction / 360;
     fe.replay.length = length * 1000;
 
-    if (ioctl(dev->fd, EVIOCSFF, &fe) == -1)
-        return false;
-
-    dev->ff_id = fe.id;
-
-    return effect_play(dev);
+    return effect_trigger(dev, &fe);
 }
 
 #endif
@@ -509,38 +700,174 @@ bool evff_periodic(evdev_t *dev, evidx_t index, int level, unsigned direction, u
 //
 ///////////////////////////////////////////////////////////////////////////////
 
-void evdev_read(evdev_t *dev)
+static unsigned evstats_bucket(evtime_t usec)
+{
+    if (usec < 4)
+        return usec;
+
+    unsigned msb = 63 - __builtin_clzll(usec);
+    unsigned bucket = 4 * (msb - 1) + ((usec >> (msb - 2)) & 3);
+
+    return bucket < EVSTATS_LATENCY_NUM ? bucket : EVSTATS_LATENCY_NUM - 1;
+}
+
+static evtime_t evstats_bucket_max(unsigned bucket)
+{
+    if (bucket < 4)
+        return bucket;
+
+    unsigned msb = bucket / 4 + 1;
+    return ((evtime_t)(4 + bucket % 4 + 1) << (msb - 2)) - 1;
+}
+
+static void evdev_latency(evdev_t *dev)
+{
+    // Event timestamps come from the realtime clock unless a client has
+    // changed it with EVIOCSCLOCKID
+    struct timespec ts;
+    clock_gettime(CLOCK_REALTIME, &ts);
+
+    evtime_t now = (evtime_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+    evtime_t latency = now > dev->time ? now - dev->time : 0;
+
+    evstats_add(dev->stats, latency);
+}
+
+static void key_resync(bit_t id, void *arg)
+{
+    evdev_t *dev = arg;
+
+    int index = evkey_map(dev, id);
+    if (index < 0)
+        return;
+
+    // Only keys that differ from the kept state are visited
+    bool value = !barray_is_set(dev->key_state, id);
+    dev->key_array[index].value = value;
+    if (dev->key_cb)
+        dev->key_cb(index, value, dev->key_arg);
+}
+
+// After the kernel dropped events the device is queried for its state and
+// only the axes and keys that changed in the meantime are reported
+static void evdev_resync(evdev_t *dev)
+{
+    for (int index = 0; index < dev->abs_num; index++)
+    {
+        evabs_t *abs = &dev->abs_array[index];
+        int value = abs->info.value;
+
+        if (ioctl(dev->fd, EVIOCGABS(abs->id), &abs->info) == 0 &&
+            abs->info.value != value && dev->abs_cb)
+            dev->abs_cb(index, abs->info.value, dev->abs_arg);
+    }
+
+    if (dev->key_num > 0)
+    {
+        BARRAY_DECLARE(key_barray, KEY_CNT);
+        if (barray_ioctl(key_barray, dev->fd, EVIOCGKEY(0)))
+        {
+            barray_foreach_diff(dev->key_state, key_barray, key_resync, dev);
+            barray_copy(dev->key_state, key_barray);
+        }
+    }
+}
+
+static void evdev_event(evdev_t *dev, const struct input_event *ev)
 {
-    struct input_event ev;
+    if (dev->stats)
+        dev->stats->events++;
+    dev->time = (evtime_t)ev->input_event_sec * 1000000 + ev->input_event_usec;
 
-    int got = read(dev->fd, &ev, sizeof(ev));
-    if (got == sizeof(ev))
+    // Events up to the report after a drop belong to an incomplete frame
+    if (dev->dropped)
     {
-        if (ev.type == EV_ABS && dev->abs_num > 0)
+        if (ev->type == EV_SYN && ev->code == SYN_REPORT)
         {
-            int index = evabs_map(dev, ev.code);
-            if (index >= 0)
+            dev->dropped = false;
+            evdev_resync(dev);
+
+            if (dev->syn_cb)
+                dev->syn_cb(dev->time, dev->syn_arg);
+        }
+        return;
+    }
+
+    if (ev->type == EV_ABS && dev->abs_num > 0)
+    {
+        int index = evabs_map(dev, ev->code);
+        if (index >= 0)
+        {
+            dev->abs_array[index].info.value = ev->value;
+            if (dev->abs_cb)
             {
-                dev->abs_array[index].info.value = ev.value;
-                if (dev->abs_cb)
-                    dev->abs_cb(index, ev.value, dev->abs_arg);
+                TRACE_BEGIN("abs_cb");
+                dev->abs_cb(index, ev->value, dev->abs_arg);
+                TRACE_END("abs_cb");
             }
         }
-        else if (ev.type == EV_KEY && dev->key_num > 0)
+    }
+    else if (ev->type == EV_KEY && dev->key_num > 0)
+    {
+        int index = evkey_map(dev, ev->code);
+        if (index >= 0)
         {
-            int index = evkey_map(dev, ev.code);
-            if (index >= 0)
+            dev->key_array[index].value = ev->value;
+            if (ev->value)
+                barray_set(dev->key_state, ev->code);
+            else
+                barray_clear(dev->key_state, ev->code);
+            if (dev->key_cb)
             {
-                dev->key_array[index].value = ev.value;
-                if (dev->key_cb)
-                    dev->key_cb(index, ev.value, dev->key_arg);
+                TRACE_BEGIN("key_cb");
+                dev->key_cb(index, ev->value, dev->key_arg);
+                TRACE_END("key_cb");
             }
         }
     }
-    else if (got < 0)
+    else if (ev->type == EV_SYN && ev->code == SYN_REPORT)
     {
+        if (dev->stats)
+            evdev_latency(dev);
+
+        if (dev->syn_cb)
+        {
+            TRACE_BEGIN("syn_cb");
+            dev->syn_cb(dev->time, dev->syn_arg);
+            TRACE_END("syn_cb");
+        }
+    }
+    else if (ev->type == EV_SYN && ev->code == SYN_DROPPED)
+    {
+        if (dev->stats)
+            dev->stats->dropped++;
+        dev->dropped = true;
+    }
+}
+
+void evdev_read(evdev_t *dev)
+{
+    TRACE_SCOPE("evdev_read");
+
+    // Drain as many queued events as possible per system call since a
+    // single frame from a 1 kHz device is typically several events long
+    struct input_event ev[EVDEV_READ_MAX];
+
+    TRACE_BEGIN("read");
+    ssize_t got = read(dev->fd, ev, sizeof(ev));
+    TRACE_END("read");
+    if (dev->stats)
+        dev->stats->reads++;
+    if (got < 0)
+    {
+        if (errno == EAGAIN || errno == EINTR)
+            return;
         xerr("read");
     }
+
+    size_t count = got / sizeof(ev[0]);
+    for (size_t i = 0; i < count; i++)
+        evdev_event(dev, &ev[i]);
 }
 
 void evdev_read_cb(evdev_t *dev, evabs_value_cb_t abs_cb, void *abs_arg,
@@ -552,6 +879,61 @@ void evdev_read_cb(evdev_t *dev, evabs_value_cb_t abs_cb, void *abs_arg,
     dev->key_arg = key_arg;
 }
 
+void evdev_syn_cb(evdev_t *dev, evsyn_cb_t syn_cb, void *syn_arg)
+{
+    dev->syn_cb  = syn_cb;
+    dev->syn_arg = syn_arg;
+}
+
+evtime_t evdev_time(evdev_t *dev)
+{
+    return dev->time;
+}
+
+// The histogram is only allocated, and the clock only read on each report,
+// for a device whose stats are shown
+void evdev_stats_enable(evdev_t *dev)
+{
+    if (!dev->stats)
+        dev->stats = xalloc(sizeof(evstats_t));
+}
+
+const evstats_t *evdev_stats(evdev_t *dev)
+{
+    return dev->stats;
+}
+
+void evstats_add(evstats_t *stats, evtime_t usec)
+{
+    stats->reports++;
+    stats->latency[evstats_bucket(usec)]++;
+}
+
+evtime_t evstats_percentile(const evstats_t *stats, const evstats_t *prev, unsigned percent)
+{
+    // Only count the reports since the previous snapshot
+    uint64_t total = stats->reports - prev->reports;
+    if (total == 0)
+        return 0;
+
+    uint64_t target = (total * percent + 99) / 100;
+    uint64_t count = 0;
+
+    for (unsigned bucket = 0; bucket < EVSTATS_LATENCY_NUM; bucket++)
+    {
+        count += stats->latency[bucket] - prev->latency[bucket];
+        if (count >= target)
+            return evstats_bucket_max(bucket);
+    }
+
+    return evstats_bucket_max(EVSTATS_LATENCY_NUM - 1);
+}
+
+bool evdev_grab(evdev_t *dev, bool grab)
+{
+    return ioctl(dev->fd, EVIOCGRAB, (void *)(intptr_t)grab) == 0;
+}
+
 int evdev_fileno(evdev_t *dev)
 {
     return dev->fd;
@@ -585,15 +967,63 @@ evdev_t *evdev_init(const char *file)
     return dev;
 }
 
+// Create a device that reads events from any fd, such as a pipe, without a
+// kernel device behind it.  The axes are 0 to abs_num - 1 with a 16-bit
+// range and the keys start at BTN_JOYSTICK.  Used to drive benchmarks.
+evdev_t *evdev_synth(int fd, size_t abs_num, size_t key_num)
+{
+    ASSERT(abs_num > 0 && abs_num <= ABS_CNT && key_num <= KEY_CNT - BTN_JOYSTICK);
+
+    evdev_t *dev = xalloc(sizeof(evdev_t));
+    dev->fd = fd;
+
+    BARRAY_DECLARE(abs_barray, ABS_CNT);
+    dev->abs_array = xalloc(abs_num * sizeof(dev->abs_array[0]));
+    for (dev->abs_num = 0; dev->abs_num < abs_num; dev->abs_num++)
+    {
+        evabs_t *abs = &dev->abs_array[dev->abs_num];
+        abs->id = dev->abs_num;
+        abs->info.minimum = -32768;
+        abs->info.maximum = 32767;
+        barray_set(abs_barray, abs->id);
+    }
+    dev->abs_rank = barray_rank_init(abs_barray);
+
+    BARRAY_DECLARE(key_barray, KEY_CNT);
+    if (key_num > 0)
+    {
+        dev->key_array = xalloc(key_num * sizeof(dev->key_array[0]));
+        for (dev->key_num = 0; dev->key_num < key_num; dev->key_num++)
+        {
+            dev->key_array[dev->key_num].id = BTN_JOYSTICK + dev->key_num;
+            barray_set(key_barray, BTN_JOYSTICK + dev->key_num);
+        }
+        dev->key_state = barray_init(KEY_CNT);
+    }
+    dev->key_rank = barray_rank_init(key_barray);
+
+    return dev;
+}
+
 void evdev_free(evdev_t *dev)
 {
     if (dev->fd > 0)
         close(dev->fd);
     xfree(dev->abs_array);
+    if (dev->abs_rank)
+        barray_rank_free(dev->abs_rank);
     xfree(dev->key_array);
+    if (dev->key_rank)
+        barray_rank_free(dev->key_rank);
+    if (dev->key_state)
+        barray_free(dev->key_state);
 #if ENABLE_EFFECTS    
     xfree(dev->ff_array);
+    if (dev->ff_rank)
+        barray_rank_free(dev->ff_rank);
+    xfree(dev->slot_array);
 #endif
+    xfree(dev->stats);
     xfree(dev);
 }
 
@@ -603,12 +1033,11 @@ bool evdev_info(const char *file, evdev_id_t *id, char **name)
     if (fd < 0)
         return false;
 
-    barray_t *abs_barray = barray_init(ABS_CNT);
-    xioctl(fd, EVIOCGBIT(EV_ABS, ABS_CNT), barray_data(abs_barray));
+    BARRAY_DECLARE(abs_barray, ABS_CNT);
+    if (!barray_ioctl(abs_barray, fd, EVIOCGBIT(EV_ABS, 0)))
+        xerr("EVIOCGBIT");
 
     size_t count = barray_count_set(abs_barray);
-
-    barray_free(abs_barray);
     if (count == 0)
     {
         close(fd);
@@ -617,7 +1046,11 @@ bool evdev_info(const char *file, evdev_id_t *id, char **name)
 
     if (id)
     {
-        xioctl(fd, EVIOCGID, id);
+        struct input_id input_id;
+        xioctl(fd, EVIOCGID, &input_id);
+        id->bus     = input_id.bustype;
+        id->vendor  = input_id.vendor;
+        id->product = input_id.product;
     }
 
     if (name)
@@ -18,6 +18,7 @@
 #include <stdlib.h>
 #include <stdint.h>
 #include <stdbool.h>
+#include <linux/input.h>
 
 typedef uint8_t  evabs_id_t;
 typedef uint16_t evkey_id_t;
@@ -31,11 +32,27 @@ typedef struct evdev_id
 
 typedef unsigned int evidx_t;
 
+// Kernel event timestamp in microseconds
+typedef uint64_t evtime_t;
+
 typedef void (*evabs_value_cb_t)(evidx_t index, int value, void *arg);
 typedef void (*evkey_value_cb_t)(evidx_t index, bool value, void *arg);
 typedef void (*evabs_cb_t)(evidx_t index, void *arg);
 typedef void (*evkey_cb_t)(evidx_t index, void *arg);
 typedef void (*evff_cb_t)(evidx_t index, void *arg);
+typedef void (*evsyn_cb_t)(evtime_t time, void *arg);
+
+// Delivery latency histogram with four buckets per power of two microseconds
+#define EVSTATS_LATENCY_NUM 128
+
+typedef struct evstats
+{
+    uint64_t    reads;
+    uint64_t    events;
+    uint64_t    reports;
+    uint64_t    dropped;
+    uint64_t    latency[EVSTATS_LATENCY_NUM];
+} evstats_t;
 
 typedef struct evdev evdev_t;
 
@@ -102,6 +119,14 @@ bool evff_property(evdev_t *dev, evidx_t index, unsigned value);
 bool evff_constant(evdev_t *dev, evidx_t index, int level, unsigned direction, unsigned length);
 bool evff_rumble(evdev_t *dev, evidx_t index, unsigned strong, unsigned weak, unsigned length);
 bool evff_periodic(evdev_t *dev, evidx_t index, int level, unsigned direction, unsigned length);
+
+size_t evff_slots(evdev_t *dev);
+int evff_find(evdev_t *dev, const struct ff_effect *effect);
+int evff_upload(evdev_t *dev, const struct ff_effect *effect);
+bool evff_update(evdev_t *dev, int slot, const struct ff_effect *effect);
+bool evff_play(evdev_t *dev, int slot, int count);
+bool evff_stop(evdev_t *dev, int slot);
+void evff_erase(evdev_t *dev, int slot);
 #endif
 
 ///////////////////////////////////////////////////////////////////////////////
@@ -112,9 +137,17 @@ bool evff_periodic(evdev_t *dev, evidx_t index, int level, unsigned direction, u
 void evdev_read(evdev_t *dev);
 void evdev_read_cb(evdev_t *dev, evabs_value_cb_t abs_cb, void *abs_arg,
                    evkey_value_cb_t key_cb, void *key_arg);
+void evdev_syn_cb(evdev_t *dev, evsyn_cb_t syn_cb, void *syn_arg);
+evtime_t evdev_time(evdev_t *dev);
+bool evdev_grab(evdev_t *dev, bool grab);
+void evdev_stats_enable(evdev_t *dev);
+const evstats_t *evdev_stats(evdev_t *dev);
+void evstats_add(evstats_t *stats, evtime_t usec);
+evtime_t evstats_percentile(const evstats_t *stats, const evstats_t *prev, unsigned percent);
 int evdev_fileno(evdev_t *dev);
 char *evdev_name(evdev_t *dev);
 void evdev_id(evdev_t *dev, evdev_id_t *id);
 evdev_t *evdev_init(const char *file);
+evdev_t *evdev_synth(int fd, size_t abs_num, size_t key_num);
 void evdev_free(evdev_t *dev);
 bool evdev_info(const char *file, evdev_id_t *id, char **name);
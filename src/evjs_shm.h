@@ -0,0 +1,152 @@
+//  evjs - Evdev Joystick Utilities
+//  Copyright (C) 2020 Scott Shumate <scott@shumatech.com>
+//
+//  This program is free software: you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation, either version 3 of the License, or
+//  (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+#pragma once
+
+// Live controller state published by 'evjsd -P' into shared memory.  This
+// header has no dependencies on the rest of evjs so that any process can
+// include it.  Opening a region is a few system calls, after which every
+// snapshot is a handful of loads with no system calls at all.
+//
+//     evjs_shm_t *shm = evjs_shm_open("/dev/shm/evjs-event11");
+//     evjs_shm_state_t state;
+//     if (shm && evjs_shm_read(shm, &state))
+//         printf("frame %llu X %d\n", (unsigned long long) state.frame, state.axis[0]);
+//
+// The region is written by a single publisher under a sequence lock: the
+// sequence is odd while a frame is being written and moves on by two for
+// every frame, so a snapshot is consistent when the sequence was even and
+// unchanged on both sides of the copy.
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#define EVJS_SHM_DIR        "/dev/shm"
+#define EVJS_SHM_PREFIX     "evjs-"
+#define EVJS_SHM_MAGIC      0x534a5645
+#define EVJS_SHM_VERSION    1
+
+#define EVJS_SHM_AXES       64
+#define EVJS_SHM_BUTTONS    768
+#define EVJS_SHM_NAME_LEN   128
+
+// Give up on a snapshot after this many tries, only a publisher that died
+// in the middle of a frame keeps it from succeeding
+#define EVJS_SHM_RETRIES    10000
+
+typedef struct evjs_shm_state
+{
+    uint64_t    frame;
+    uint64_t    time;
+    int32_t     axis[EVJS_SHM_AXES];
+    uint64_t    button[EVJS_SHM_BUTTONS / 64];
+} evjs_shm_state_t;
+
+typedef struct evjs_shm
+{
+    // Written once before the region appears under its name
+    uint32_t    magic;
+    uint32_t    version;
+    uint32_t    size;
+    uint16_t    bus;
+    uint16_t    vendor;
+    uint16_t    product;
+    uint16_t    axis_num;
+    uint16_t    button_num;
+    uint16_t    axis_id[EVJS_SHM_AXES];
+    uint16_t    button_id[EVJS_SHM_BUTTONS];
+    char        name[EVJS_SHM_NAME_LEN];
+
+    // Set when the publisher stops or the device is removed
+    uint32_t    closed;
+
+    // The sequence lock on a cache line of its own with the state after it
+    uint32_t    seq __attribute__((aligned(64)));
+    evjs_shm_state_t state;
+} evjs_shm_t;
+
+static inline evjs_shm_t *evjs_shm_open(const char *path)
+{
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0)
+        return NULL;
+
+    // Touching a mapping past the end of a shorter file raises SIGBUS
+    struct stat st;
+    if (fstat(fd, &st) < 0 || !S_ISREG(st.st_mode) || st.st_size < (off_t) sizeof(evjs_shm_t))
+    {
+        close(fd);
+        return NULL;
+    }
+
+    void *map = mmap(NULL, sizeof(evjs_shm_t), PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED)
+        return NULL;
+
+    evjs_shm_t *shm = map;
+    if (shm->magic != EVJS_SHM_MAGIC || shm->version != EVJS_SHM_VERSION ||
+        shm->size != sizeof(evjs_shm_t))
+    {
+        munmap(map, sizeof(evjs_shm_t));
+        return NULL;
+    }
+
+    return shm;
+}
+
+static inline void evjs_shm_close(evjs_shm_t *shm)
+{
+    munmap(shm, sizeof(evjs_shm_t));
+}
+
+static inline bool evjs_shm_closed(const evjs_shm_t *shm)
+{
+    return __atomic_load_n(&shm->closed, __ATOMIC_ACQUIRE) != 0;
+}
+
+// Copy the latest complete frame into STATE, false if none could be taken
+static inline bool evjs_shm_read(const evjs_shm_t *shm, evjs_shm_state_t *state)
+{
+    for (int retry = 0; retry < EVJS_SHM_RETRIES; retry++)
+    {
+        uint32_t seq = __atomic_load_n(&shm->seq, __ATOMIC_ACQUIRE);
+        if (seq & 1)
+        {
+#if defined(__x86_64__) || defined(__i386__)
+            __builtin_ia32_pause();
+#endif
+            continue;
+        }
+
+        memcpy(state, (const void *) &shm->state, sizeof(*state));
+
+        __atomic_thread_fence(__ATOMIC_ACQUIRE);
+        if (__atomic_load_n(&shm->seq, __ATOMIC_RELAXED) == seq)
+            return true;
+    }
+
+    return false;
+}
+
+static inline bool evjs_shm_button(const evjs_shm_state_t *state, unsigned index)
+{
+    return (state->button[index / 64] >> (index % 64)) & 1;
+}
@@ -0,0 +1,142 @@
+//  evjs - Evdev Joystick Utilities
+//  Copyright (C) 2020 Scott Shumate <scott@shumatech.com>
+//
+//  This program is free software: you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation, either version 3 of the License, or
+//  (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+#pragma once
+
+// Frames served by 'evjsd -S SOCKET' to local subscribers.  This header has
+// no dependencies on the rest of evjs so that any process can include it.
+//
+// The socket is a SOCK_SEQPACKET Unix socket, so every read is one whole
+// message.  After connecting, a subscriber receives an evjs_sock_device_t
+// for every device, followed by an evjs_sock_frame_t for every frame of
+// any device.  Each subscriber has a bounded queue in the server.  A
+// subscriber that falls behind loses frames according to its policy, which
+// it can change at any time by sending an evjs_sock_subscribe_t.
+//
+//     int fd = evjs_sock_connect("/run/user/1000/evjs.sock", EVJS_SOCK_COALESCE);
+//     evjs_sock_msg_t msg;
+//     while (recv(fd, &msg, sizeof(msg), 0) > 0)
+//         if (msg.type == EVJS_SOCK_FRAME)
+//             printf("device %u X %d\n", msg.frame.device, msg.frame.axis[0]);
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+#define EVJS_SOCK_VERSION   1
+
+#define EVJS_SOCK_AXES      64
+#define EVJS_SOCK_BUTTONS   768
+#define EVJS_SOCK_NAME_LEN  128
+
+typedef enum evjs_sock_type
+{
+    EVJS_SOCK_DEVICE = 1,
+    EVJS_SOCK_FRAME,
+    EVJS_SOCK_SUBSCRIBE,
+} evjs_sock_type_t;
+
+// What the server does when the queue of a subscriber is full
+typedef enum evjs_sock_policy
+{
+    // Discard the oldest queued frame, every frame sent is a real frame
+    EVJS_SOCK_DROP_OLDEST,
+    // Merge the new frame into the newest queued frame of the same device,
+    // so the latest values are kept and changed covers both frames
+    EVJS_SOCK_COALESCE,
+} evjs_sock_policy_t;
+
+// Frame flags
+#define EVJS_SOCK_COALESCED 0x0001
+#define EVJS_SOCK_REMOVED   0x0002
+
+typedef struct evjs_sock_device
+{
+    uint32_t    type;
+    uint32_t    version;
+    uint16_t    device;
+    uint16_t    bus;
+    uint16_t    vendor;
+    uint16_t    product;
+    uint16_t    axis_num;
+    uint16_t    button_num;
+    uint16_t    axis_id[EVJS_SOCK_AXES];
+    uint16_t    button_id[EVJS_SOCK_BUTTONS];
+    char        name[EVJS_SOCK_NAME_LEN];
+} evjs_sock_device_t;
+
+// The axes are normalized to [-32768, 32767] around their calibrated
+// center and changed has a bit for every axis index that changed since the
+// frame before.  dropped counts the frames this subscriber lost since the
+// last one it was sent, after which changed is only relative to a frame it
+// never saw.
+typedef struct evjs_sock_frame
+{
+    uint32_t    type;
+    uint16_t    device;
+    uint16_t    flags;
+    uint32_t    dropped;
+    uint32_t    reserved;
+    uint64_t    frame;
+    uint64_t    time;
+    uint64_t    changed;
+    int32_t     axis[EVJS_SOCK_AXES];
+    uint64_t    button[EVJS_SOCK_BUTTONS / 64];
+} evjs_sock_frame_t;
+
+typedef struct evjs_sock_subscribe
+{
+    uint32_t    type;
+    uint32_t    policy;
+} evjs_sock_subscribe_t;
+
+typedef union evjs_sock_msg
+{
+    uint32_t                type;
+    evjs_sock_device_t      device;
+    evjs_sock_frame_t       frame;
+    evjs_sock_subscribe_t   subscribe;
+} evjs_sock_msg_t;
+
+// Returns a connected socket or -1 with errno set
+static inline int evjs_sock_connect(const char *path, evjs_sock_policy_t policy)
+{
+    struct sockaddr_un addr = { .sun_family = AF_UNIX };
+    if (strlen(path) >= sizeof(addr.sun_path))
+        return -1;
+    strcpy(addr.sun_path, path);
+
+    int fd = socket(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0);
+    if (fd < 0)
+        return -1;
+
+    evjs_sock_subscribe_t subscribe = { .type = EVJS_SOCK_SUBSCRIBE, .policy = policy };
+    if (connect(fd, (struct sockaddr *) &addr, sizeof(addr)) < 0 ||
+        send(fd, &subscribe, sizeof(subscribe), MSG_NOSIGNAL) != sizeof(subscribe))
+    {
+        close(fd);
+        return -1;
+    }
+
+    return fd;
+}
+
+static inline bool evjs_sock_button(const evjs_sock_frame_t *frame, unsigned index)
+{
+    return (frame->button[index / 64] >> (index % 64)) & 1;
+}
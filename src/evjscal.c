@@ -25,6 +25,7 @@
 #include <limits.h>
 #include <getopt.h>
 #include <poll.h>
+#include <time.h>
 #include <sys/types.h>
 
 #include "caldb.h"
@@ -47,8 +48,25 @@ typedef enum op {
     OP_CALIBRATE,
     OP_SET,
     OP_GET,
+    OP_FF_BENCH,
 } op_t;
 
+// Phases of the configure path reported by --timing
+typedef enum phase {
+    PHASE_EXEC,
+    PHASE_CONFIG_PATH,
+    PHASE_EVDEV_INIT,
+    PHASE_EVABS_INIT,
+    PHASE_CALDB_INIT,
+    PHASE_CALDB_QUERY,
+    PHASE_CALDB_CLOSE,
+    PHASE_JSDEV_OPEN,
+    PHASE_EVIOCSABS,
+    PHASE_JSIOCSCORR,
+    PHASE_EVDEV_FREE,
+    PHASE_NUM
+} phase_t;
+
 typedef struct cal_node
 {
     caldb_record_t  rec;
@@ -66,6 +84,15 @@ typedef struct cal_state
 
 #define VALUES_PER_AXIS 5
 
+// Timed operations per effect type in the force feedback benchmark
+#define FF_BENCH_ITERATIONS 2000
+
+// Rates tried by the paced loop in the force feedback benchmark, each for
+// FF_BENCH_PACED_MS, stopping at the first one that does not hold
+#define FF_BENCH_RATE_MIN   125
+#define FF_BENCH_RATE_MAX   16000
+#define FF_BENCH_PACED_MS   250
+
 #define VERBOSE(...)  ({ if (verbose) printf(__VA_ARGS__); })
 
 ///////////////////////////////////////////////////////////////////////////////
@@ -73,6 +100,102 @@ typedef struct cal_state
 static bool         verbose;
 static evdev_t      *evdev;
 static evdev_id_t   evid;
+static arena_t      *arena;
+static bool         timing;
+static int64_t      timing_main;
+static int64_t      phase_ns[PHASE_NUM];
+static unsigned     phase_calls[PHASE_NUM];
+
+static const char *phase_name[PHASE_NUM] = {
+    [PHASE_EXEC]        = "exec",
+    [PHASE_CONFIG_PATH] = "config_path",
+    [PHASE_EVDEV_INIT]  = "evdev_init",
+    [PHASE_EVABS_INIT]  = "evabs_init",
+    [PHASE_CALDB_INIT]  = "caldb_init",
+    [PHASE_CALDB_QUERY] = "caldb_query",
+    [PHASE_CALDB_CLOSE] = "caldb_close",
+    [PHASE_JSDEV_OPEN]  = "jsdev_open",
+    [PHASE_EVIOCSABS]   = "eviocsabs",
+    [PHASE_JSIOCSCORR]  = "jsiocscorr",
+    [PHASE_EVDEV_FREE]  = "evdev_free",
+};
+
+///////////////////////////////////////////////////////////////////////////////
+//
+// Timing
+//
+///////////////////////////////////////////////////////////////////////////////
+
+static int64_t phase_start(void)
+{
+    return timing ? (int64_t) now_ns() : 0;
+}
+
+static void phase_stop(phase_t phase, int64_t start)
+{
+    if (!timing)
+        return;
+
+    phase_ns[phase] += (int64_t) now_ns() - start;
+    phase_calls[phase]++;
+}
+
+// Time from the exec to main() from the process start time, which the
+// kernel only keeps in clock ticks
+static void phase_exec(void)
+{
+    FILE *file = fopen("/proc/self/stat", "r");
+    if (!file)
+        return;
+
+    char buf[1024];
+    size_t len = fread(buf, 1, sizeof(buf) - 1, file);
+    fclose(file);
+    buf[len] = '\0';
+
+    // The command name may contain spaces so start after its closing paren
+    char *field = strrchr(buf, ')');
+    unsigned long long start;
+    if (!field || sscanf(field + 2, "%*c %*d %*d %*d %*d %*d %*u %*u %*u %*u %*u "
+                         "%*u %*u %*d %*d %*d %*d %*d %*d %llu", &start) != 1)
+        return;
+
+    struct timespec ts;
+    clock_gettime(CLOCK_BOOTTIME, &ts);
+    int64_t main_boot = (int64_t) ts.tv_sec * 1000000000 + ts.tv_nsec -
+                        ((int64_t) now_ns() - timing_main);
+    int64_t start_boot = (int64_t) start * 1000000000 / sysconf(_SC_CLK_TCK);
+
+    phase_ns[PHASE_EXEC] = main_boot > start_boot ? main_boot - start_boot : 0;
+    phase_calls[PHASE_EXEC] = 1;
+}
+
+// The main entry time is on the monotonic clock so that a parent can
+// measure the exec more precisely than the process start time allows
+static void timing_report(void)
+{
+    int64_t total = (int64_t) now_ns() - timing_main;
+    int64_t other = total;
+
+    phase_exec();
+
+    fprintf(stderr, "%-12s %6s %12s %12s\n", "Phase", "Calls", "Total us", "Per call us");
+    for (phase_t phase = 0; phase < PHASE_NUM; phase++)
+    {
+        if (!phase_calls[phase])
+            continue;
+
+        if (phase != PHASE_EXEC)
+            other -= phase_ns[phase];
+
+        fprintf(stderr, "%-12s %6u %12.1f %12.1f\n", phase_name[phase],
+                phase_calls[phase], phase_ns[phase] / 1000.0,
+                phase_ns[phase] / 1000.0 / phase_calls[phase]);
+    }
+    fprintf(stderr, "%-12s %6s %12.1f\n", "other", "", other / 1000.0);
+    fprintf(stderr, "%-12s %6s %12.1f\n", "main", "", total / 1000.0);
+    fprintf(stderr, "%-12s %6s %12.1f\n", "main_entry", "", timing_main / 1000.0);
+}
 
 ///////////////////////////////////////////////////////////////////////////////
 //
@@ -125,10 +248,10 @@ static bool rec_reader(const evdev_id_t *dev, const caldb_record_t *rec, void *a
     VERBOSE("Read axis %d calibration min:%d max:%d fuzz:%d flat:%d\n",
             rec->axis, rec->cal.min, rec->cal.max, rec->cal.fuzz, rec->cal.flat);
 
-    size_t index = evabs_map(evdev, rec->axis);
+    int index = evabs_map(evdev, rec->axis);
     if (index >= 0)
     {
-        cal_node_t *node = xalloc(sizeof(cal_node_t));
+        cal_node_t *node = arena_alloc(arena, sizeof(cal_node_t));
         node->rec = *rec;
 
         **prevpp = node;
@@ -142,34 +265,30 @@ static cal_node_t *readdb(const char *db_file)
 {
     char *err_msg;
 
+    int64_t start = phase_start();
     caldb_t *db = caldb_init(db_file, &err_msg);
     if (!db)
         xerrx("%s: %s", db_file, err_msg);
+    phase_stop(PHASE_CALDB_INIT, start);
 
     cal_node_t *list = NULL;
     cal_node_t **prev = &list;
+    start = phase_start();
     if (!caldb_read(db, &evid, rec_reader, &prev, &err_msg))
         xerrx("%s", err_msg);
+    phase_stop(PHASE_CALDB_QUERY, start);
 
+    start = phase_start();
     caldb_free(db);
+    phase_stop(PHASE_CALDB_CLOSE, start);
 
     return list;
 }
 
-static void cal_list_free(cal_node_t *list)
-{
-    cal_node_t *next;
-
-    while (list)
-    {
-        next = list->next;
-        xfree(list);
-        list = next;
-    }
-}
-
 static void op_read(const char *db_file)
 {
+    arena_mark_t mark = arena_mark(arena);
+
     cal_node_t *list = readdb(db_file);
     if (list == NULL)
     {
@@ -191,7 +310,7 @@ static void op_read(const char *db_file)
     if (!verbose)
         printf("\n");
 
-    cal_list_free(list);
+    arena_reset(arena, mark);
 }
 
 ///////////////////////////////////////////////////////////////////////////////
@@ -256,7 +375,7 @@ static cal_node_t *values_parse(const char *str)
 {
     int abs_num = evabs_num(evdev);
     int max_values = abs_num * VALUES_PER_AXIS;    
-    int intvals[max_values];
+    int *intvals = arena_alloc(arena, sizeof(int) * max_values);
     const char *end = str;
     ssize_t count = 0;
     long result;
@@ -291,7 +410,7 @@ static cal_node_t *values_parse(const char *str)
         if (evabs_map(evdev, intvals[i]) < 0)
             xerrx("Axis %d is not valid for device", intvals[i]);
 
-        cal_node_t *node = xalloc(sizeof(cal_node_t));
+        cal_node_t *node = arena_alloc(arena, sizeof(cal_node_t));
 
         caldb_record_t *rec = &node->rec;
         rec->axis     = intvals[i];
@@ -317,11 +436,13 @@ static cal_node_t *values_parse(const char *str)
 
 static void op_write(const char *db_file, const char *values)
 {
+    arena_mark_t mark = arena_mark(arena);
+
     cal_node_t *list = values_parse(values);
 
     writedb(db_file, list);
 
-    cal_list_free(list);
+    arena_reset(arena, mark);
 }
 
 ///////////////////////////////////////////////////////////////////////////////
@@ -379,7 +500,9 @@ static void joystick_close(jsdev_t *jsdev)
 static void calibrate(cal_node_t *list)
 {
 #if ENABLE_JOYSTICK
+    int64_t start = phase_start();
     jsdev_t *jsdev = joystick_open();
+    phase_stop(PHASE_JSDEV_OPEN, start);
 #endif
 
     for (cal_node_t *node = list; node != NULL; node = node->next)
@@ -391,7 +514,9 @@ static void calibrate(cal_node_t *list)
             VERBOSE("Set axis %d calibration min:%d max:%d fuzz:%d flat:%d\n",
                     rec->axis, rec->cal.min, rec->cal.max, rec->cal.fuzz, rec->cal.flat);
 
+            int64_t start = phase_start();
             evabs_cal_set(evdev, index, &rec->cal);
+            phase_stop(PHASE_EVIOCSABS, start);
 #if ENABLE_JOYSTICK
             joystick_cal(jsdev, index, &rec->cal);
 #endif            
@@ -399,12 +524,17 @@ static void calibrate(cal_node_t *list)
     }
 
 #if ENABLE_JOYSTICK
+    start = phase_start();
     joystick_close(jsdev);
+    if (jsdev)
+        phase_stop(PHASE_JSIOCSCORR, start);
 #endif
 }
 
 static void op_config(const char *db_file)
 {
+    arena_mark_t mark = arena_mark(arena);
+
     cal_node_t *list = readdb(db_file);
     if (list == NULL)
     {
@@ -414,7 +544,7 @@ static void op_config(const char *db_file)
 
     calibrate(list);
 
-    cal_list_free(list);
+    arena_reset(arena, mark);
 }
 
 ///////////////////////////////////////////////////////////////////////////////
@@ -424,9 +554,13 @@ static void op_config(const char *db_file)
 ///////////////////////////////////////////////////////////////////////////////
 static void op_set(const char *values)
 {
+    arena_mark_t mark = arena_mark(arena);
+
     cal_node_t *list = values_parse(values);
 
     calibrate(list);
+
+    arena_reset(arena, mark);
 }
 
 ///////////////////////////////////////////////////////////////////////////////
@@ -507,6 +641,8 @@ static void op_calibrate(const char *db_file)
         { .fd = evdev_fileno(evdev), .events = POLLIN | POLLPRI },
     };
 
+    arena_mark_t mark = arena_mark(arena);
+
     cal_node_t *list = NULL;
     cal_node_t **prev = &list;
     for (int index = 0; index < abs_num; index++)
@@ -538,7 +674,7 @@ static void op_calibrate(const char *db_file)
             }
         }
 
-        cal_node_t *node = xalloc(sizeof(cal_node_t));
+        cal_node_t *node = arena_alloc(arena, sizeof(cal_node_t));
         node->rec.axis = evabs_id(evdev, index);
 
         evcal_t *cal = &node->rec.cal;
@@ -556,9 +692,218 @@ static void op_calibrate(const char *db_file)
 
     writedb(db_file, list);
 
-    cal_list_free(list);
+    arena_reset(arena, mark);
 }
 
+#if ENABLE_EFFECTS
+///////////////////////////////////////////////////////////////////////////////
+//
+// Force Feedback Benchmark Operation
+//
+///////////////////////////////////////////////////////////////////////////////
+static void bench_report(const char *name, int64_t *times, size_t num)
+{
+    sort_i64(times, num);
+
+    printf("  %-8s p50 %8.1f  p90 %8.1f  p99 %8.1f  max %8.1f us\n", name,
+           times[percentile(num, 50)] / 1000.0,
+           times[percentile(num, 90)] / 1000.0,
+           times[percentile(num, 99)] / 1000.0,
+           times[num - 1] / 1000.0);
+}
+
+// Build a weak, short effect whose parameters change with the iteration so
+// that every upload and update carries new data to the driver
+static bool bench_effect(evff_type_t type, int iteration, struct ff_effect *fe)
+{
+    int level = 1 + iteration % 10;
+
+    memset(fe, 0, sizeof(*fe));
+    fe->replay.length = 20;
+
+    switch (type)
+    {
+        case EVFF_CONSTANT:
+            fe->type = FF_CONSTANT;
+            fe->u.constant.level = 0x7fff * level / 100;
+            break;
+        case EVFF_RUMBLE:
+            fe->type = FF_RUMBLE;
+            fe->u.rumble.strong_magnitude = 0xffff * level / 100;
+            fe->u.rumble.weak_magnitude = 0xffff * level / 100;
+            break;
+        case EVFF_PERIODIC:
+            fe->type = FF_PERIODIC;
+            fe->u.periodic.waveform = FF_SINE;
+            fe->u.periodic.period = 100;
+            fe->u.periodic.magnitude = 0x7fff * level / 100;
+            break;
+        default:
+            return false;
+    }
+
+    return true;
+}
+
+static void bench_sleep(int64_t when)
+{
+    struct timespec ts = { .tv_sec = when / 1000000000, .tv_nsec = when % 1000000000 };
+
+    while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL) == EINTR)
+        ;
+}
+
+// Update the effect in SLOT at RATE, and start it too on every tick if
+// PLAY, the way a force feedback loop would.  The rate holds if every tick
+// finishes before the next one is due and no update or play fails.
+static bool bench_paced(evff_type_t type, int slot, unsigned rate, bool play)
+{
+    int64_t period = 1000000000LL / rate;
+    unsigned ticks = rate * FF_BENCH_PACED_MS / 1000;
+    struct ff_effect fe;
+
+    int64_t next = (int64_t) now_ns() + period;
+    for (unsigned i = 0; i < ticks; i++, next += period)
+    {
+        bench_effect(type, i, &fe);
+        fe.replay.length = 0;
+
+        bench_sleep(next);
+
+        if (!evff_update(evdev, slot, &fe) || (play && !evff_play(evdev, slot, 1)))
+        {
+            // A driver that queues updates reports a full queue this way
+            if (errno != EAGAIN && errno != ENOSPC)
+                warn("%s", play ? "update and play" : "update");
+            return false;
+        }
+
+        if ((int64_t) now_ns() > next + period)
+            return false;
+    }
+
+    return true;
+}
+
+// The highest rate from FF_BENCH_RATE_MIN that holds, doubling each time,
+// or 0 if even the lowest rate does not
+static unsigned bench_rate(evff_type_t type, int slot, bool play)
+{
+    unsigned held = 0;
+
+    if (!evff_play(evdev, slot, 1))
+        return 0;
+
+    for (unsigned rate = FF_BENCH_RATE_MIN; rate <= FF_BENCH_RATE_MAX; rate *= 2)
+    {
+        if (!bench_paced(type, slot, rate, play))
+            break;
+        held = rate;
+    }
+
+    evff_stop(evdev, slot);
+
+    return held;
+}
+
+static void bench_type(evidx_t index, int64_t *times)
+{
+    evff_type_t type = evff_type(evdev, index);
+    struct ff_effect fe;
+    int slot = -1;
+
+    if (!bench_effect(type, 0, &fe))
+        return;
+
+    printf("Effect %s (%d iterations)\n", evff_name(evdev, index), FF_BENCH_ITERATIONS);
+
+    // A fresh upload each time, the removal is not timed
+    for (int i = 0; i < FF_BENCH_ITERATIONS; i++)
+    {
+        bench_effect(type, i, &fe);
+
+        int64_t start = now_ns();
+        slot = evff_upload(evdev, &fe);
+        times[i] = (int64_t) now_ns() - start;
+
+        if (slot < 0)
+        {
+            warn("%s upload", evff_name(evdev, index));
+            return;
+        }
+        evff_erase(evdev, slot);
+    }
+    bench_report("upload", times, FF_BENCH_ITERATIONS);
+
+    slot = evff_upload(evdev, &fe);
+    if (slot < 0)
+    {
+        warn("%s upload", evff_name(evdev, index));
+        return;
+    }
+
+    // In place updates keep the kernel effect id
+    for (int i = 0; i < FF_BENCH_ITERATIONS; i++)
+    {
+        bench_effect(type, i + 1, &fe);
+
+        int64_t start = now_ns();
+        bool ok = evff_update(evdev, slot, &fe);
+        times[i] = (int64_t) now_ns() - start;
+
+        if (!ok)
+        {
+            warn("%s update", evff_name(evdev, index));
+            evff_erase(evdev, slot);
+            return;
+        }
+    }
+    bench_report("update", times, FF_BENCH_ITERATIONS);
+
+    // Restart the effect each time, the stop is not timed
+    for (int i = 0; i < FF_BENCH_ITERATIONS; i++)
+    {
+        int64_t start = now_ns();
+        bool ok = evff_play(evdev, slot, 1);
+        times[i] = (int64_t) now_ns() - start;
+
+        if (!ok)
+        {
+            warn("%s play", evff_name(evdev, index));
+            evff_erase(evdev, slot);
+            return;
+        }
+        evff_stop(evdev, slot);
+    }
+    bench_report("play", times, FF_BENCH_ITERATIONS);
+
+    // A closed loop pays for an update and sometimes a play every period
+    unsigned update_rate = bench_rate(type, slot, false);
+    unsigned play_rate = bench_rate(type, slot, true);
+
+    evff_erase(evdev, slot);
+
+    printf("  Paced rate: %u Hz update only, %u Hz update and play (%d ms per rate)\n",
+           update_rate, play_rate, FF_BENCH_PACED_MS);
+}
+
+static void op_ff_bench(void)
+{
+    evff_init(evdev);
+    if (evff_num(evdev) == 0)
+        xerrx("Device does not support force feedback");
+
+    VERBOSE("Effect slots: %zu\n", evff_slots(evdev));
+
+    int64_t *times = xalloc(sizeof(int64_t) * FF_BENCH_ITERATIONS);
+
+    for (evidx_t index = 0; index < evff_num(evdev); index++)
+        bench_type(index, times);
+
+    xfree(times);
+}
+#endif // ENABLE_EFFECTS
+
 ///////////////////////////////////////////////////////////////////////////////
 
 static void op_check(op_t *op, op_t val)
@@ -587,6 +932,10 @@ static int usage(void)
         "  -s  --set VALUES      Set new calibration VALUES in DEVICE\n"
         "  -g  --get             Get the calibration VALUES configured in DEVICE\n"
         "  -C, --calibrate       Execute calibration procedure\n"
+#if ENABLE_EFFECTS
+        "  -b, --ff-bench        Time force feedback upload, update and play in DEVICE\n"
+#endif
+        "  -t, --timing          Print the time spent in each phase to stderr on exit\n"
         "\n"
         "  VALUES is a comma separated list: [axis],[min],[max],[fuzz],[flat],...\n"
         "\n"
@@ -599,6 +948,12 @@ static int usage(void)
         "    evjscal -w 2,255,2,15 /dev/input/event11\n"
         "  Delete database values:\n"
         "    evjscal -D /dev/input/event11\n"
+        "  Break down the time taken to configure a device:\n"
+        "    evjscal --timing -c /dev/input/event11\n"
+#if ENABLE_EFFECTS
+        "  Benchmark the force feedback driver:\n"
+        "    evjscal --ff-bench /dev/input/event11\n"
+#endif
     );
 
     return 1;
@@ -606,6 +961,8 @@ static int usage(void)
 
 int main(int argc, char *argv[])
 {
+    timing_main = now_ns();
+
     op_t op = OP_NONE;
     static struct option long_options[] = {
         { "help",       no_argument,       NULL,  'h' },
@@ -619,6 +976,10 @@ int main(int argc, char *argv[])
         { "calibrate",  no_argument,       NULL,  'C' },
         { "set",        required_argument, NULL,  's' },
         { "get",        no_argument,       NULL,  'g' },
+#if ENABLE_EFFECTS
+        { "ff-bench",   no_argument,       NULL,  'b' },
+#endif
+        { "timing",     no_argument,       NULL,  't' },
         { 0,            0,                 NULL,  0   }
     };
     char *values = "";
@@ -627,7 +988,7 @@ int main(int argc, char *argv[])
     while (1)
     {
         int option_index = 0;
-        int c = getopt_long(argc, argv, "hvd:lrDw:cCs:g", long_options, &option_index);
+        int c = getopt_long(argc, argv, "hvd:lrDw:cCs:gbt", long_options, &option_index);
         if (c == -1)
             break;
 
@@ -666,6 +1027,14 @@ int main(int argc, char *argv[])
             case 'g':
                 op_check(&op, OP_GET);
                 break;
+#if ENABLE_EFFECTS
+            case 'b':
+                op_check(&op, OP_FF_BENCH);
+                break;
+#endif
+            case 't':
+                timing = true;
+                break;
             default:
             case 'h':
                 return usage();
@@ -689,7 +1058,9 @@ int main(int argc, char *argv[])
 
     if (!db_file)
     {
+        int64_t start = phase_start();
         db_file = config_path(CALDB_DEFAULT_NAME);
+        phase_stop(PHASE_CONFIG_PATH, start);
         VERBOSE("Database file: %s\n", db_file);
     }
 
@@ -697,15 +1068,24 @@ int main(int argc, char *argv[])
         op_list(db_file);
     }
     else {
+        int64_t start = phase_start();
         evdev = evdev_init(argv[optind]);
 
         evdev_id(evdev, &evid);
+        phase_stop(PHASE_EVDEV_INIT, start);
         VERBOSE("Device: %04x:%04x on bus %d\n", evid.vendor, evid.product, evid.bus);
 
+        start = phase_start();
         evabs_init(evdev);
-        if (evabs_num(evdev) == 0)
+        phase_stop(PHASE_EVABS_INIT, start);
+        if (evabs_num(evdev) == 0 && op != OP_FF_BENCH)
             xerrx("Device does not have absolute axes");
 
+        // Room for a calibration list and the values parsed for it
+        size_t abs_num = evabs_num(evdev);
+        arena = arena_init(abs_num * ARENA_SIZE(sizeof(cal_node_t)) +
+                           ARENA_SIZE(abs_num * VALUES_PER_AXIS * sizeof(int)));
+
         switch (op)
         {
             case OP_READ:
@@ -729,15 +1109,27 @@ int main(int argc, char *argv[])
             case OP_GET:
                 op_get();
                 break;
+#if ENABLE_EFFECTS
+            case OP_FF_BENCH:
+                op_ff_bench();
+                break;
+#endif
             default:
                 xerrx("No operation specified");
                 break;
         }
 
+        arena_free(arena);
+
+        start = phase_start();
         evdev_free(evdev);
+        phase_stop(PHASE_EVDEV_FREE, start);
     }
 
     xfree(db_file);
 
+    if (timing)
+        timing_report();
+
     return 0;
 }
@@ -0,0 +1,1660 @@
+//  evjs - Evdev Joystick Utilities
+//  Copyright (C) 2020 Scott Shumate <scott@shumatech.com>
+//
+//  This program is free software: you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation, either version 3 of the License, or
+//  (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+#define _GNU_SOURCE
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <unistd.h>
+#include <string.h>
+#include <signal.h>
+#include <errno.h>
+#include <err.h>
+#include <getopt.h>
+#include <time.h>
+#include <sys/epoll.h>
+#include <sys/timerfd.h>
+#include <sys/prctl.h>
+#include <sys/mman.h>
+#include <sched.h>
+#include <strings.h>
+#include <linux/input.h>
+
+#include "caldb.h"
+#include "util.h"
+#include "barray.h"
+#include "evdev.h"
+#include "device.h"
+#include "uidev.h"
+#include "shm.h"
+#include "evjs_shm.h"
+#include "fanout.h"
+#include "config.h"
+
+///////////////////////////////////////////////////////////////////////////////
+
+typedef enum op {
+    OP_NONE,
+    OP_LIST,
+    OP_DELETE,
+    OP_MERGE,
+    OP_MONITOR,
+    OP_ENGINE,
+    OP_PUBLISH,
+} op_t;
+
+typedef struct source
+{
+    const char  *file;
+    evdev_t     *evdev;
+    evdev_id_t  id;
+    int         *abs_target;
+    int         *key_target;
+    struct merge *merge;
+} source_t;
+
+typedef struct merge
+{
+    uidev_t     *uidev;
+    size_t      source_num;
+    source_t    *source_array;
+
+    int         abs_value[ABS_CNT];
+    barray_t    *abs_changed;
+    bool        key_value[KEY_CNT];
+    barray_t    *key_changed;
+
+    evtime_t    time;
+    bool        pending;
+} merge_t;
+
+typedef struct drift
+{
+    bool        calibrated;
+    evcal_t     cal;
+    int         low;
+    int         high;
+    int64_t     rest_sum;
+    unsigned    rest_num;
+} drift_t;
+
+typedef struct watch
+{
+    char        *file;
+    device_t    *dev;
+    drift_t     *drift_array;
+} watch_t;
+
+typedef struct monitor
+{
+    caldb_t     *db;
+    size_t      watch_num;
+    watch_t     *watch_array;
+    int         threshold;
+} monitor_t;
+
+typedef struct publisher
+{
+    char        *file;
+    device_t    *dev;
+    shm_t       *shm;
+    fanout_t    *fanout;
+    unsigned    device;
+} publisher_t;
+
+typedef struct publish
+{
+    caldb_t     *db;
+    bool        shm;
+    fanout_t    *fanout;
+    size_t      publisher_num;
+    publisher_t *publisher_array;
+} publish_t;
+
+#if ENABLE_EFFECTS
+typedef struct engine
+{
+    device_t    *dev;
+    axis_t      *axis;
+    int         slot;
+    struct ff_effect effect;
+
+    double      spring;
+    double      damper;
+    double      friction;
+    double      gain;
+
+    double      position;
+    double      velocity;
+    evtime_t    time;
+    int64_t     moved;
+
+    uint64_t    ticks;
+    uint64_t    overruns;
+    uint64_t    updates;
+    evstats_t   lateness;
+    evstats_t   update;
+} engine_t;
+#endif
+
+#define COMPOSITE_PREFIX    "evjs "
+#define COMPOSITE_ABS_MAX   ABS_MISC
+#define COMPOSITE_EVENTS    16
+
+#define MONITOR_TICK        10
+#define MONITOR_INTERVAL    3600
+#define MONITOR_THRESHOLD   5
+#define MONITOR_SLACK_NS    1000000000UL
+// An axis that stays within this part of its range, or its flat or fuzz if
+// larger, over a whole tick is at rest
+#define MONITOR_REST_DIV    100
+// A range that shrank is only reported once the extremes reached cover
+// this many percent of the calibrated range, before that the axis has
+// just not been moved end to end
+#define MONITOR_SWEEP_PCT   75
+
+#define FANOUT_QUEUE        64
+#define FANOUT_QUEUE_MAX    65536
+
+#define ENGINE_RATE         1000
+#define ENGINE_PRIORITY     50
+#define ENGINE_SLACK_NS     1
+// The damper reaches full strength at this axis speed in ranges per second
+#define ENGINE_DAMPER_SPEED 2.0
+// Friction fades in below this speed so that it does not chatter at rest
+#define ENGINE_STICK_SPEED  0.05
+// Time constant of the velocity smoothing in microseconds
+#define ENGINE_VELOCITY_TAU 5000.0
+// The axis is considered at rest when no event arrived for this long
+#define ENGINE_IDLE_NS      50000000LL
+
+#define VERBOSE(...)  ({ if (verbose) printf(__VA_ARGS__); })
+
+///////////////////////////////////////////////////////////////////////////////
+
+static bool          verbose;
+static volatile bool running = true;
+
+///////////////////////////////////////////////////////////////////////////////
+//
+// List Operation
+//
+///////////////////////////////////////////////////////////////////////////////
+
+static bool map_lister(const caldb_map_record_t *rec, void *arg)
+{
+    const char **comma = arg;
+
+    printf("%s%04x:%04x:%04x,%d,%d,%d", *comma, rec->dev.bus, rec->dev.vendor,
+           rec->dev.product, rec->type, rec->code, rec->target);
+    *comma = ",";
+
+    return true;
+}
+
+static bool name_lister(const char *name, void *arg)
+{
+    caldb_t *db = arg;
+    char *err_msg;
+    const char *comma = "";
+
+    printf("%s = ", name);
+    if (!caldb_map_read(db, name, map_lister, &comma, &err_msg))
+        xerrx("%s", err_msg);
+    printf("\n");
+
+    return true;
+}
+
+static void op_list(const char *db_file)
+{
+    char *err_msg;
+
+    caldb_t *db = caldb_init(db_file, &err_msg);
+    if (!db)
+        xerrx("%s: %s", db_file, err_msg);
+
+    if (!caldb_map_list(db, name_lister, db, &err_msg))
+        xerrx("%s", err_msg);
+
+    caldb_free(db);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+//
+// Delete Operation
+//
+///////////////////////////////////////////////////////////////////////////////
+
+static void op_delete(const char *db_file, const char *name)
+{
+    char *err_msg;
+
+    caldb_t *db = caldb_init(db_file, &err_msg);
+    if (!db)
+        xerrx("%s: %s", db_file, err_msg);
+
+    if (!caldb_map_delete(db, name, &err_msg))
+        xerrx("%s", err_msg);
+
+    caldb_free(db);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+//
+// Merge Operation
+//
+///////////////////////////////////////////////////////////////////////////////
+
+static source_t *source_lookup(merge_t *merge, const evdev_id_t *id)
+{
+    for (source_t *src = merge->source_array; src < &merge->source_array[merge->source_num]; src++)
+    {
+        if (src->id.bus == id->bus && src->id.vendor == id->vendor &&
+            src->id.product == id->product)
+            return src;
+    }
+    return NULL;
+}
+
+static bool map_reader(const caldb_map_record_t *rec, void *arg)
+{
+    merge_t *merge = arg;
+
+    source_t *src = source_lookup(merge, &rec->dev);
+    if (!src)
+    {
+        VERBOSE("Skip unused mapping for %04x:%04x:%04x\n",
+                rec->dev.bus, rec->dev.vendor, rec->dev.product);
+        return true;
+    }
+
+    if (rec->type == EV_ABS && rec->code < ABS_CNT && rec->target < ABS_CNT)
+    {
+        int index = evabs_map(src->evdev, rec->code);
+        if (index >= 0)
+            src->abs_target[index] = rec->target;
+    }
+    else if (rec->type == EV_KEY && rec->code < KEY_CNT && rec->target < KEY_CNT)
+    {
+        int index = evkey_map(src->evdev, rec->code);
+        if (index >= 0)
+            src->key_target[index] = rec->target;
+    }
+
+    return true;
+}
+
+static int map_free_abs(bool *used, int id)
+{
+    if (id < COMPOSITE_ABS_MAX && !used[id])
+        return id;
+
+    for (id = 0; id < COMPOSITE_ABS_MAX; id++)
+        if (!used[id])
+            return id;
+
+    xerrx("Too many axes for a composite device");
+}
+
+static int map_free_key(bool *used, int id)
+{
+    if (!used[id])
+        return id;
+
+    for (id = BTN_TRIGGER_HAPPY; id <= BTN_TRIGGER_HAPPY40; id++)
+        if (!used[id])
+            return id;
+
+    xerrx("Too many buttons for a composite device");
+}
+
+static void map_generate(merge_t *merge)
+{
+    bool abs_used[ABS_CNT] = { 0 };
+    bool key_used[KEY_CNT] = { 0 };
+
+    for (source_t *src = merge->source_array; src < &merge->source_array[merge->source_num]; src++)
+    {
+        for (int index = 0; index < evabs_num(src->evdev); index++)
+        {
+            int target = map_free_abs(abs_used, evabs_id(src->evdev, index));
+            abs_used[target] = true;
+            src->abs_target[index] = target;
+        }
+
+        for (int index = 0; index < evkey_num(src->evdev); index++)
+        {
+            int target = map_free_key(key_used, evkey_id(src->evdev, index));
+            key_used[target] = true;
+            src->key_target[index] = target;
+        }
+    }
+}
+
+typedef struct map_cursor
+{
+    merge_t *merge;
+    source_t *src;
+    int type;
+    int index;
+} map_cursor_t;
+
+static bool map_writer(caldb_map_record_t *rec, void *arg)
+{
+    map_cursor_t *cur = arg;
+    merge_t *merge = cur->merge;
+
+    while (cur->src < &merge->source_array[merge->source_num])
+    {
+        source_t *src = cur->src;
+
+        if (cur->type == EV_ABS && cur->index < evabs_num(src->evdev))
+        {
+            rec->dev    = src->id;
+            rec->type   = EV_ABS;
+            rec->code   = evabs_id(src->evdev, cur->index);
+            rec->target = src->abs_target[cur->index++];
+            return true;
+        }
+        else if (cur->type == EV_ABS)
+        {
+            cur->type = EV_KEY;
+            cur->index = 0;
+        }
+        else if (cur->index < evkey_num(src->evdev))
+        {
+            rec->dev    = src->id;
+            rec->type   = EV_KEY;
+            rec->code   = evkey_id(src->evdev, cur->index);
+            rec->target = src->key_target[cur->index++];
+            return true;
+        }
+        else
+        {
+            cur->src++;
+            cur->type = EV_ABS;
+            cur->index = 0;
+        }
+    }
+
+    return false;
+}
+
+static void map_load(merge_t *merge, const char *db_file, const char *name)
+{
+    char *err_msg;
+
+    caldb_t *db = caldb_init(db_file, &err_msg);
+    if (!db)
+        xerrx("%s: %s", db_file, err_msg);
+
+    if (!caldb_map_read(db, name, map_reader, merge, &err_msg))
+        xerrx("%s", err_msg);
+
+    bool mapped = false;
+    for (source_t *src = merge->source_array; src < &merge->source_array[merge->source_num]; src++)
+    {
+        for (int index = 0; index < evabs_num(src->evdev); index++)
+            mapped |= (src->abs_target[index] >= 0);
+        for (int index = 0; index < evkey_num(src->evdev); index++)
+            mapped |= (src->key_target[index] >= 0);
+    }
+
+    if (!mapped)
+    {
+        VERBOSE("No mapping for %s in database, generating a default mapping\n", name);
+
+        map_generate(merge);
+
+        map_cursor_t cur = { .merge = merge, .src = merge->source_array, .type = EV_ABS };
+        if (!caldb_map_write(db, name, map_writer, &cur, &err_msg))
+            xerrx("%s", err_msg);
+    }
+
+    caldb_free(db);
+}
+
+static void flush_abs(bit_t id, void *arg)
+{
+    merge_t *merge = arg;
+
+    uidev_abs(merge->uidev, id, merge->abs_value[id]);
+}
+
+static void flush_key(bit_t id, void *arg)
+{
+    merge_t *merge = arg;
+
+    uidev_key(merge->uidev, id, merge->key_value[id]);
+}
+
+static void merge_flush(merge_t *merge)
+{
+    if (!merge->pending)
+        return;
+
+    barray_foreach_set(merge->abs_changed, flush_abs, merge);
+    barray_foreach_set(merge->key_changed, flush_key, merge);
+    barray_zero(merge->abs_changed);
+    barray_zero(merge->key_changed);
+    uidev_syn(merge->uidev, merge->time);
+
+    merge->pending = false;
+}
+
+// A value still waiting from a completed frame is flushed before it is
+// replaced, otherwise a press and release in one wakeup would be lost
+static void merge_abs(evidx_t index, int value, void *arg)
+{
+    source_t *src = arg;
+    merge_t *merge = src->merge;
+
+    int target = src->abs_target[index];
+    if (target >= 0)
+    {
+        if (merge->pending && barray_is_set(merge->abs_changed, target))
+            merge_flush(merge);
+        merge->abs_value[target] = value;
+        barray_set(merge->abs_changed, target);
+    }
+}
+
+static void merge_key(evidx_t index, bool value, void *arg)
+{
+    source_t *src = arg;
+    merge_t *merge = src->merge;
+
+    int target = src->key_target[index];
+    if (target >= 0)
+    {
+        if (merge->pending && barray_is_set(merge->key_changed, target))
+            merge_flush(merge);
+        merge->key_value[target] = value;
+        barray_set(merge->key_changed, target);
+    }
+}
+
+static void merge_syn(evtime_t time, void *arg)
+{
+    source_t *src = arg;
+    merge_t *merge = src->merge;
+
+    if (time > merge->time)
+        merge->time = time;
+    merge->pending = true;
+}
+
+static void merge_create(merge_t *merge, const char *name)
+{
+    char *dev_name;
+    xasprintf(&dev_name, COMPOSITE_PREFIX "%s", name);
+
+    // Derive a stable product ID from the name so that each composite
+    // device can have its own calibration in the database
+    evdev_id_t id = { .bus = BUS_VIRTUAL };
+    for (const char *p = name; *p; p++)
+        id.product = (id.product * 31 + *p) & 0xffff;
+
+    merge->uidev = uidev_init(dev_name, &id);
+
+    for (source_t *src = merge->source_array; src < &merge->source_array[merge->source_num]; src++)
+    {
+        for (int index = 0; index < evabs_num(src->evdev); index++)
+        {
+            int target = src->abs_target[index];
+            if (target >= 0)
+            {
+                evcal_t cal;
+                evabs_cal_get(src->evdev, index, &cal);
+                // The source values have already been through the fuzz
+                cal.fuzz = 0;
+                uidev_abs_add(merge->uidev, target, &cal);
+                merge->abs_value[target] = evabs_value(src->evdev, index);
+                VERBOSE("Map %s axis %s to %d\n", src->file, evabs_name(src->evdev, index), target);
+            }
+        }
+
+        for (int index = 0; index < evkey_num(src->evdev); index++)
+        {
+            int target = src->key_target[index];
+            if (target >= 0)
+            {
+                uidev_key_add(merge->uidev, target);
+                merge->key_value[target] = evkey_value(src->evdev, index);
+                VERBOSE("Map %s key %d to %d\n", src->file, evkey_id(src->evdev, index), target);
+            }
+        }
+    }
+
+    uidev_create(merge->uidev);
+
+    VERBOSE("Created composite device %s (%04x:%04x:%04x)\n", dev_name, id.bus, id.vendor, id.product);
+
+    xfree(dev_name);
+}
+
+static void source_open(merge_t *merge, source_t *src, const char *file, bool grab)
+{
+    src->file = file;
+    src->merge = merge;
+    src->evdev = evdev_init(file);
+    evdev_id(src->evdev, &src->id);
+    evabs_init(src->evdev);
+    evkey_init(src->evdev);
+
+    if (source_lookup(merge, &src->id) != src)
+        xerrx("%s: Duplicate device ID %04x:%04x:%04x", file,
+              src->id.bus, src->id.vendor, src->id.product);
+
+    if (grab && !evdev_grab(src->evdev, true))
+        xerr("%s: grab", file);
+
+    size_t abs_num = evabs_num(src->evdev);
+    src->abs_target = xalloc(sizeof(int) * (abs_num + 1));
+    for (int index = 0; index < abs_num; index++)
+        src->abs_target[index] = -1;
+
+    size_t key_num = evkey_num(src->evdev);
+    src->key_target = xalloc(sizeof(int) * (key_num + 1));
+    for (int index = 0; index < key_num; index++)
+        src->key_target[index] = -1;
+
+    evdev_read_cb(src->evdev, merge_abs, src, merge_key, src);
+    evdev_syn_cb(src->evdev, merge_syn, src);
+
+    VERBOSE("Source %s: %04x:%04x:%04x with %zu axes and %zu buttons\n", file,
+            src->id.bus, src->id.vendor, src->id.product, abs_num, key_num);
+}
+
+static void source_close(source_t *src)
+{
+    evdev_free(src->evdev);
+    xfree(src->abs_target);
+    xfree(src->key_target);
+}
+
+static void sig_stop(int sig)
+{
+    running = false;
+}
+
+static void op_merge(const char *db_file, const char *name, char **files, int num, bool grab)
+{
+    merge_t merge = { 0 };
+
+    merge.abs_changed = barray_init(ABS_CNT);
+    merge.key_changed = barray_init(KEY_CNT);
+
+    merge.source_array = xalloc(sizeof(source_t) * num);
+    for (int i = 0; i < num; i++)
+    {
+        merge.source_num++;
+        source_open(&merge, &merge.source_array[i], files[i], grab);
+    }
+
+    map_load(&merge, db_file, name);
+
+    merge_create(&merge, name);
+
+    int epfd = epoll_create1(EPOLL_CLOEXEC);
+    if (epfd < 0)
+        xerr("epoll");
+
+    for (source_t *src = merge.source_array; src < &merge.source_array[merge.source_num]; src++)
+    {
+        struct epoll_event ev = { .events = EPOLLIN, .data.ptr = src };
+        if (epoll_ctl(epfd, EPOLL_CTL_ADD, evdev_fileno(src->evdev), &ev) < 0)
+            xerr("epoll_ctl");
+    }
+
+    signal(SIGINT, sig_stop);
+    signal(SIGTERM, sig_stop);
+
+    // Every source that is ready in one wakeup contributes to a single
+    // merged frame so several 1 kHz devices cost one write per wakeup,
+    // unless a source sent a control again before the frame was written
+    struct epoll_event events[COMPOSITE_EVENTS];
+    while (running)
+    {
+        int nfds = epoll_wait(epfd, events, COMPOSITE_EVENTS, -1);
+        if (nfds < 0)
+        {
+            if (errno == EINTR)
+                continue;
+            xerr("epoll_wait");
+        }
+
+        for (int i = 0; i < nfds; i++)
+        {
+            source_t *src = events[i].data.ptr;
+
+            if (events[i].events & (EPOLLERR | EPOLLHUP))
+                xerrx("%s: device removed", src->file);
+
+            evdev_read(src->evdev);
+        }
+
+        merge_flush(&merge);
+    }
+
+    close(epfd);
+
+    uidev_free(merge.uidev);
+    for (source_t *src = merge.source_array; src < &merge.source_array[merge.source_num]; src++)
+        source_close(src);
+    xfree(merge.source_array);
+
+    barray_free(merge.abs_changed);
+    barray_free(merge.key_changed);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+//
+// Filter Functions
+//
+///////////////////////////////////////////////////////////////////////////////
+
+static bool filter_reader(const caldb_filter_record_t *rec, void *arg)
+{
+    device_t *dev = arg;
+
+    axis_t *axis = device_axis_get(dev, rec->axis);
+    if (axis)
+        device_axis_filter(dev, axis, rec->type, rec->param1, rec->param2);
+
+    return true;
+}
+
+// The jitter filters saved from evjstest apply to the axes evjsd reads
+static void filter_load(caldb_t *db, device_t *dev)
+{
+    char *err_msg;
+
+    if (!caldb_filter_read(db, &dev->id, filter_reader, dev, &err_msg))
+        xerrx("%s", err_msg);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+//
+// Monitor Operation
+//
+///////////////////////////////////////////////////////////////////////////////
+
+static bool drift_reader(const evdev_id_t *id, const caldb_record_t *rec, void *arg)
+{
+    watch_t *watch = arg;
+
+    axis_t *axis = device_axis_get(watch->dev, rec->axis);
+    if (axis && rec->cal.max > rec->cal.min)
+    {
+        drift_t *drift = &watch->drift_array[axis->index];
+        drift->calibrated = true;
+        drift->cal = rec->cal;
+    }
+
+    return true;
+}
+
+static void drift_axis(axis_t *axis, void *arg)
+{
+    drift_t *drift = &((drift_t *) arg)[axis->index];
+
+    if (axis->value < drift->low)
+        drift->low = axis->value;
+    if (axis->value > drift->high)
+        drift->high = axis->value;
+}
+
+static int drift_band(const drift_t *drift)
+{
+    int band = (drift->cal.max - drift->cal.min) / MONITOR_REST_DIV;
+    if (band < drift->cal.flat)
+        band = drift->cal.flat;
+    if (band < drift->cal.fuzz)
+        band = drift->cal.fuzz;
+    return band;
+}
+
+static void watch_remove(watch_t *watch)
+{
+    device_free(watch->dev);
+    xfree(watch->drift_array);
+    xfree(watch->file);
+    watch->dev = NULL;
+}
+
+static void watch_add(const char *file, const evdev_id_t *id, const char *name, void *arg)
+{
+    monitor_t *monitor = arg;
+    char *err_msg;
+
+    monitor->watch_array = xrealloc(monitor->watch_array,
+                                    sizeof(watch_t) * (monitor->watch_num + 1));
+
+    watch_t *watch = &monitor->watch_array[monitor->watch_num];
+    watch->file = xstrdup(file);
+    watch->dev = device_init(watch->file);
+    watch->drift_array = xalloc(sizeof(drift_t) * watch->dev->axis_num);
+
+    if (!caldb_read(monitor->db, &watch->dev->id, drift_reader, watch, &err_msg))
+        xerrx("%s", err_msg);
+    filter_load(monitor->db, watch->dev);
+
+    bool calibrated = false;
+    for (int index = 0; index < watch->dev->axis_num; index++)
+        calibrated |= watch->drift_array[index].calibrated;
+
+    if (!calibrated)
+    {
+        watch_remove(watch);
+        return;
+    }
+
+    AXIS_FOREACH(watch->dev, axis)
+        watch->drift_array[axis->index].low = watch->drift_array[axis->index].high = axis->value;
+    device_axis_track_reset(watch->dev);
+    device_read_cb(watch->dev, drift_axis, NULL, watch->drift_array);
+
+    VERBOSE("Monitor %s: %s\n", file, name);
+
+    monitor->watch_num++;
+}
+
+static void drift_tick(monitor_t *monitor)
+{
+    // A worn potentiometer jitters all the time, so rest is staying within
+    // a small band rather than sending no events
+    for (watch_t *watch = monitor->watch_array; watch < &monitor->watch_array[monitor->watch_num]; watch++)
+    {
+        if (!watch->dev)
+            continue;
+
+        AXIS_FOREACH(watch->dev, axis)
+        {
+            drift_t *drift = &watch->drift_array[axis->index];
+            if (drift->high - drift->low <= drift_band(drift))
+            {
+                drift->rest_sum += (drift->low + drift->high) / 2;
+                drift->rest_num++;
+            }
+            drift->low = drift->high = axis->value;
+        }
+    }
+}
+
+typedef struct drift_cursor
+{
+    monitor_t   *monitor;
+    watch_t     *watch;
+    axis_t      *axis;
+    int64_t     time;
+} drift_cursor_t;
+
+static bool drift_writer(caldb_drift_record_t *rec, void *arg)
+{
+    drift_cursor_t *cur = arg;
+    device_t *dev = cur->watch->dev;
+
+    for (; cur->axis < &dev->axis_array[dev->axis_num]; cur->axis++)
+    {
+        axis_t *axis = cur->axis;
+        drift_t *drift = &cur->watch->drift_array[axis->index];
+        if (!drift->calibrated)
+            continue;
+
+        int range = drift->cal.max - drift->cal.min;
+        int center = drift->cal.min + range / 2;
+        int rest = drift->rest_num ? drift->rest_sum / drift->rest_num : axis->value;
+        int over_min = drift->cal.min - axis->minimum;
+        int over_max = axis->maximum - drift->cal.max;
+        int span = axis->maximum - axis->minimum;
+
+        // Drift is reported in tenths of a percent of the calibrated range.
+        // The extremes are kept since the monitor started so that slow
+        // drift shows up.  A range grew when they go past the calibrated
+        // ones and shrank when an axis that has been swept falls short.
+        // The center is only meaningful for axes that were seen at rest in
+        // the middle half of their range, i.e. not throttles, pedals or
+        // sliders, and rest is measured per interval.
+        rec->axis         = axis->id;
+        rec->time         = cur->time;
+        rec->min          = axis->minimum;
+        rec->max          = axis->maximum;
+        rec->rest         = rest;
+        if (over_min > 0 || over_max > 0)
+            rec->range_drift = (int64_t)((over_min > 0 ? over_min : 0) + (over_max > 0 ? over_max : 0)) *
+                               1000 / range;
+        else if ((int64_t) span * 100 >= (int64_t) range * MONITOR_SWEEP_PCT)
+            rec->range_drift = (int64_t)(span - range) * 1000 / range;
+        else
+            rec->range_drift = 0;
+        if (drift->rest_num && rest > drift->cal.min + range / 4 && rest < drift->cal.max - range / 4)
+            rec->center_drift = (int64_t)(rest - center) * 1000 / range;
+        else
+            rec->center_drift = 0;
+
+        int threshold = cur->monitor->threshold * 10;
+        if (abs(rec->range_drift) > threshold)
+            warnx("%s: %s axis %s range drifted %s%d.%d%% (%d..%d, calibrated %d..%d)",
+                  cur->watch->file, dev->name, axis->name, rec->range_drift < 0 ? "-" : "",
+                  abs(rec->range_drift) / 10, abs(rec->range_drift) % 10,
+                  axis->minimum, axis->maximum, drift->cal.min, drift->cal.max);
+        if (abs(rec->center_drift) > threshold)
+            warnx("%s: %s axis %s center drifted %s%d.%d%% (rest %d, calibrated %d)",
+                  cur->watch->file, dev->name, axis->name, rec->center_drift < 0 ? "-" : "",
+                  abs(rec->center_drift) / 10, abs(rec->center_drift) % 10, rest, center);
+
+        drift->rest_sum = 0;
+        drift->rest_num = 0;
+
+        cur->axis++;
+        return true;
+    }
+
+    return false;
+}
+
+static void drift_flush(monitor_t *monitor)
+{
+    char *err_msg;
+
+    for (watch_t *watch = monitor->watch_array; watch < &monitor->watch_array[monitor->watch_num]; watch++)
+    {
+        if (!watch->dev)
+            continue;
+
+        drift_cursor_t cur = {
+            .monitor = monitor,
+            .watch   = watch,
+            .axis    = watch->dev->axis_array,
+            .time    = time(NULL),
+        };
+
+        if (!caldb_drift_write(monitor->db, &watch->dev->id, drift_writer, &cur, &err_msg))
+        {
+            warnx("%s", err_msg);
+            caldb_err_free(err_msg);
+        }
+    }
+}
+
+static void op_monitor(const char *db_file, unsigned interval, int threshold)
+{
+    monitor_t monitor = { .threshold = threshold };
+    char *err_msg;
+
+    monitor.db = caldb_init(db_file, &err_msg);
+    if (!monitor.db)
+        xerrx("%s: %s", db_file, err_msg);
+
+    device_scan(watch_add, &monitor);
+    if (monitor.watch_num == 0)
+        xerrx("No calibrated devices found");
+
+    // Let the kernel coalesce the monitor timer with other wakeups
+    prctl(PR_SET_TIMERSLACK, MONITOR_SLACK_NS);
+
+    int tfd = timerfd_create(CLOCK_MONOTONIC, TFD_CLOEXEC);
+    if (tfd < 0)
+        xerr("timerfd");
+
+    struct itimerspec its = {
+        .it_interval = { .tv_sec = MONITOR_TICK },
+        .it_value    = { .tv_sec = MONITOR_TICK },
+    };
+    if (timerfd_settime(tfd, 0, &its, NULL) < 0)
+        xerr("timerfd_settime");
+
+    int epfd = epoll_create1(EPOLL_CLOEXEC);
+    if (epfd < 0)
+        xerr("epoll");
+
+    struct epoll_event ev = { .events = EPOLLIN, .data.ptr = NULL };
+    if (epoll_ctl(epfd, EPOLL_CTL_ADD, tfd, &ev) < 0)
+        xerr("epoll_ctl");
+
+    for (watch_t *watch = monitor.watch_array; watch < &monitor.watch_array[monitor.watch_num]; watch++)
+    {
+        ev.data.ptr = watch;
+        if (epoll_ctl(epfd, EPOLL_CTL_ADD, device_fileno(watch->dev), &ev) < 0)
+            xerr("epoll_ctl");
+    }
+
+    signal(SIGINT, sig_stop);
+    signal(SIGTERM, sig_stop);
+
+    unsigned ticks = 0;
+    struct epoll_event events[COMPOSITE_EVENTS];
+    while (running)
+    {
+        int nfds = epoll_wait(epfd, events, COMPOSITE_EVENTS, -1);
+        if (nfds < 0)
+        {
+            if (errno == EINTR)
+                continue;
+            xerr("epoll_wait");
+        }
+
+        for (int i = 0; i < nfds; i++)
+        {
+            watch_t *watch = events[i].data.ptr;
+
+            if (!watch)
+            {
+                uint64_t expired;
+                if (read(tfd, &expired, sizeof(expired)) != sizeof(expired))
+                    continue;
+
+                drift_tick(&monitor);
+
+                ticks += expired;
+                if (ticks * MONITOR_TICK >= interval)
+                {
+                    drift_flush(&monitor);
+                    ticks = 0;
+                }
+            }
+            else if (events[i].events & (EPOLLERR | EPOLLHUP))
+            {
+                VERBOSE("Device %s removed\n", watch->file);
+                epoll_ctl(epfd, EPOLL_CTL_DEL, device_fileno(watch->dev), NULL);
+                watch_remove(watch);
+            }
+            else
+            {
+                device_read(watch->dev);
+            }
+        }
+    }
+
+    drift_flush(&monitor);
+
+    close(epfd);
+    close(tfd);
+
+    for (watch_t *watch = monitor.watch_array; watch < &monitor.watch_array[monitor.watch_num]; watch++)
+        if (watch->dev)
+            watch_remove(watch);
+    xfree(monitor.watch_array);
+
+    caldb_free(monitor.db);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+//
+// Publish Operation
+//
+///////////////////////////////////////////////////////////////////////////////
+
+static void publish_syn(evtime_t time, void *arg)
+{
+    publisher_t *pub = arg;
+
+    if (pub->shm)
+        shm_publish(pub->shm, time);
+    if (pub->fanout)
+        fanout_frame(pub->fanout, pub->device, time);
+}
+
+static void publisher_add(const char *file, const evdev_id_t *id, const char *name, void *arg)
+{
+    publish_t *publish = arg;
+
+    publish->publisher_array = xrealloc(publish->publisher_array,
+                                        sizeof(publisher_t) * (publish->publisher_num + 1));
+
+    publisher_t *pub = &publish->publisher_array[publish->publisher_num];
+    pub->file = xstrdup(file);
+    pub->dev = device_init(pub->file);
+    filter_load(publish->db, pub->dev);
+    pub->shm = NULL;
+    pub->fanout = publish->fanout;
+
+    if (publish->shm)
+    {
+        pub->shm = shm_init(pub->dev);
+        VERBOSE("Publish %s: %s to %s\n", file, pub->dev->name, shm_path(pub->shm));
+    }
+    if (pub->fanout)
+    {
+        pub->device = fanout_device_add(pub->fanout, pub->dev);
+        VERBOSE("Serve %s: %s as device %u\n", file, pub->dev->name, pub->device);
+    }
+
+    publish->publisher_num++;
+}
+
+static void publisher_remove(publisher_t *pub)
+{
+    if (pub->shm)
+        shm_free(pub->shm);
+    if (pub->fanout)
+        fanout_device_remove(pub->fanout, pub->device);
+    device_free(pub->dev);
+    xfree(pub->file);
+    pub->dev = NULL;
+}
+
+// Every reader of a device costs the kernel a wakeup per frame, so one
+// process reads each device and publishes its state to any number of
+// local readers through shared memory, or serves every frame to them on
+// a socket
+static void op_publish(const char *db_file, char **files, int num, bool shm, const char *sock_file,
+                       size_t queue_len)
+{
+    publish_t publish = { .shm = shm };
+    char *err_msg;
+
+    publish.db = caldb_init(db_file, &err_msg);
+    if (!publish.db)
+        xerrx("%s: %s", db_file, err_msg);
+
+    if (sock_file)
+    {
+        publish.fanout = fanout_init(sock_file, queue_len);
+        VERBOSE("Serving on %s\n", sock_file);
+    }
+
+    if (num > 0)
+    {
+        for (int i = 0; i < num; i++)
+            publisher_add(files[i], NULL, NULL, &publish);
+    }
+    else if (device_scan(publisher_add, &publish) == 0)
+        xerrx("No joysticks found");
+
+    caldb_free(publish.db);
+
+    // The array is final, so the callbacks can point into it
+    for (publisher_t *pub = publish.publisher_array; pub < &publish.publisher_array[publish.publisher_num]; pub++)
+        device_syn_cb(pub->dev, publish_syn, pub);
+
+    int epfd = epoll_create1(EPOLL_CLOEXEC);
+    if (epfd < 0)
+        xerr("epoll");
+
+    for (publisher_t *pub = publish.publisher_array; pub < &publish.publisher_array[publish.publisher_num]; pub++)
+    {
+        struct epoll_event ev = { .events = EPOLLIN, .data.ptr = pub };
+        if (epoll_ctl(epfd, EPOLL_CTL_ADD, device_fileno(pub->dev), &ev) < 0)
+            xerr("epoll_ctl");
+    }
+
+    if (publish.fanout)
+    {
+        struct epoll_event ev = { .events = EPOLLIN, .data.ptr = NULL };
+        if (epoll_ctl(epfd, EPOLL_CTL_ADD, fanout_fileno(publish.fanout), &ev) < 0)
+            xerr("epoll_ctl");
+    }
+
+    signal(SIGINT, sig_stop);
+    signal(SIGTERM, sig_stop);
+
+    struct epoll_event events[COMPOSITE_EVENTS];
+    while (running)
+    {
+        int nfds = epoll_wait(epfd, events, COMPOSITE_EVENTS, -1);
+        if (nfds < 0)
+        {
+            if (errno == EINTR)
+                continue;
+            xerr("epoll_wait");
+        }
+
+        for (int i = 0; i < nfds; i++)
+        {
+            publisher_t *pub = events[i].data.ptr;
+
+            if (!pub)
+            {
+                fanout_poll(publish.fanout);
+            }
+            else if (events[i].events & (EPOLLERR | EPOLLHUP))
+            {
+                VERBOSE("Device %s removed\n", pub->file);
+                epoll_ctl(epfd, EPOLL_CTL_DEL, device_fileno(pub->dev), NULL);
+                publisher_remove(pub);
+            }
+            else
+            {
+                device_read(pub->dev);
+            }
+        }
+
+        // One batch per subscriber for all the frames of this wakeup
+        if (publish.fanout)
+            fanout_flush(publish.fanout);
+    }
+
+    close(epfd);
+
+    for (publisher_t *pub = publish.publisher_array; pub < &publish.publisher_array[publish.publisher_num]; pub++)
+        if (pub->dev)
+            publisher_remove(pub);
+    xfree(publish.publisher_array);
+
+    if (publish.fanout)
+        fanout_free(publish.fanout);
+}
+
+#if ENABLE_EFFECTS
+///////////////////////////////////////////////////////////////////////////////
+//
+// Engine Operation
+//
+///////////////////////////////////////////////////////////////////////////////
+
+static double engine_clamp(double value)
+{
+    return value < -1.0 ? -1.0 : value > 1.0 ? 1.0 : value;
+}
+
+static void engine_params(engine_t *engine, const char *params)
+{
+    char *copy = xstrdup(params);
+    char *save;
+
+    for (char *param = strtok_r(copy, ",", &save); param; param = strtok_r(NULL, ",", &save))
+    {
+        char *value = strchr(param, '=');
+        if (!value)
+            xerrx("Expected NAME=PCT: %s", param);
+        *value++ = '\0';
+
+        int pct = atoi(value);
+        if (pct < -100 || pct > 100)
+            xerrx("Invalid percentage: %s", value);
+
+        if (strcmp(param, "spring") == 0 && pct >= 0)
+            engine->spring = pct / 100.0;
+        else if (strcmp(param, "damper") == 0 && pct >= 0)
+            engine->damper = pct / 100.0;
+        else if (strcmp(param, "friction") == 0 && pct >= 0)
+            engine->friction = pct / 100.0;
+        else if (strcmp(param, "gain") == 0)
+            engine->gain = pct / 100.0;
+        else
+            xerrx("Invalid engine parameter: %s=%s", param, value);
+    }
+
+    xfree(copy);
+}
+
+static axis_t *engine_axis(device_t *dev, const char *name)
+{
+    if (!name)
+        return &dev->axis_array[0];
+
+    char *end;
+    long id = strtol(name, &end, 0);
+
+    AXIS_FOREACH(dev, axis)
+    {
+        if ((*end == '\0' && axis->id == id) || strcasecmp(axis->name, name) == 0)
+            return axis;
+    }
+
+    xerrx("Device does not have axis %s", name);
+}
+
+static void engine_position(axis_t *axis, void *arg)
+{
+    engine_t *engine = arg;
+
+    if (axis != engine->axis || axis->cal.max <= axis->cal.min)
+        return;
+
+    double position = engine_clamp(2.0 * (axis->value - axis->cal.min) /
+                                   (axis->cal.max - axis->cal.min) - 1.0);
+
+    // Velocity is taken from the kernel timestamps of the position events
+    // so that it does not depend on when the loop happens to read them
+    evtime_t time = evdev_time(engine->dev->evdev);
+    if (engine->time && time > engine->time)
+    {
+        double dt = time - engine->time;
+        double velocity = (position - engine->position) * 1e6 / dt;
+        engine->velocity += (velocity - engine->velocity) * dt / (ENGINE_VELOCITY_TAU + dt);
+    }
+
+    engine->position = position;
+    engine->time = time;
+    engine->moved = now_ns();
+}
+
+static void engine_tick(engine_t *engine, int64_t now)
+{
+    if (now - engine->moved > ENGINE_IDLE_NS)
+        engine->velocity = 0.0;
+
+    double force = -engine->spring * engine->position
+                   - engine->damper * engine_clamp(engine->velocity / ENGINE_DAMPER_SPEED)
+                   - engine->friction * engine_clamp(engine->velocity / ENGINE_STICK_SPEED);
+
+    int level = engine_clamp(force * engine->gain) * 0x7fff;
+
+    // Only changes go to the device to spare the bus at high rates
+    if (level == engine->effect.u.constant.level)
+        return;
+
+    engine->effect.u.constant.level = level;
+
+    int64_t start = now_ns();
+    if (!evff_update(engine->dev->evdev, engine->slot, &engine->effect))
+        xerr("%s: update", engine->dev->file);
+    evstats_add(&engine->update, ((int64_t) now_ns() - start) / 1000);
+
+    engine->updates++;
+}
+
+static void engine_report(engine_t *engine)
+{
+    static const evstats_t none;
+
+    printf("Ticks: %llu, overruns: %llu, updates: %llu\n",
+           (unsigned long long) engine->ticks,
+           (unsigned long long) engine->overruns,
+           (unsigned long long) engine->updates);
+    printf("Tick lateness (us): p50 %llu  p99 %llu  max %llu\n",
+           (unsigned long long) evstats_percentile(&engine->lateness, &none, 50),
+           (unsigned long long) evstats_percentile(&engine->lateness, &none, 99),
+           (unsigned long long) evstats_percentile(&engine->lateness, &none, 100));
+    printf("Update time (us): p50 %llu  p99 %llu  max %llu\n",
+           (unsigned long long) evstats_percentile(&engine->update, &none, 50),
+           (unsigned long long) evstats_percentile(&engine->update, &none, 99),
+           (unsigned long long) evstats_percentile(&engine->update, &none, 100));
+}
+
+static void op_engine(const char *db_file, const char *file, const char *params, const char *axis_name,
+                      unsigned rate)
+{
+    engine_t engine = { .gain = 1.0 };
+    char *err_msg;
+
+    engine_params(&engine, params);
+
+    engine.dev = device_init(file);
+
+    caldb_t *db = caldb_init(db_file, &err_msg);
+    if (!db)
+        xerrx("%s: %s", db_file, err_msg);
+    filter_load(db, engine.dev);
+    caldb_free(db);
+    engine.axis = engine_axis(engine.dev, axis_name);
+    VERBOSE("Engine axis %s at %u Hz\n", engine.axis->name, rate);
+
+    bool constant = false;
+    EFFECT_FOREACH(engine.dev, effect)
+    {
+        if (effect->type == EFFECT_CONSTANT)
+            constant = true;
+
+        // The engine spring replaces the device autocenter spring
+        if (effect->id == FF_AUTOCENTER)
+            device_effect_property(engine.dev, effect, 0);
+    }
+    if (!constant)
+        xerrx("Device does not support constant force effects");
+
+    // One endless constant force is uploaded and then updated in place
+    engine.effect.type = FF_CONSTANT;
+    engine.effect.direction = 0x4000;
+    engine.slot = evff_upload(engine.dev->evdev, &engine.effect);
+    if (engine.slot < 0 || !evff_play(engine.dev->evdev, engine.slot, 1))
+        xerr("%s: constant effect", file);
+
+    device_read_cb(engine.dev, engine_position, NULL, &engine);
+    engine_position(engine.axis, &engine);
+
+    // Page faults and other tasks are the main sources of loop jitter
+    if (mlockall(MCL_CURRENT | MCL_FUTURE) < 0)
+        VERBOSE("Memory not locked: %s\n", strerror(errno));
+
+    struct sched_param sp = { .sched_priority = ENGINE_PRIORITY };
+    if (sched_setscheduler(0, SCHED_FIFO, &sp) < 0)
+        VERBOSE("Realtime priority not set: %s\n", strerror(errno));
+
+    prctl(PR_SET_TIMERSLACK, ENGINE_SLACK_NS);
+
+    int tfd = timerfd_create(CLOCK_MONOTONIC, TFD_CLOEXEC);
+    if (tfd < 0)
+        xerr("timerfd");
+
+    int64_t period = 1000000000LL / rate;
+    int64_t next = now_ns() + period;
+    struct itimerspec its = {
+        .it_interval = { .tv_sec = period / 1000000000, .tv_nsec = period % 1000000000 },
+        .it_value    = { .tv_sec = next / 1000000000, .tv_nsec = next % 1000000000 },
+    };
+    if (timerfd_settime(tfd, TFD_TIMER_ABSTIME, &its, NULL) < 0)
+        xerr("timerfd_settime");
+
+    int epfd = epoll_create1(EPOLL_CLOEXEC);
+    if (epfd < 0)
+        xerr("epoll");
+
+    struct epoll_event ev = { .events = EPOLLIN, .data.ptr = NULL };
+    if (epoll_ctl(epfd, EPOLL_CTL_ADD, tfd, &ev) < 0)
+        xerr("epoll_ctl");
+
+    ev.data.ptr = engine.dev;
+    if (epoll_ctl(epfd, EPOLL_CTL_ADD, device_fileno(engine.dev), &ev) < 0)
+        xerr("epoll_ctl");
+
+    signal(SIGINT, sig_stop);
+    signal(SIGTERM, sig_stop);
+
+    struct epoll_event events[2];
+    while (running)
+    {
+        int nfds = epoll_wait(epfd, events, 2, -1);
+        if (nfds < 0)
+        {
+            if (errno == EINTR)
+                continue;
+            xerr("epoll_wait");
+        }
+
+        // Read the position first so that a tick in the same wakeup uses it
+        for (int i = 0; i < nfds; i++)
+        {
+            if (!events[i].data.ptr)
+                continue;
+
+            if (events[i].events & (EPOLLERR | EPOLLHUP))
+                xerrx("%s: device removed", file);
+
+            device_read(engine.dev);
+        }
+
+        for (int i = 0; i < nfds; i++)
+        {
+            if (events[i].data.ptr)
+                continue;
+
+            uint64_t expired;
+            if (read(tfd, &expired, sizeof(expired)) != sizeof(expired))
+                continue;
+
+            int64_t now = now_ns();
+
+            // Missed ticks are skipped rather than run late in a burst
+            next += expired * period;
+            engine.ticks++;
+            engine.overruns += expired - 1;
+            evstats_add(&engine.lateness, (now - (next - period)) / 1000);
+
+            engine_tick(&engine, now);
+        }
+    }
+
+    close(epfd);
+    close(tfd);
+
+    evff_stop(engine.dev->evdev, engine.slot);
+    evff_erase(engine.dev->evdev, engine.slot);
+
+    engine_report(&engine);
+
+    device_free(engine.dev);
+}
+#endif // ENABLE_EFFECTS
+
+///////////////////////////////////////////////////////////////////////////////
+
+static void op_check(op_t *op, op_t val)
+{
+    if (*op != OP_NONE)
+        xerrx("Only one operation is allowed at a time");
+    *op = val;
+}
+
+static int usage(void)
+{
+    fprintf(stderr,
+        "Usage: evjsd [OPTION]... [DEVICE]...\n"
+        "Run joystick event services for one or more DEVICEs.\n"
+        "\n"
+        "Options:\n"
+        "  -h, --help            Print this help\n"
+        "  -v, --verbose         Display verbose information\n"
+        "  -d, --database FILE   Use the specified database FILE\n"
+        "  -g, --grab            Grab DEVICEs for exclusive access\n"
+        "  -l, --list            List all composite mappings in database\n"
+        "  -D, --delete NAME     Delete composite mapping NAME from database\n"
+        "  -m, --merge NAME      Merge DEVICEs into composite uinput device NAME\n"
+        "  -M, --monitor         Monitor calibrated devices for calibration drift\n"
+        "  -i, --interval SECS   Write drift metrics every SECS seconds (default %d)\n"
+        "  -t, --threshold PCT   Warn when drift exceeds PCT percent (default %d)\n"
+        "  -P, --publish         Publish the state of DEVICEs, or of all joysticks,\n"
+        "                        in shared memory for other processes\n"
+        "  -S, --serve SOCKET    Serve the frames of DEVICEs, or of all joysticks,\n"
+        "                        to other processes on Unix SOCKET\n"
+        "  -q, --queue NUM       Queue up to NUM frames per subscriber (default %d)\n"
+#if ENABLE_EFFECTS
+        "  -E, --engine PARAMS   Run a spring, damper and friction force loop on DEVICE\n"
+        "  -a, --axis AXIS       Use the position of AXIS name or number for the loop\n"
+        "  -r, --rate HZ         Update the loop force HZ times per second (default %d)\n"
+#endif
+        "\n"
+        "  The composite mapping NAME is read from the database. If it does not\n"
+        "  exist then a default mapping is generated from DEVICEs and saved.\n"
+        "  Mappings are listed as: [bus]:[vendor]:[product],[type],[code],[target],...\n"
+        "  Published state is in " EVJS_SHM_DIR "/" EVJS_SHM_PREFIX "eventN and is read with\n"
+        "  the functions in evjs_shm.h.\n"
+        "  Served frames are read with the messages in evjs_sock.h. -P and -S can\n"
+        "  be used together.\n"
+#if ENABLE_EFFECTS
+        "  PARAMS is a comma separated list of spring=PCT, damper=PCT, friction=PCT\n"
+        "  and gain=PCT where a negative gain reverses the force direction.\n"
+#endif
+        "\n"
+        "Examples:\n"
+        "  Merge a stick, throttle and pedals into one device:\n"
+        "    evjsd -g -m hotas /dev/input/event11 /dev/input/event12 /dev/input/event13\n"
+        "  List the composite mappings:\n"
+        "    evjsd -l\n"
+        "  Monitor all calibrated devices for drift:\n"
+        "    evjsd -M -t 3\n"
+        "  Publish the state of every joystick for other processes:\n"
+        "    evjsd -P\n"
+        "  Serve every frame of a stick to other processes on a socket:\n"
+        "    evjsd -S /run/user/1000/evjs.sock -q 256 /dev/input/event11\n"
+#if ENABLE_EFFECTS
+        "  Add a soft centering spring with damping to a wheel:\n"
+        "    evjsd -E spring=40,damper=20,friction=5 -a WHEEL /dev/input/event11\n"
+#endif
+        , MONITOR_INTERVAL, MONITOR_THRESHOLD, FANOUT_QUEUE
+#if ENABLE_EFFECTS
+        , ENGINE_RATE
+#endif
+    );
+
+    return 1;
+}
+
+int main(int argc, char *argv[])
+{
+    op_t op = OP_NONE;
+    static struct option long_options[] = {
+        { "help",       no_argument,       NULL,  'h' },
+        { "verbose",    no_argument,       NULL,  'v' },
+        { "database",   required_argument, NULL,  'd' },
+        { "grab",       no_argument,       NULL,  'g' },
+        { "list",       no_argument,       NULL,  'l' },
+        { "delete",     required_argument, NULL,  'D' },
+        { "merge",      required_argument, NULL,  'm' },
+        { "monitor",    no_argument,       NULL,  'M' },
+        { "interval",   required_argument, NULL,  'i' },
+        { "threshold",  required_argument, NULL,  't' },
+        { "publish",    no_argument,       NULL,  'P' },
+        { "serve",      required_argument, NULL,  'S' },
+        { "queue",      required_argument, NULL,  'q' },
+#if ENABLE_EFFECTS
+        { "engine",     required_argument, NULL,  'E' },
+        { "axis",       required_argument, NULL,  'a' },
+        { "rate",       required_argument, NULL,  'r' },
+#endif
+        { 0,            0,                 NULL,  0   }
+    };
+    char *name = NULL;
+    char *db_file = NULL;
+    bool grab = false;
+    int interval = MONITOR_INTERVAL;
+    int threshold = MONITOR_THRESHOLD;
+#if ENABLE_EFFECTS
+    char *params = NULL;
+    char *axis = NULL;
+    unsigned rate = ENGINE_RATE;
+#endif
+    bool shm = false;
+    char *sock_file = NULL;
+    int queue_len = FANOUT_QUEUE;
+
+    while (1)
+    {
+        int option_index = 0;
+        int c = getopt_long(argc, argv, "hvd:glD:m:Mi:t:PS:q:"
+#if ENABLE_EFFECTS
+                            "E:a:r:"
+#endif
+                            , long_options, &option_index);
+        if (c == -1)
+            break;
+
+        switch (c)
+        {
+            case 'v':
+                verbose = true;
+                break;
+            case 'd':
+                if (!db_file)
+                    db_file = xstrdup(optarg);
+                break;
+            case 'g':
+                grab = true;
+                break;
+            case 'l':
+                op_check(&op, OP_LIST);
+                break;
+            case 'D':
+                op_check(&op, OP_DELETE);
+                name = optarg;
+                break;
+            case 'm':
+                op_check(&op, OP_MERGE);
+                name = optarg;
+                break;
+            case 'M':
+                op_check(&op, OP_MONITOR);
+                break;
+            case 'P':
+                if (op != OP_PUBLISH)
+                    op_check(&op, OP_PUBLISH);
+                shm = true;
+                break;
+            case 'S':
+                if (op != OP_PUBLISH)
+                    op_check(&op, OP_PUBLISH);
+                sock_file = optarg;
+                break;
+            case 'q':
+                queue_len = atoi(optarg);
+                if (queue_len < 1 || queue_len > FANOUT_QUEUE_MAX)
+                    xerrx("Invalid queue length");
+                break;
+            case 'i':
+                interval = atoi(optarg);
+                if (interval < MONITOR_TICK)
+                    xerrx("Interval must be at least %d seconds", MONITOR_TICK);
+                break;
+            case 't':
+                threshold = atoi(optarg);
+                if (threshold <= 0)
+                    xerrx("Invalid threshold");
+                break;
+#if ENABLE_EFFECTS
+            case 'E':
+                op_check(&op, OP_ENGINE);
+                params = optarg;
+                break;
+            case 'a':
+                axis = optarg;
+                break;
+            case 'r':
+                rate = atoi(optarg);
+                if (rate < 1 || rate > 10000)
+                    xerrx("Invalid rate");
+                break;
+#endif
+            default:
+            case 'h':
+                return usage();
+        }
+    }
+
+    if ((op == OP_MERGE || op == OP_ENGINE) && optind == argc)
+    {
+        warnx("Missing input DEVICE");
+        usage();
+        return 1;
+    }
+    else if ((op != OP_MERGE && op != OP_PUBLISH && op != OP_ENGINE && optind != argc) ||
+             (op == OP_ENGINE && optind != argc - 1))
+    {
+        warnx("Extra parameters on command line");
+        usage();
+        return 1;
+    }
+
+    if (!db_file)
+    {
+        db_file = config_path(CALDB_DEFAULT_NAME);
+        VERBOSE("Database file: %s\n", db_file);
+    }
+
+    switch (op)
+    {
+        case OP_LIST:
+            op_list(db_file);
+            break;
+        case OP_DELETE:
+            op_delete(db_file, name);
+            break;
+        case OP_MERGE:
+            op_merge(db_file, name, &argv[optind], argc - optind, grab);
+            break;
+        case OP_MONITOR:
+            op_monitor(db_file, interval, threshold);
+            break;
+        case OP_PUBLISH:
+            op_publish(db_file, &argv[optind], argc - optind, shm, sock_file, queue_len);
+            break;
+#if ENABLE_EFFECTS
+        case OP_ENGINE:
+            op_engine(db_file, argv[optind], params, axis, rate);
+            break;
+#endif
+        default:
+            xerrx("No operation specified");
+            break;
+    }
+
+    xfree(db_file);
+
+    return 0;
+}
@@ -20,17 +20,24 @@
 #include <unistd.h>
 #include <string.h>
 #include <poll.h>
+#include <time.h>
 #include <getopt.h>
 #include <errno.h>
 #include <err.h>
 #include <limits.h>
+#include <signal.h>
 
+#include <sys/timerfd.h>
 #include <linux/input.h>
 
 #include "util.h"
 #include "device.h"
 #include "view.h"
 #include "caldb.h"
+#include "stream.h"
+#include "sequence.h"
+
+#define FRAME_RATE_DEFAULT  60
 
 #if ENABLE_EFFECTS
 static void handle_effect(device_t *dev, view_t *view)
@@ -126,6 +133,25 @@ static bool write_axis(caldb_record_t *rec, void **arg)
     return true;
 }
 
+static bool write_filter(caldb_filter_record_t *rec, void **arg)
+{
+    device_t *dev = arg[0];
+    axis_t **axis_ptr = arg[1];
+    axis_t *axis = *axis_ptr;
+
+    if (axis >= &dev->axis_array[dev->axis_num])
+        return false;
+
+    rec->axis   = axis->id;
+    rec->type   = axis->filter.type;
+    rec->param1 = axis->filter.param1;
+    rec->param2 = axis->filter.param2;
+
+    *axis_ptr = ++axis;
+
+    return true;
+}
+
 static void write_device(caldb_t *db, device_t *dev, view_t *view)
 {
     char *err_msg;
@@ -143,6 +169,14 @@ static void write_device(caldb_t *db, device_t *dev, view_t *view)
         return;
     }
 
+    axis = dev->axis_array;
+    if (!caldb_filter_write(db, &caldb_dev, (caldb_filter_writer_t)write_filter, &args, &err_msg))
+    {
+        view_error(view, err_msg);
+        caldb_err_free(err_msg);
+        return;
+    }
+
     dev->dirty = false;
 }
 
@@ -150,9 +184,24 @@ static bool read_axis(const evdev_id_t *unused, const caldb_record_t *rec, void
 {
     device_t *dev = arg;
 
+    // Applied like an edit so the normalized values follow the new range
     axis_t *axis = device_axis_get(dev, rec->axis);
     if (axis)
-        axis->cal  = rec->cal;
+    {
+        axis->cal = rec->cal;
+        device_axis_calibrate(dev, axis);
+    }
+
+    return true;
+}
+
+static bool read_filter(const caldb_filter_record_t *rec, void *arg)
+{
+    device_t *dev = arg;
+
+    axis_t *axis = device_axis_get(dev, rec->axis);
+    if (axis)
+        device_axis_filter(dev, axis, rec->type, rec->param1, rec->param2);
 
     return true;
 }
@@ -168,6 +217,13 @@ static void read_device(caldb_t *db, device_t *dev, view_t *view)
         return;
     }
 
+    if (!caldb_filter_read(db, &dev->id, read_filter, dev, &err_msg))
+    {
+        view_error(view, err_msg);
+        caldb_err_free(err_msg);
+        return;
+    }
+
     dev->dirty = false;
 }
 
@@ -183,20 +239,58 @@ static void button_change(button_t *button, void *arg)
     view_button_value(view, button, button->value);
 }
 
-static void event_loop(caldb_t *db, device_t *dev, view_t *view)
+static void frame_timer(int fd, unsigned rate)
 {
-    struct pollfd fds[2] =
+    // A zero rate disarms the timer
+    long period = rate ? 1000000000L / rate : 0;
+    struct timespec ts = { .tv_sec = period / 1000000000L, .tv_nsec = period % 1000000000L };
+    struct itimerspec its = { .it_interval = ts, .it_value = ts };
+
+    if (timerfd_settime(fd, 0, &its, NULL) < 0)
+        xerr("timerfd_settime");
+}
+
+static void event_loop(caldb_t *db, device_t *dev_array[], size_t dev_num, view_t *view, unsigned rate)
+{
+    int tfd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+    if (tfd < 0)
+        xerr("timerfd");
+
+    int sfd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+    if (sfd < 0)
+        xerr("timerfd");
+
+    // Key input and the timers come first followed by one entry per device
+    size_t fds_num = dev_num + 3;
+    struct pollfd *fds = xalloc(sizeof(struct pollfd) * fds_num);
+
+    fds[0].fd = STDIN_FILENO;
+    fds[0].events = POLLIN;
+    fds[1].fd = tfd;
+    fds[1].events = POLLIN;
+    fds[2].fd = sfd;
+    fds[2].events = POLLIN;
+
+    for (size_t i = 0; i < dev_num; i++)
     {
-        { .fd = STDIN_FILENO,       .events = POLLIN },
-        { .fd = device_fileno(dev), .events = POLLIN | POLLPRI },
-    };
+        fds[i + 3].fd = device_fileno(dev_array[i]);
+        fds[i + 3].events = POLLIN | POLLPRI;
+
+        device_read_cb(dev_array[i], axis_change, button_change, view);
+    }
 
-    device_read_cb(dev, axis_change, button_change, view);
+    // The stats panel is refreshed once per second
+    frame_timer(sfd, 1);
+    view_stats_refresh(view);
 
+    // Device events only mark the view dirty and the frame timer draws
+    // them, so the terminal is updated at most once per frame no matter
+    // how many devices are streaming
+    bool timer = false;
     bool running = true;
     while (running)
     {
-        if (poll(fds, 2, -1) < 0 && errno != EINTR)
+        if (poll(fds, fds_num, -1) < 0 && errno != EINTR)
             xerr("poll");
 
         view_resize(view);
@@ -204,17 +298,33 @@ static void event_loop(caldb_t *db, device_t *dev, view_t *view)
         if (fds[0].revents & POLLIN)
         {
             int key = view_key(view);
+            device_t *dev = view_device_get(view);
             axis_t *axis = view_axis_get(view);
 
             if (key == 'q')
             {
-                if (dev->dirty)
+                bool dirty = false;
+                for (size_t i = 0; i < dev_num; i++)
+                    dirty |= dev_array[i]->dirty;
+
+                if (dirty && view_confirm(view, "Save changed calibrations? [Y/N]> "))
                 {
-                    if (view_confirm(view, "Save changed calibrations? [Y/N]> "))
-                        write_device(db, dev, view);
+                    for (size_t i = 0; i < dev_num; i++)
+                    {
+                        if (dev_array[i]->dirty)
+                            write_device(db, dev_array[i], view);
+                    }
                 }
                 running = false;
             }
+            else if (key == '\t')
+            {
+                view_device_next(view);
+            }
+            else if (key == KEY_BTAB)
+            {
+                view_device_prev(view);
+            }
             else if (key == '\n' || key == '\r' || key == KEY_ENTER)
             {
                 bool cursors = view_axis_cursors_get(view);
@@ -237,13 +347,7 @@ static void event_loop(caldb_t *db, device_t *dev, view_t *view)
             {
                 bool cursors = view_axis_cursors_get(view);
                 if (!cursors)
-                {
-                    AXIS_FOREACH(dev, axis)
-                    {
-                        axis->maximum = axis->value;
-                        axis->minimum = axis->value;
-                    }
-                }
+                    device_axis_track_reset(dev);
                 view_axis_cursors_set(view, !cursors);
             }
             else if (key == 'f')
@@ -270,6 +374,26 @@ static void event_loop(caldb_t *db, device_t *dev, view_t *view)
                     view_axis_calibration(view, axis);
                 }
             }
+            else if (key == 'i')
+            {
+                filter_type_t type = (axis->filter.type + 1) % FILTER_CNT;
+                device_axis_filter(dev, axis, type, 0, 0);
+                dev->dirty = true;
+                view_info_refresh(view);
+                view_axis_calibration(view, axis);
+            }
+            else if (key == 's')
+            {
+                view_scope_set(view, !view_scope_get(view));
+            }
+            else if (key == '+' || key == '=')
+            {
+                view_scope_zoom(view, 1);
+            }
+            else if (key == '-')
+            {
+                view_scope_zoom(view, -1);
+            }
             else if (key == KEY_UP || key == 'k')
             {
                 view_axis_prev(view);
@@ -316,33 +440,165 @@ static void event_loop(caldb_t *db, device_t *dev, view_t *view)
                 view_help(view);
             }
 
+            view_frame(view);
+
             fds[0].revents = 0;
         }
 
-        if (fds[1].revents & (POLLIN | POLLPRI))
+        for (size_t i = 0; i < dev_num; i++)
         {
-            device_read(dev);
+            if (fds[i + 3].revents & (POLLIN | POLLPRI))
+            {
+                device_read(dev_array[i]);
+                fds[i + 3].revents = 0;
+            }
+        }
+
+        if (!timer && view_dirty(view))
+        {
+            frame_timer(tfd, rate);
+            timer = true;
+        }
+
+        if (fds[1].revents & POLLIN)
+        {
+            uint64_t expired;
+            if (read(tfd, &expired, sizeof(expired)) == sizeof(expired))
+            {
+                // Stop the timer when idle so the loop sleeps until input
+                if (!view_frame(view))
+                {
+                    frame_timer(tfd, 0);
+                    timer = false;
+                }
+            }
 
             fds[1].revents = 0;
         }
+
+        if (fds[2].revents & POLLIN)
+        {
+            uint64_t expired;
+            if (read(sfd, &expired, sizeof(expired)) == sizeof(expired))
+                view_stats_refresh(view);
+
+            fds[2].revents = 0;
+        }
     }
+
+    xfree(fds);
+    close(sfd);
+    close(tfd);
+}
+
+static volatile sig_atomic_t stopped;
+
+static void stop(int sig)
+{
+    stopped = 1;
+}
+
+static void headless_loop(device_t *dev_array[], size_t dev_num, stream_format_t format, unsigned rate)
+{
+    struct pollfd *fds = xalloc(sizeof(struct pollfd) * dev_num);
+    for (size_t i = 0; i < dev_num; i++)
+    {
+        fds[i].fd = device_fileno(dev_array[i]);
+        fds[i].events = POLLIN | POLLPRI;
+    }
+
+    // Stop cleanly on a signal so the pending records are written out
+    signal(SIGINT, stop);
+    signal(SIGTERM, stop);
+
+    stream_t *stream = stream_init(dev_array, dev_num, format, rate, STDOUT_FILENO);
+
+    while (!stopped)
+    {
+        if (poll(fds, dev_num, stream_timeout(stream)) < 0 && errno != EINTR)
+            xerr("poll");
+
+        for (size_t i = 0; i < dev_num; i++)
+        {
+            if (fds[i].revents & (POLLIN | POLLPRI))
+            {
+                device_read(dev_array[i]);
+                fds[i].revents = 0;
+            }
+        }
+
+        stream_poll(stream);
+    }
+
+    stream_free(stream);
+    xfree(fds);
+}
+
+#if ENABLE_EFFECTS
+static bool sequence_loop(device_t *dev, const char *seq_file)
+{
+    sequence_t *seq = sequence_load(seq_file, dev);
+
+    // Stop cleanly on a signal so that the effects are stopped and reported.
+    // Without SA_RESTART the signal interrupts the wait for the next step.
+    struct sigaction sa = { .sa_handler = stop };
+    sigaction(SIGINT, &sa, NULL);
+    sigaction(SIGTERM, &sa, NULL);
+
+    bool ok = sequence_run(seq, &stopped);
+    sequence_report(seq);
+
+    sequence_free(seq);
+
+    return ok;
+}
+#endif
+
+static void scan_add(const char *file, const evdev_id_t *id, const char *name, void *arg)
+{
+    char ***file_array = arg;
+    size_t num = 0;
+
+    while ((*file_array)[num])
+        num++;
+
+    *file_array = xrealloc(*file_array, sizeof(char *) * (num + 2));
+    (*file_array)[num] = xstrdup(file);
+    (*file_array)[num + 1] = NULL;
 }
 
 static int usage(void)
 {
     fprintf(stderr,
-        "Usage: evjstest [OPTIONS] [DEVICE]\n"
-        "Calibrate the absolute axes for a joystick event DEVICE.\n"
-        "A selection list is presented if no DEVICE is given.\n"
+        "Usage: evjstest [OPTIONS] [DEVICE...]\n"
+        "Calibrate the absolute axes for joystick event DEVICEs.\n"
+        "A selection list is presented if no DEVICE is given.  Several DEVICEs\n"
+        "are shown side by side in a dashboard.\n"
         "\n"
         "Options:\n"
         "  -h, --help            Print this help\n"
+        "  -a, --all             Show all joystick devices in a dashboard\n"
         "  -d, --database FILE   Use the specified database FILE\n"
+        "  -f, --fps RATE        Redraw at most RATE frames per second (default %d)\n"
+        "  -H, --headless FORMAT Stream frames to stdout as json or csv without the UI\n"
+        "  -r, --rate RATE       Stream at most RATE frames per second per device\n"
+#if ENABLE_EFFECTS
+        "  -s, --sequence FILE   Play the force feedback timeline in FILE on DEVICE\n"
+        "                        and report the start jitter of each step\n"
+#endif
         "\n"
         "Examples:\n"
         "  evjstest\n"
         "  evjstest /dev/input/event11\n"
-        "  evjstest -d ~/evutils.db /dev/input/event4\n"
+        "  evjstest /dev/input/event11 /dev/input/event12\n"
+        "  evjstest --all\n"
+        "  evjstest --headless json /dev/input/event11 | jq .abs\n"
+        "  evjstest --headless csv --rate 100 --all > rig.csv\n"
+#if ENABLE_EFFECTS
+        "  evjstest --sequence pattern.seq /dev/input/event11\n"
+#endif
+        "  evjstest -d ~/evutils.db /dev/input/event4\n",
+        FRAME_RATE_DEFAULT
     );
 
     return 1;
@@ -350,71 +606,151 @@ static int usage(void)
 
 int main(int argc, char *argv[])
 {
-    char *dev_file = NULL;
+    char **file_array = xalloc(sizeof(char *));
     char *db_file = NULL;
+    unsigned rate = FRAME_RATE_DEFAULT;
+    bool all = false;
+    bool headless = false;
+    stream_format_t format = STREAM_JSON;
+    unsigned stream_rate = 0;
+    char *seq_file = NULL;
 
     static struct option long_options[] = {
         { "help",       no_argument,       NULL, 'h' },
+        { "all",        no_argument,       NULL, 'a' },
         { "database",   required_argument, NULL, 'd' },
+        { "fps",        required_argument, NULL, 'f' },
+        { "headless",   required_argument, NULL, 'H' },
+        { "rate",       required_argument, NULL, 'r' },
+#if ENABLE_EFFECTS
+        { "sequence",   required_argument, NULL, 's' },
+#endif
         { 0,            0,                 NULL,  0  }
     };
 
     while (1)
     {
         int option_index = 0;
-        int c = getopt_long(argc, argv, "hd:", long_options, &option_index);
+        int c = getopt_long(argc, argv, "had:f:H:r:s:", long_options, &option_index);
         if (c == -1)
             break;
 
         switch (c)
         {
+            case 'a':
+                all = true;
+                break;
             case 'd':
                 if (!db_file)
                     db_file = xstrdup(optarg);
                 break;
+            case 'f':
+                rate = atoi(optarg);
+                if (rate < 1 || rate > 1000)
+                    xerrx("Invalid frame rate");
+                break;
+            case 'H':
+                if (!stream_format(optarg, &format))
+                    xerrx("Invalid stream format: %s", optarg);
+                headless = true;
+                break;
+            case 'r':
+                stream_rate = atoi(optarg);
+                if (stream_rate < 1 || stream_rate > 100000)
+                    xerrx("Invalid stream rate");
+                break;
+#if ENABLE_EFFECTS
+            case 's':
+                if (!seq_file)
+                    seq_file = xstrdup(optarg);
+                break;
+#endif
             case 'h':
             default:
                 return usage();
         }
     }
 
-    if (optind == argc - 1)
+    if (all)
     {
-        dev_file = xstrdup(argv[optind]);
+        if (optind != argc)
+        {
+            warnx("Extra parameters on command line");
+            return usage();
+        }
+
+        if (device_scan(scan_add, &file_array) == 0)
+            xerrx("No available devices");
     }
-    else if (optind != argc)
+    else if (optind < argc)
     {
-        warnx("Extra parameters on command line");
-        return usage();
+        for (int i = optind; i < argc; i++)
+            scan_add(argv[i], NULL, NULL, &file_array);
     }
     else
     {
-        dev_file = device_select();
+        char *dev_file = device_select();
         if (!dev_file)
             return 0;
+
+        scan_add(dev_file, NULL, NULL, &file_array);
+        xfree(dev_file);
     }
 
-    if (!db_file)
-        db_file = config_path(CALDB_DEFAULT_NAME);
+    size_t dev_num = 0;
+    while (file_array[dev_num])
+        dev_num++;
 
-    char *err_msg = NULL;
-    caldb_t *db = caldb_init(db_file, &err_msg);
-    if (!db)
-        xerrx("%s: %s", db_file, err_msg);
+    if (seq_file && dev_num != 1)
+        xerrx("A sequence is played on a single device");
 
-    device_t *dev = device_init(dev_file);
-    view_t *view = view_init(dev, db_file);
+    device_t **dev_array = xalloc(sizeof(device_t *) * dev_num);
+    for (size_t i = 0; i < dev_num; i++)
+        dev_array[i] = device_init(file_array[i]);
 
-    xon_exit((exit_callback_t) view_free, view);
+    int status = 0;
 
-    event_loop(db, dev, view);
+    if (seq_file)
+    {
+#if ENABLE_EFFECTS
+        if (!sequence_loop(dev_array[0], seq_file))
+            status = 1;
+#endif
+    }
+    else if (headless)
+    {
+        headless_loop(dev_array, dev_num, format, stream_rate);
+    }
+    else
+    {
+        if (!db_file)
+            db_file = config_path(CALDB_DEFAULT_NAME);
 
-    view_free(view);
-    device_free(dev);
-    caldb_free(db);
+        char *err_msg = NULL;
+        caldb_t *db = caldb_init(db_file, &err_msg);
+        if (!db)
+            xerrx("%s: %s", db_file, err_msg);
 
-    xfree(dev_file);
-        xfree(db_file);
+        view_t *view = view_init(dev_array, dev_num, db_file);
 
-    return 0;
-}
\ No newline at end of file
+        xon_exit((exit_callback_t) view_free, view);
+
+        event_loop(db, dev_array, dev_num, view, rate);
+
+        view_free(view);
+        caldb_free(db);
+    }
+
+    for (size_t i = 0; i < dev_num; i++)
+    {
+        device_free(dev_array[i]);
+        xfree(file_array[i]);
+    }
+    xfree(dev_array);
+    xfree(file_array);
+
+    xfree(db_file);
+    xfree(seq_file);
+
+    return status;
+}
@@ -0,0 +1,467 @@
+//  evjs - Evdev Joystick Utilities
+//  Copyright (C) 2020 Scott Shumate <scott@shumatech.com>
+//
+//  This program is free software: you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation, either version 3 of the License, or
+//  (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+#define _GNU_SOURCE
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/stat.h>
+#include <sys/epoll.h>
+
+#include "fanout.h"
+#include "evjs_sock.h"
+#include "util.h"
+#include "trace.h"
+
+_Static_assert(EVJS_SOCK_AXES >= ABS_CNT, "evjs_sock_frame_t axes");
+_Static_assert(EVJS_SOCK_BUTTONS >= KEY_CNT, "evjs_sock_frame_t buttons");
+
+#define FANOUT_BACKLOG      16
+#define FANOUT_EVENTS       16
+
+typedef struct subscriber
+{
+    int                 fd;
+    evjs_sock_policy_t  policy;
+    evjs_sock_frame_t   *queue;
+    size_t              head;
+    size_t              count;
+    uint32_t            dropped;
+    bool                blocked;
+    struct subscriber   *next;
+} subscriber_t;
+
+typedef struct fanout_device
+{
+    device_t    *dev;
+    uint64_t    frame;
+    int32_t     axis[EVJS_SOCK_AXES];
+    bool        removed;
+} fanout_device_t;
+
+struct fanout
+{
+    char                *path;
+    int                 listen_fd;
+    int                 epfd;
+    size_t              queue_len;
+
+    subscriber_t        *subscriber_list;
+    size_t              subscriber_num;
+
+    fanout_device_t     *device_array;
+    size_t              device_num;
+
+    // Scratch for building a frame and for one batch of sends
+    evjs_sock_frame_t   frame;
+    struct mmsghdr      *msg_array;
+    struct iovec        *iov_array;
+};
+
+///////////////////////////////////////////////////////////////////////////////
+//
+// Subscriber Functions
+//
+///////////////////////////////////////////////////////////////////////////////
+
+static void subscriber_remove(fanout_t *fanout, subscriber_t *sub)
+{
+    subscriber_t **subpp = &fanout->subscriber_list;
+    while (*subpp != sub)
+        subpp = &(*subpp)->next;
+    *subpp = sub->next;
+
+    close(sub->fd);
+    xfree(sub->queue);
+    xfree(sub);
+    fanout->subscriber_num--;
+}
+
+static void subscriber_device(fanout_t *fanout, unsigned device, evjs_sock_device_t *msg)
+{
+    device_t *dev = fanout->device_array[device].dev;
+
+    *msg = (evjs_sock_device_t) {
+        .type       = EVJS_SOCK_DEVICE,
+        .version    = EVJS_SOCK_VERSION,
+        .device     = device,
+        .bus        = dev->id.bus,
+        .vendor     = dev->id.vendor,
+        .product    = dev->id.product,
+        .axis_num   = dev->axis_num,
+        .button_num = dev->button_num,
+    };
+    snprintf(msg->name, sizeof(msg->name), "%s", dev->name);
+
+    AXIS_FOREACH(dev, axis)
+        msg->axis_id[axis->index] = axis->id;
+    BUTTON_FOREACH(dev, button)
+        msg->button_id[button->index] = button->id;
+}
+
+// A new subscriber is sent the device descriptions straight away.  They
+// fit in the empty socket buffer, a subscriber that cannot take them is
+// not worth queueing for.
+static void subscriber_add(fanout_t *fanout, int fd)
+{
+    evjs_sock_device_t msg;
+
+    for (unsigned device = 0; device < fanout->device_num; device++)
+    {
+        if (fanout->device_array[device].removed)
+            continue;
+
+        subscriber_device(fanout, device, &msg);
+        if (send(fd, &msg, sizeof(msg), MSG_DONTWAIT | MSG_NOSIGNAL) != sizeof(msg))
+        {
+            close(fd);
+            return;
+        }
+    }
+
+    subscriber_t *sub = xalloc(sizeof(subscriber_t));
+    sub->fd = fd;
+    sub->policy = EVJS_SOCK_DROP_OLDEST;
+    sub->queue = xalloc(sizeof(evjs_sock_frame_t) * fanout->queue_len);
+
+    struct epoll_event ev = { .events = EPOLLIN, .data.ptr = sub };
+    if (epoll_ctl(fanout->epfd, EPOLL_CTL_ADD, fd, &ev) < 0)
+        xerr("epoll_ctl");
+
+    sub->next = fanout->subscriber_list;
+    fanout->subscriber_list = sub;
+    fanout->subscriber_num++;
+}
+
+static void subscriber_blocked(fanout_t *fanout, subscriber_t *sub, bool blocked)
+{
+    if (sub->blocked == blocked)
+        return;
+
+    struct epoll_event ev = { .events = EPOLLIN | (blocked ? EPOLLOUT : 0), .data.ptr = sub };
+    if (epoll_ctl(fanout->epfd, EPOLL_CTL_MOD, sub->fd, &ev) < 0)
+        xerr("epoll_ctl");
+
+    sub->blocked = blocked;
+}
+
+// Send as much of the queue as the socket takes in one system call, false
+// if the subscriber is gone
+static bool subscriber_send(fanout_t *fanout, subscriber_t *sub)
+{
+    if (sub->count == 0)
+        return true;
+
+    // Frames dropped while queued precede whatever is now the oldest
+    sub->queue[sub->head].dropped += sub->dropped;
+    sub->dropped = 0;
+
+    for (size_t i = 0; i < sub->count; i++)
+    {
+        struct iovec *iov = &fanout->iov_array[i];
+        iov->iov_base = &sub->queue[(sub->head + i) % fanout->queue_len];
+        iov->iov_len = sizeof(evjs_sock_frame_t);
+
+        fanout->msg_array[i] = (struct mmsghdr) {
+            .msg_hdr = { .msg_iov = iov, .msg_iovlen = 1 },
+        };
+    }
+
+    TRACE_BEGIN_ARG("sendmmsg", sub->count);
+    int sent = sendmmsg(sub->fd, fanout->msg_array, sub->count, MSG_DONTWAIT | MSG_NOSIGNAL);
+    TRACE_END("sendmmsg");
+    if (sent < 0)
+    {
+        if (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR)
+            return false;
+        sent = 0;
+    }
+
+    sub->head = (sub->head + sent) % fanout->queue_len;
+    sub->count -= sent;
+
+    // Wait for room instead of retrying on every frame
+    subscriber_blocked(fanout, sub, sub->count > 0);
+
+    return true;
+}
+
+static void subscriber_receive(fanout_t *fanout, subscriber_t *sub)
+{
+    evjs_sock_msg_t msg;
+
+    while (1)
+    {
+        ssize_t len = recv(sub->fd, &msg, sizeof(msg), MSG_DONTWAIT);
+        if (len == 0 || (len < 0 && errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR))
+        {
+            subscriber_remove(fanout, sub);
+            return;
+        }
+        if (len < 0)
+            return;
+
+        if (len >= sizeof(msg.subscribe) && msg.type == EVJS_SOCK_SUBSCRIBE &&
+            (msg.subscribe.policy == EVJS_SOCK_DROP_OLDEST || msg.subscribe.policy == EVJS_SOCK_COALESCE))
+            sub->policy = msg.subscribe.policy;
+    }
+}
+
+///////////////////////////////////////////////////////////////////////////////
+//
+// Queue Functions
+//
+///////////////////////////////////////////////////////////////////////////////
+
+static void queue_drop_oldest(fanout_t *fanout, subscriber_t *sub)
+{
+    sub->dropped += sub->queue[sub->head].dropped + 1;
+    sub->head = (sub->head + 1) % fanout->queue_len;
+    sub->count--;
+}
+
+// Merge into the newest queued frame of the same device, false if there is
+// none to merge into
+static bool queue_coalesce(fanout_t *fanout, subscriber_t *sub, const evjs_sock_frame_t *frame)
+{
+    for (size_t i = sub->count; i > 0; i--)
+    {
+        evjs_sock_frame_t *queued = &sub->queue[(sub->head + i - 1) % fanout->queue_len];
+        if (queued->device != frame->device)
+            continue;
+
+        uint64_t changed = queued->changed | frame->changed;
+        uint32_t dropped = queued->dropped;
+
+        *queued = *frame;
+        queued->changed = changed;
+        queued->dropped = dropped;
+        queued->flags |= EVJS_SOCK_COALESCED;
+
+        return true;
+    }
+
+    return false;
+}
+
+static void queue_push(fanout_t *fanout, const evjs_sock_frame_t *frame)
+{
+    for (subscriber_t *sub = fanout->subscriber_list; sub != NULL; sub = sub->next)
+    {
+        if (sub->count == fanout->queue_len)
+        {
+            // A removal must not be merged away
+            if (sub->policy == EVJS_SOCK_COALESCE && !(frame->flags & EVJS_SOCK_REMOVED) &&
+                queue_coalesce(fanout, sub, frame))
+                continue;
+
+            queue_drop_oldest(fanout, sub);
+        }
+
+        sub->queue[(sub->head + sub->count) % fanout->queue_len] = *frame;
+        sub->count++;
+    }
+}
+
+///////////////////////////////////////////////////////////////////////////////
+//
+// Fanout Functions
+//
+///////////////////////////////////////////////////////////////////////////////
+
+fanout_t *fanout_init(const char *path, size_t queue_len)
+{
+    ASSERT(queue_len > 0);
+
+    struct sockaddr_un addr = { .sun_family = AF_UNIX };
+    if (strlen(path) >= sizeof(addr.sun_path))
+        xerrx("%s: socket path is too long", path);
+    strcpy(addr.sun_path, path);
+
+    fanout_t *fanout = xalloc(sizeof(fanout_t));
+    fanout->path = xstrdup(path);
+    fanout->queue_len = queue_len;
+    fanout->msg_array = xalloc(sizeof(struct mmsghdr) * queue_len);
+    fanout->iov_array = xalloc(sizeof(struct iovec) * queue_len);
+
+    fanout->listen_fd = socket(AF_UNIX, SOCK_SEQPACKET | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (fanout->listen_fd < 0)
+        xerr("socket");
+
+    // A socket left behind by an earlier run would fail the bind, but
+    // anything else at the path is not ours to remove
+    struct stat st;
+    if (lstat(path, &st) == 0)
+    {
+        if (!S_ISSOCK(st.st_mode))
+            xerrx("%s: exists and is not a socket", path);
+        unlink(path);
+    }
+    if (bind(fanout->listen_fd, (struct sockaddr *) &addr, sizeof(addr)) < 0)
+        xerr("%s", path);
+    if (listen(fanout->listen_fd, FANOUT_BACKLOG) < 0)
+        xerr("listen");
+
+    fanout->epfd = epoll_create1(EPOLL_CLOEXEC);
+    if (fanout->epfd < 0)
+        xerr("epoll");
+
+    struct epoll_event ev = { .events = EPOLLIN, .data.ptr = NULL };
+    if (epoll_ctl(fanout->epfd, EPOLL_CTL_ADD, fanout->listen_fd, &ev) < 0)
+        xerr("epoll_ctl");
+
+    return fanout;
+}
+
+void fanout_free(fanout_t *fanout)
+{
+    while (fanout->subscriber_list)
+        subscriber_remove(fanout, fanout->subscriber_list);
+
+    close(fanout->epfd);
+    close(fanout->listen_fd);
+    unlink(fanout->path);
+
+    xfree(fanout->device_array);
+    xfree(fanout->msg_array);
+    xfree(fanout->iov_array);
+    xfree(fanout->path);
+    xfree(fanout);
+}
+
+int fanout_fileno(fanout_t *fanout)
+{
+    return fanout->epfd;
+}
+
+size_t fanout_subscribers(fanout_t *fanout)
+{
+    return fanout->subscriber_num;
+}
+
+// Devices are numbered in the order they are added and the numbers are not
+// reused, so a subscriber can keep its device table
+unsigned fanout_device_add(fanout_t *fanout, device_t *dev)
+{
+    ASSERT(fanout->subscriber_num == 0);
+
+    fanout->device_array = xrealloc(fanout->device_array,
+                                    sizeof(fanout_device_t) * (fanout->device_num + 1));
+
+    fanout_device_t *fdev = &fanout->device_array[fanout->device_num];
+    *fdev = (fanout_device_t) { .dev = dev };
+    device_normalize(dev, fdev->axis);
+
+    return fanout->device_num++;
+}
+
+void fanout_device_remove(fanout_t *fanout, unsigned device)
+{
+    fanout_device_t *fdev = &fanout->device_array[device];
+
+    evjs_sock_frame_t *frame = &fanout->frame;
+    memset(frame, 0, sizeof(*frame));
+    frame->type   = EVJS_SOCK_FRAME;
+    frame->device = device;
+    frame->flags  = EVJS_SOCK_REMOVED;
+    frame->frame  = ++fdev->frame;
+
+    queue_push(fanout, frame);
+
+    fdev->removed = true;
+    fdev->dev = NULL;
+}
+
+// Queue the frame a device just completed for every subscriber
+void fanout_frame(fanout_t *fanout, unsigned device, evtime_t time)
+{
+    TRACE_SCOPE("fanout_frame");
+
+    fanout_device_t *fdev = &fanout->device_array[device];
+    device_t *dev = fdev->dev;
+
+    evjs_sock_frame_t *frame = &fanout->frame;
+    memset(frame, 0, sizeof(*frame));
+    frame->type   = EVJS_SOCK_FRAME;
+    frame->device = device;
+    frame->frame  = ++fdev->frame;
+    frame->time   = time;
+
+    device_normalize(dev, frame->axis);
+    for (size_t i = 0; i < dev->axis_num; i++)
+    {
+        if (frame->axis[i] != fdev->axis[i])
+            frame->changed |= 1ULL << i;
+    }
+    memcpy(fdev->axis, frame->axis, sizeof(int32_t) * dev->axis_num);
+
+    BUTTON_FOREACH(dev, button)
+    {
+        if (button->value)
+            frame->button[button->index / 64] |= 1ULL << (button->index % 64);
+    }
+
+    queue_push(fanout, frame);
+}
+
+// Send the queued frames of every subscriber that is not waiting for room
+void fanout_flush(fanout_t *fanout)
+{
+    subscriber_t *next;
+    for (subscriber_t *sub = fanout->subscriber_list; sub != NULL; sub = next)
+    {
+        next = sub->next;
+        if (!sub->blocked && !subscriber_send(fanout, sub))
+            subscriber_remove(fanout, sub);
+    }
+}
+
+void fanout_poll(fanout_t *fanout)
+{
+    struct epoll_event events[FANOUT_EVENTS];
+
+    int nfds = epoll_wait(fanout->epfd, events, FANOUT_EVENTS, 0);
+    for (int i = 0; i < nfds; i++)
+    {
+        subscriber_t *sub = events[i].data.ptr;
+
+        if (!sub)
+        {
+            int fd;
+            while ((fd = accept4(fanout->listen_fd, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC)) >= 0)
+                subscriber_add(fanout, fd);
+        }
+        else if (events[i].events & (EPOLLERR | EPOLLHUP))
+        {
+            subscriber_remove(fanout, sub);
+        }
+        else
+        {
+            if ((events[i].events & EPOLLOUT) && !subscriber_send(fanout, sub))
+            {
+                subscriber_remove(fanout, sub);
+                continue;
+            }
+            if (events[i].events & EPOLLIN)
+                subscriber_receive(fanout, sub);
+        }
+    }
+}
@@ -0,0 +1,38 @@
+//  evjs - Evdev Joystick Utilities
+//  Copyright (C) 2020 Scott Shumate <scott@shumatech.com>
+//
+//  This program is free software: you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation, either version 3 of the License, or
+//  (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+#pragma once
+
+#include <stdlib.h>
+#include <stdbool.h>
+
+#include "device.h"
+
+typedef struct fanout fanout_t;
+
+// Serves the frames of devices to any number of subscribers on a Unix
+// socket, see evjs_sock.h for the messages and the subscriber side.  The
+// server is single threaded: frames are queued as they complete and sent
+// in batches by fanout_flush(), and fanout_poll() handles the subscribers
+// when fanout_fileno() is readable.
+fanout_t *fanout_init(const char *path, size_t queue_len);
+void fanout_free(fanout_t *fanout);
+int fanout_fileno(fanout_t *fanout);
+unsigned fanout_device_add(fanout_t *fanout, device_t *dev);
+void fanout_device_remove(fanout_t *fanout, unsigned device);
+void fanout_frame(fanout_t *fanout, unsigned device, evtime_t time);
+void fanout_flush(fanout_t *fanout);
+void fanout_poll(fanout_t *fanout);
+size_t fanout_subscribers(fanout_t *fanout);
@@ -0,0 +1,216 @@
+//  evjs - Evdev Joystick Utilities
+//  Copyright (C) 2020 Scott Shumate <scott@shumatech.com>
+//
+//  This program is free software: you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation, either version 3 of the License, or
+//  (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+#include <stdlib.h>
+#include <string.h>
+
+#include "util.h"
+#include "filter.h"
+
+#define EMA_ALPHA_DEFAULT       64
+#define EMA_SHIFT               8
+
+#define MEDIAN_WINDOW_DEFAULT   5
+
+#define EURO_CUTOFF_DEFAULT     1000
+#define EURO_BETA_DEFAULT       10
+#define EURO_DCUTOFF            1000
+#define EURO_SHIFT              16
+#define EURO_SPEED_SHIFT        8
+#define EURO_DT_MAX             1000000
+#define EURO_CUTOFF_MAX         1000000
+
+// 2 * pi in 16.16 fixed point
+#define TWO_PI_Q16              411775
+
+///////////////////////////////////////////////////////////////////////////////
+//
+// Exponential Moving Average
+//
+///////////////////////////////////////////////////////////////////////////////
+
+static int ema_apply(filter_t *filter, int value)
+{
+    int64_t x = (int64_t)value << EMA_SHIFT;
+
+    if (!filter->primed)
+        filter->value = x;
+    else
+        filter->value += ((x - filter->value) * filter->param1) >> EMA_SHIFT;
+
+    return (filter->value + (1 << (EMA_SHIFT - 1))) >> EMA_SHIFT;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+//
+// Median
+//
+///////////////////////////////////////////////////////////////////////////////
+
+static int median_apply(filter_t *filter, int value)
+{
+    int size = filter->param1;
+
+    if (!filter->primed)
+    {
+        for (int i = 0; i < size; i++)
+            filter->window[i] = value;
+    }
+
+    filter->window[filter->window_pos] = value;
+    if (++filter->window_pos == size)
+        filter->window_pos = 0;
+
+    // Insertion sort is the fastest for a handful of values
+    int sorted[FILTER_MEDIAN_MAX];
+    for (int i = 0; i < size; i++)
+    {
+        int v = filter->window[i];
+        int j = i;
+        while (j > 0 && sorted[j - 1] > v)
+        {
+            sorted[j] = sorted[j - 1];
+            j--;
+        }
+        sorted[j] = v;
+    }
+
+    return sorted[size / 2];
+}
+
+///////////////////////////////////////////////////////////////////////////////
+//
+// 1-Euro Filter
+//
+///////////////////////////////////////////////////////////////////////////////
+
+// Low pass smoothing factor in 16.16 for a cutoff in mHz and period in us
+static int64_t euro_alpha(int64_t cutoff, int64_t dt)
+{
+    int64_t w = cutoff * dt * TWO_PI_Q16 / 1000000000;
+    return (w << EURO_SHIFT) / (w + (1 << EURO_SHIFT));
+}
+
+static int euro_apply(filter_t *filter, int value, evtime_t time)
+{
+    int64_t x = (int64_t)value << EURO_SHIFT;
+
+    if (!filter->primed)
+    {
+        filter->value = x;
+        filter->speed = 0;
+        filter->time = time;
+        return value;
+    }
+
+    int64_t dt = time - filter->time;
+    if (dt <= 0)
+        dt = 1;
+    else if (dt > EURO_DT_MAX)
+        dt = EURO_DT_MAX;
+    filter->time = time;
+
+    // Smoothed speed in units per second drives the cutoff frequency
+    int64_t dx = ((x - filter->value) >> (EURO_SHIFT - EURO_SPEED_SHIFT)) * 1000000 / dt;
+    filter->speed += ((dx - filter->speed) * euro_alpha(EURO_DCUTOFF, dt)) >> EURO_SHIFT;
+
+    int64_t speed = llabs(filter->speed) >> EURO_SPEED_SHIFT;
+    int64_t cutoff = filter->param1 + filter->param2 * speed;
+    if (cutoff > EURO_CUTOFF_MAX)
+        cutoff = EURO_CUTOFF_MAX;
+
+    filter->value += ((x - filter->value) * euro_alpha(cutoff, dt)) >> EURO_SHIFT;
+
+    return (filter->value + (1 << (EURO_SHIFT - 1))) >> EURO_SHIFT;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+//
+// Filter Functions
+//
+///////////////////////////////////////////////////////////////////////////////
+
+void filter_init(filter_t *filter, filter_type_t type, int param1, int param2)
+{
+    memset(filter, 0, sizeof(*filter));
+
+    switch (type)
+    {
+        case FILTER_EMA:
+            if (param1 <= 0 || param1 > (1 << EMA_SHIFT))
+                param1 = EMA_ALPHA_DEFAULT;
+            break;
+        case FILTER_MEDIAN:
+            if (param1 <= 0 || param1 > FILTER_MEDIAN_MAX)
+                param1 = MEDIAN_WINDOW_DEFAULT;
+            param1 |= 1;
+            break;
+        case FILTER_EURO:
+            if (param1 <= 0)
+                param1 = EURO_CUTOFF_DEFAULT;
+            if (param2 <= 0)
+                param2 = EURO_BETA_DEFAULT;
+            break;
+        default:
+            type = FILTER_NONE;
+            param1 = 0;
+            param2 = 0;
+            break;
+    }
+
+    filter->type = type;
+    filter->param1 = param1;
+    filter->param2 = param2;
+}
+
+void filter_reset(filter_t *filter)
+{
+    filter->primed = false;
+    filter->window_pos = 0;
+}
+
+int filter_apply(filter_t *filter, int value, evtime_t time)
+{
+    switch (filter->type)
+    {
+        case FILTER_EMA:
+            value = ema_apply(filter, value);
+            break;
+        case FILTER_MEDIAN:
+            value = median_apply(filter, value);
+            break;
+        case FILTER_EURO:
+            value = euro_apply(filter, value, time);
+            break;
+        default:
+            return value;
+    }
+
+    filter->primed = true;
+
+    return value;
+}
+
+const char *filter_name(filter_type_t type)
+{
+    switch (type)
+    {
+        case FILTER_NONE:   return "None";
+        case FILTER_EMA:    return "EMA";
+        case FILTER_MEDIAN: return "Median";
+        case FILTER_EURO:   return "1-Euro";
+        default:            return "UNKNOWN";
+    }
+}
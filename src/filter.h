@@ -0,0 +1,59 @@
+//  evjs - Evdev Joystick Utilities
+//  Copyright (C) 2020 Scott Shumate <scott@shumatech.com>
+//
+//  This program is free software: you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation, either version 3 of the License, or
+//  (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "evdev.h"
+
+typedef enum filter_type
+{
+    FILTER_NONE,
+    FILTER_EMA,
+    FILTER_MEDIAN,
+    FILTER_EURO,
+    FILTER_CNT
+} filter_type_t;
+
+#define FILTER_MEDIAN_MAX   7
+
+// Parameters of zero select the defaults.
+//   FILTER_EMA:    param1 = smoothing factor in 1/256 units
+//   FILTER_MEDIAN: param1 = odd window size up to FILTER_MEDIAN_MAX
+//   FILTER_EURO:   param1 = minimum cutoff in mHz
+//                  param2 = beta in mHz per unit/s of axis speed
+typedef struct filter
+{
+    filter_type_t type;
+    int           param1;
+    int           param2;
+
+    bool          primed;
+    evtime_t      time;
+    int64_t       value;
+    int64_t       speed;
+    int           window[FILTER_MEDIAN_MAX];
+    unsigned      window_pos;
+} filter_t;
+
+void filter_init(filter_t *filter, filter_type_t type, int param1, int param2);
+
+void filter_reset(filter_t *filter);
+
+int filter_apply(filter_t *filter, int value, evtime_t time);
+
+const char *filter_name(filter_type_t type);
@@ -0,0 +1,463 @@
+//  evjs - Evdev Joystick Utilities
+//  Copyright (C) 2020 Scott Shumate <scott@shumatech.com>
+//
+//  This program is free software: you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation, either version 3 of the License, or
+//  (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdarg.h>
+#include <string.h>
+#include <strings.h>
+#include <unistd.h>
+#include <errno.h>
+#include <limits.h>
+#include <time.h>
+
+#include <sys/timerfd.h>
+#include <sys/prctl.h>
+
+#include "util.h"
+#include "sequence.h"
+
+#if ENABLE_EFFECTS
+
+// The clock starts this long after the effects that fit have been uploaded
+#define SEQUENCE_LEAD_NS    100000000LL
+
+// Timer slack in nanoseconds, the default of 50us would swamp the jitter
+#define SEQUENCE_SLACK_NS   1
+
+#define SEQUENCE_LINE_MAX   512
+
+typedef enum step_action
+{
+    STEP_PLAY,
+    STEP_STOP,
+    STEP_GAIN
+} step_action_t;
+
+typedef struct step
+{
+    int64_t          time;
+    step_action_t    action;
+    int              line;
+    struct ff_effect effect;
+    unsigned         gain;
+    int64_t          late;
+} step_t;
+
+typedef struct named
+{
+    char             *name;
+    struct ff_effect effect;
+} named_t;
+
+struct sequence
+{
+    const char  *file;
+    device_t    *dev;
+    int         gain_index;
+    step_t      *step_array;
+    size_t      step_num;
+    size_t      step_done;
+    named_t     *named_array;
+    size_t      named_num;
+    unsigned    late_uploads;
+    unsigned    failed;
+};
+
+typedef struct waveform
+{
+    const char  *name;
+    uint16_t    id;
+} waveform_t;
+
+static const waveform_t waveforms[] =
+{
+    { "square",   FF_SQUARE },
+    { "triangle", FF_TRIANGLE },
+    { "sine",     FF_SINE },
+    { "saw_up",   FF_SAW_UP },
+    { "saw_down", FF_SAW_DOWN },
+};
+
+#define WAVEFORM_NUM    (sizeof(waveforms) / sizeof(waveforms[0]))
+
+///////////////////////////////////////////////////////////////////////////////
+//
+// Parsing Functions
+//
+///////////////////////////////////////////////////////////////////////////////
+
+static void __attribute__ ((format(printf, 3, 4), noreturn))
+parse_error(sequence_t *seq, int line, const char *fmt, ...)
+{
+    char msg[256];
+    va_list ap;
+
+    va_start(ap, fmt);
+    vsnprintf(msg, sizeof(msg), fmt, ap);
+    va_end(ap);
+
+    xerrx("%s:%d: %s", seq->file, line, msg);
+}
+
+static long parse_number(sequence_t *seq, int line, const char *str, long min, long max)
+{
+    char *end;
+
+    errno = 0;
+    long value = strtol(str, &end, 0);
+    if (errno || end == str || *end != '\0')
+        parse_error(seq, line, "Invalid number: %s", str);
+    if (value < min || value > max)
+        parse_error(seq, line, "Value %ld is outside of [%ld-%ld]", value, min, max);
+
+    return value;
+}
+
+static void parse_param(sequence_t *seq, int line, struct ff_effect *fe, char *param)
+{
+    char *value = strchr(param, '=');
+    if (!value)
+        parse_error(seq, line, "Expected NAME=VALUE: %s", param);
+    *value++ = '\0';
+
+    if (strcmp(param, "length") == 0)
+        fe->replay.length = parse_number(seq, line, value, 0, 0x7fff);
+    else if (strcmp(param, "delay") == 0)
+        fe->replay.delay = parse_number(seq, line, value, 0, 0x7fff);
+    else if (strcmp(param, "direction") == 0 && fe->type != FF_RUMBLE)
+        fe->direction = 0x10000 * parse_number(seq, line, value, 0, 359) / 360;
+    else if (strcmp(param, "level") == 0 && fe->type == FF_CONSTANT)
+        fe->u.constant.level = 0x7fff * parse_number(seq, line, value, -100, 100) / 100;
+    else if (strcmp(param, "level") == 0 && fe->type == FF_PERIODIC)
+        fe->u.periodic.magnitude = 0x7fff * parse_number(seq, line, value, -100, 100) / 100;
+    else if (strcmp(param, "period") == 0 && fe->type == FF_PERIODIC)
+        fe->u.periodic.period = parse_number(seq, line, value, 1, 0x7fff);
+    else if (strcmp(param, "strong") == 0 && fe->type == FF_RUMBLE)
+        fe->u.rumble.strong_magnitude = 0xffff * parse_number(seq, line, value, 0, 100) / 100;
+    else if (strcmp(param, "weak") == 0 && fe->type == FF_RUMBLE)
+        fe->u.rumble.weak_magnitude = 0xffff * parse_number(seq, line, value, 0, 100) / 100;
+    else if (strcmp(param, "waveform") == 0 && fe->type == FF_PERIODIC)
+    {
+        const waveform_t *wave = waveforms;
+        while (wave < &waveforms[WAVEFORM_NUM] && strcasecmp(wave->name, value) != 0)
+            wave++;
+        if (wave == &waveforms[WAVEFORM_NUM])
+            parse_error(seq, line, "Unknown waveform: %s", value);
+        fe->u.periodic.waveform = wave->id;
+    }
+    else
+        parse_error(seq, line, "Unknown parameter: %s", param);
+}
+
+static void parse_effect(sequence_t *seq, int line, struct ff_effect *fe, const char *type, char **save)
+{
+    // Zeroed so that identical effects compare equal in the slot cache
+    memset(fe, 0, sizeof(*fe));
+
+    if (strcasecmp(type, "constant") == 0)
+        fe->type = FF_CONSTANT;
+    else if (strcasecmp(type, "rumble") == 0)
+        fe->type = FF_RUMBLE;
+    else if (strcasecmp(type, "periodic") == 0)
+    {
+        fe->type = FF_PERIODIC;
+        fe->u.periodic.waveform = FF_SINE;
+        fe->u.periodic.period = 1000;
+    }
+    else
+        parse_error(seq, line, "Unknown effect type: %s", type);
+
+    if (evff_map(seq->dev->evdev, fe->type) < 0)
+        parse_error(seq, line, "Effect %s is not supported by the device", type);
+
+    char *param;
+    while ((param = strtok_r(NULL, " \t\n", save)))
+        parse_param(seq, line, fe, param);
+}
+
+static named_t *named_get(sequence_t *seq, const char *name, bool add)
+{
+    for (named_t *named = seq->named_array; named < &seq->named_array[seq->named_num]; named++)
+    {
+        if (strcmp(named->name, name) == 0)
+            return named;
+    }
+
+    if (!add)
+        return NULL;
+
+    seq->named_array = xrealloc(seq->named_array, sizeof(named_t) * (seq->named_num + 1));
+
+    named_t *named = &seq->named_array[seq->named_num++];
+    named->name = xstrdup(name);
+
+    return named;
+}
+
+static void parse_line(sequence_t *seq, int line, char *text)
+{
+    char *save;
+    char *time = strtok_r(text, " \t\n", &save);
+    if (!time || *time == '#')
+        return;
+
+    step_t step = { .line = line };
+    step.time = parse_number(seq, line, time, 0, LONG_MAX / 1000000) * 1000000;
+    if (seq->step_num && step.time < seq->step_array[seq->step_num - 1].time)
+        parse_error(seq, line, "Step is earlier than the previous step");
+
+    char *action = strtok_r(NULL, " \t\n", &save);
+    char *arg = strtok_r(NULL, " \t\n", &save);
+    if (!action || !arg)
+        parse_error(seq, line, "Expected TIME ACTION ARGUMENT");
+
+    if (strcasecmp(action, "play") == 0 || strcasecmp(action, "stop") == 0)
+    {
+        step.action = (strcasecmp(action, "play") == 0) ? STEP_PLAY : STEP_STOP;
+
+        // An effect type after the name (re)defines the named effect
+        char *type = strtok_r(NULL, " \t\n", &save);
+        named_t *named = named_get(seq, arg, type != NULL);
+        if (type)
+            parse_effect(seq, line, &named->effect, type, &save);
+        else if (!named)
+            parse_error(seq, line, "Undefined effect: %s", arg);
+
+        step.effect = named->effect;
+    }
+    else if (strcasecmp(action, "gain") == 0)
+    {
+        if (seq->gain_index < 0)
+            parse_error(seq, line, "Gain is not supported by the device");
+
+        step.action = STEP_GAIN;
+        step.gain = parse_number(seq, line, arg, 0, 100);
+    }
+    else
+        parse_error(seq, line, "Unknown action: %s", action);
+
+    seq->step_array = xrealloc(seq->step_array, sizeof(step_t) * (seq->step_num + 1));
+    seq->step_array[seq->step_num++] = step;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+//
+// Sequence Functions
+//
+///////////////////////////////////////////////////////////////////////////////
+
+// Upload the next effect to play so that its EVIOCSFF is off the critical
+// path.  evff_upload() never evicts an effect that is still playing, so
+// when every slot is busy the upload is left to the step itself.
+static void sequence_preload(sequence_t *seq, size_t next)
+{
+    evdev_t *evdev = seq->dev->evdev;
+
+    for (step_t *step = &seq->step_array[next]; step < &seq->step_array[seq->step_num]; step++)
+    {
+        if (step->action == STEP_PLAY)
+        {
+            if (evff_find(evdev, &step->effect) < 0)
+                evff_upload(evdev, &step->effect);
+            break;
+        }
+    }
+}
+
+static void sequence_step(sequence_t *seq, step_t *step, int64_t when)
+{
+    evdev_t *evdev = seq->dev->evdev;
+    bool ok = true;
+
+    switch (step->action)
+    {
+        case STEP_PLAY:
+        {
+            int slot = evff_find(evdev, &step->effect);
+            if (slot < 0)
+            {
+                seq->late_uploads++;
+                slot = evff_upload(evdev, &step->effect);
+            }
+
+            step->late = (int64_t) now_ns() - when;
+            ok = (slot >= 0 && evff_play(evdev, slot, 1));
+            break;
+        }
+        case STEP_STOP:
+        {
+            // Playing effects are never evicted so one that is gone has ended
+            int slot = evff_find(evdev, &step->effect);
+
+            step->late = (int64_t) now_ns() - when;
+            if (slot >= 0)
+                ok = evff_stop(evdev, slot);
+            break;
+        }
+        case STEP_GAIN:
+            step->late = (int64_t) now_ns() - when;
+            ok = evff_property(evdev, seq->gain_index, step->gain);
+            break;
+    }
+
+    if (!ok)
+        seq->failed++;
+}
+
+sequence_t *sequence_load(const char *file, device_t *dev)
+{
+    FILE *fp = fopen(file, "r");
+    if (!fp)
+        xerr("%s", file);
+
+    sequence_t *seq = xalloc(sizeof(sequence_t));
+    seq->file = file;
+    seq->dev = dev;
+    seq->gain_index = evff_map(dev->evdev, FF_GAIN);
+
+    char text[SEQUENCE_LINE_MAX];
+    int line = 0;
+    while (fgets(text, sizeof(text), fp))
+        parse_line(seq, ++line, text);
+
+    fclose(fp);
+
+    if (seq->step_num == 0)
+        xerrx("%s: No steps in sequence", file);
+
+    return seq;
+}
+
+void sequence_free(sequence_t *seq)
+{
+    for (named_t *named = seq->named_array; named < &seq->named_array[seq->named_num]; named++)
+        xfree(named->name);
+
+    xfree(seq->named_array);
+    xfree(seq->step_array);
+    xfree(seq);
+}
+
+bool sequence_run(sequence_t *seq, volatile sig_atomic_t *stopped)
+{
+    evdev_t *evdev = seq->dev->evdev;
+
+    prctl(PR_SET_TIMERSLACK, SEQUENCE_SLACK_NS);
+
+    int tfd = timerfd_create(CLOCK_MONOTONIC, TFD_CLOEXEC);
+    if (tfd < 0)
+        xerr("timerfd");
+
+    // Upload the first effects in play order while they fit in the slots
+    size_t uploads = 0;
+    for (step_t *step = seq->step_array; step < &seq->step_array[seq->step_num]; step++)
+    {
+        if (uploads == evff_slots(evdev))
+            break;
+
+        if (step->action == STEP_PLAY && evff_find(evdev, &step->effect) < 0)
+        {
+            evff_upload(evdev, &step->effect);
+            uploads++;
+        }
+    }
+
+    int64_t start = now_ns() + SEQUENCE_LEAD_NS;
+
+    seq->step_done = 0;
+    while (seq->step_done < seq->step_num && !*stopped)
+    {
+        step_t *step = &seq->step_array[seq->step_done];
+        int64_t when = start + step->time;
+
+        // Steps scheduled at the same time run back to back without the timer
+        if ((int64_t) now_ns() < when)
+        {
+            struct itimerspec its = {
+                .it_value = { .tv_sec = when / 1000000000, .tv_nsec = when % 1000000000 }
+            };
+            if (timerfd_settime(tfd, TFD_TIMER_ABSTIME, &its, NULL) < 0)
+                xerr("timerfd_settime");
+
+            uint64_t expired;
+            if (read(tfd, &expired, sizeof(expired)) != sizeof(expired))
+            {
+                if (errno == EINTR)
+                    continue;
+                xerr("timerfd");
+            }
+        }
+
+        sequence_step(seq, step, when);
+        seq->step_done++;
+
+        sequence_preload(seq, seq->step_done);
+    }
+
+    // Leave nothing playing if the sequence was interrupted
+    for (named_t *named = seq->named_array; named < &seq->named_array[seq->named_num]; named++)
+    {
+        int slot = evff_find(evdev, &named->effect);
+        if (slot >= 0)
+            evff_stop(evdev, slot);
+    }
+
+    close(tfd);
+
+    return (seq->step_done == seq->step_num && seq->failed == 0);
+}
+
+void sequence_report(sequence_t *seq)
+{
+    size_t num = seq->step_done;
+
+    printf("Steps: %zu of %zu, late uploads: %u, failed: %u\n",
+           num, seq->step_num, seq->late_uploads, seq->failed);
+    if (num == 0)
+        return;
+
+    int64_t *late = xalloc(sizeof(int64_t) * num);
+    step_t *worst = seq->step_array;
+    int64_t sum = 0;
+
+    for (size_t i = 0; i < num; i++)
+    {
+        step_t *step = &seq->step_array[i];
+
+        late[i] = step->late;
+        sum += step->late;
+        if (step->late > worst->late)
+            worst = step;
+    }
+
+    sort_i64(late, num);
+
+    printf("Start jitter (us): min %.1f  p50 %.1f  p90 %.1f  p99 %.1f  max %.1f  mean %.1f\n",
+           late[0] / 1000.0,
+           late[percentile(num, 50)] / 1000.0,
+           late[percentile(num, 90)] / 1000.0,
+           late[percentile(num, 99)] / 1000.0,
+           late[num - 1] / 1000.0,
+           (double) sum / num / 1000.0);
+    printf("Worst step: line %d at %lld ms, %.1f us late\n",
+           worst->line, (long long) (worst->time / 1000000), worst->late / 1000.0);
+
+    xfree(late);
+}
+
+#endif // ENABLE_EFFECTS
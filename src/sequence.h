@@ -0,0 +1,34 @@
+//  evjs - Evdev Joystick Utilities
+//  Copyright (C) 2020 Scott Shumate <scott@shumatech.com>
+//
+//  This program is free software: you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation, either version 3 of the License, or
+//  (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+#pragma once
+
+#include <stdlib.h>
+#include <stdbool.h>
+#include <signal.h>
+
+#include "device.h"
+
+#if ENABLE_EFFECTS
+typedef struct sequence sequence_t;
+
+sequence_t *sequence_load(const char *file, device_t *dev);
+
+void sequence_free(sequence_t *seq);
+
+bool sequence_run(sequence_t *seq, volatile sig_atomic_t *stopped);
+
+void sequence_report(sequence_t *seq);
+#endif
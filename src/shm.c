@@ -0,0 +1,137 @@
+//  evjs - Evdev Joystick Utilities
+//  Copyright (C) 2020 Scott Shumate <scott@shumatech.com>
+//
+//  This program is free software: you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation, either version 3 of the License, or
+//  (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+#define _GNU_SOURCE
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "shm.h"
+#include "evjs_shm.h"
+#include "util.h"
+#include "trace.h"
+
+_Static_assert(EVJS_SHM_AXES >= ABS_CNT, "evjs_shm_t axes");
+_Static_assert(EVJS_SHM_BUTTONS >= KEY_CNT, "evjs_shm_t buttons");
+
+struct shm
+{
+    device_t    *dev;
+    evjs_shm_t  *map;
+    char        *path;
+};
+
+// The region is filled in under a temporary name and then renamed so that
+// a reader never sees it without its device description
+shm_t *shm_init(device_t *dev)
+{
+    shm_t *shm = xalloc(sizeof(shm_t));
+    shm->dev = dev;
+
+    const char *base = strrchr(dev->file, '/');
+    base = base ? base + 1 : dev->file;
+
+    char *tmp;
+    xasprintf(&shm->path, "%s/%s%s", EVJS_SHM_DIR, EVJS_SHM_PREFIX, base);
+    xasprintf(&tmp, "%s/.%s%s.XXXXXX", EVJS_SHM_DIR, EVJS_SHM_PREFIX, base);
+
+    // The directory is world writable, so the temporary file must be new
+    int fd = mkostemp(tmp, O_CLOEXEC);
+    if (fd < 0)
+        xerr("%s", tmp);
+    if (fchmod(fd, 0644) < 0)
+        xerr("%s", tmp);
+
+    if (ftruncate(fd, sizeof(evjs_shm_t)) < 0)
+        xerr("%s", tmp);
+
+    void *map = mmap(NULL, sizeof(evjs_shm_t), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (map == MAP_FAILED)
+        xerr("mmap");
+    close(fd);
+
+    evjs_shm_t *region = shm->map = map;
+    region->magic      = EVJS_SHM_MAGIC;
+    region->version    = EVJS_SHM_VERSION;
+    region->size       = sizeof(evjs_shm_t);
+    region->bus        = dev->id.bus;
+    region->vendor     = dev->id.vendor;
+    region->product    = dev->id.product;
+    region->axis_num   = dev->axis_num;
+    region->button_num = dev->button_num;
+    snprintf(region->name, sizeof(region->name), "%s", dev->name);
+
+    AXIS_FOREACH(dev, axis)
+        region->axis_id[axis->index] = axis->id;
+    BUTTON_FOREACH(dev, button)
+        region->button_id[button->index] = button->id;
+
+    shm_publish(shm, 0);
+
+    if (rename(tmp, shm->path) < 0)
+        xerr("%s", shm->path);
+    xfree(tmp);
+
+    return shm;
+}
+
+// Called by the single writer at the end of every frame
+void shm_publish(shm_t *shm, evtime_t time)
+{
+    TRACE_SCOPE("shm_publish");
+
+    evjs_shm_t *region = shm->map;
+    device_t *dev = shm->dev;
+
+    // Only copies happen while the sequence is odd
+    uint64_t bits[EVJS_SHM_BUTTONS / 64] = { 0 };
+    BUTTON_FOREACH(dev, button)
+    {
+        if (button->value)
+            bits[button->index / 64] |= 1ULL << (button->index % 64);
+    }
+
+    uint32_t seq = region->seq;
+    __atomic_store_n(&region->seq, seq + 1, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+
+    evjs_shm_state_t *state = &region->state;
+    state->frame++;
+    state->time = time;
+    memcpy(state->axis, dev->axis_soa.value, sizeof(int32_t) * dev->axis_num);
+    memcpy(state->button, bits, sizeof(bits));
+
+    __atomic_store_n(&region->seq, seq + 2, __ATOMIC_RELEASE);
+}
+
+const char *shm_path(shm_t *shm)
+{
+    return shm->path;
+}
+
+// Readers that still have the region mapped see it closed
+void shm_free(shm_t *shm)
+{
+    __atomic_store_n(&shm->map->closed, 1, __ATOMIC_RELEASE);
+    munmap(shm->map, sizeof(evjs_shm_t));
+    unlink(shm->path);
+    xfree(shm->path);
+    xfree(shm);
+}
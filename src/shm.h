@@ -0,0 +1,27 @@
+//  evjs - Evdev Joystick Utilities
+//  Copyright (C) 2020 Scott Shumate <scott@shumatech.com>
+//
+//  This program is free software: you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation, either version 3 of the License, or
+//  (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+#pragma once
+
+#include "device.h"
+
+typedef struct shm shm_t;
+
+// Publishes the state of a device into shared memory for any number of
+// readers, see evjs_shm.h for the layout and the reader side
+shm_t *shm_init(device_t *dev);
+void shm_publish(shm_t *shm, evtime_t time);
+const char *shm_path(shm_t *shm);
+void shm_free(shm_t *shm);
@@ -0,0 +1,353 @@
+//  evjs - Evdev Joystick Utilities
+//  Copyright (C) 2020 Scott Shumate <scott@shumatech.com>
+//
+//  This program is free software: you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation, either version 3 of the License, or
+//  (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdarg.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <time.h>
+
+#include "util.h"
+#include "barray.h"
+#include "stream.h"
+
+// Records are batched and written once this many frames are pending or
+// the oldest pending frame is this old, whichever comes first
+#define STREAM_BATCH_FRAMES 64
+#define STREAM_BATCH_MS     10
+#define STREAM_BUF_SIZE     65536
+
+// Worst case bytes for one value and for the fixed part of a record
+#define STREAM_VALUE_MAX    48
+#define STREAM_RECORD_MAX   96
+
+typedef struct source
+{
+    stream_t    *stream;
+    device_t    *dev;
+    size_t      index;
+    size_t      column;
+    barray_t    *axis_changed;
+    barray_t    *button_changed;
+    evtime_t    next;
+} source_t;
+
+struct stream
+{
+    int             fd;
+    stream_format_t format;
+    evtime_t        period;
+    source_t        *source_array;
+    size_t          source_num;
+    size_t          column_num;
+    char            *buf;
+    size_t          buf_len;
+    size_t          buf_size;
+    size_t          record_max;
+    size_t          frames;
+    uint64_t        deadline;
+};
+
+static const char *format_names[] =
+{
+    [STREAM_JSON] = "json",
+    [STREAM_CSV]  = "csv"
+};
+
+#define FORMAT_NUM          (sizeof(format_names) / sizeof(format_names[0]))
+
+static void stream_printf(stream_t *stream, const char *fmt, ...)
+{
+    va_list ap;
+
+    va_start(ap, fmt);
+    int len = vsnprintf(stream->buf + stream->buf_len, stream->buf_size - stream->buf_len, fmt, ap);
+    va_end(ap);
+
+    if (len < 0 || len >= stream->buf_size - stream->buf_len)
+        xerrx("stream record overflow");
+
+    stream->buf_len += len;
+}
+
+static void stream_putc(stream_t *stream, char ch)
+{
+    stream->buf[stream->buf_len++] = ch;
+}
+
+void stream_flush(stream_t *stream)
+{
+    size_t done = 0;
+
+    while (done < stream->buf_len)
+    {
+        ssize_t len = write(stream->fd, stream->buf + done, stream->buf_len - done);
+        if (len < 0)
+        {
+            if (errno == EINTR)
+                continue;
+            xerr("stream write");
+        }
+        done += len;
+    }
+
+    stream->buf_len = 0;
+    stream->frames = 0;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+//
+// Record Functions
+//
+///////////////////////////////////////////////////////////////////////////////
+
+static void stream_json(stream_t *stream, source_t *src, evtime_t time)
+{
+    device_t *dev = src->dev;
+    char sep;
+
+    stream_printf(stream, "{\"time\":%llu,\"device\":%zu", (unsigned long long) time, src->index);
+
+    sep = '{';
+    stream_printf(stream, ",\"abs\":");
+    AXIS_FOREACH(dev, axis)
+    {
+        if (barray_is_set(src->axis_changed, axis->index))
+        {
+            stream_printf(stream, "%c\"%s\":%d", sep, axis->name, axis->value);
+            sep = ',';
+        }
+    }
+    stream_printf(stream, sep == '{' ? "{}" : "}");
+
+    sep = '{';
+    stream_printf(stream, ",\"key\":");
+    BUTTON_FOREACH(dev, button)
+    {
+        if (barray_is_set(src->button_changed, button->index))
+        {
+            stream_printf(stream, "%c\"%d\":%d", sep, button->index, button->value);
+            sep = ',';
+        }
+    }
+    stream_printf(stream, sep == '{' ? "{}}\n" : "}}\n");
+}
+
+static void stream_csv(stream_t *stream, source_t *src, evtime_t time)
+{
+    device_t *dev = src->dev;
+
+    // Every row has a cell for every column of every device and only the
+    // cells of the values that changed in this frame are filled in
+    stream_printf(stream, "%llu", (unsigned long long) time);
+
+    for (size_t column = 0; column < src->column; column++)
+        stream_putc(stream, ',');
+
+    AXIS_FOREACH(dev, axis)
+    {
+        stream_putc(stream, ',');
+        if (barray_is_set(src->axis_changed, axis->index))
+            stream_printf(stream, "%d", axis->value);
+    }
+
+    BUTTON_FOREACH(dev, button)
+    {
+        stream_putc(stream, ',');
+        if (barray_is_set(src->button_changed, button->index))
+            stream_printf(stream, "%d", button->value);
+    }
+
+    size_t end = src->column + dev->axis_num + dev->button_num;
+    for (size_t column = end; column < stream->column_num; column++)
+        stream_putc(stream, ',');
+
+    stream_putc(stream, '\n');
+}
+
+static void stream_header(stream_t *stream)
+{
+    if (stream->format != STREAM_CSV)
+        return;
+
+    stream_printf(stream, "time");
+
+    for (size_t i = 0; i < stream->source_num; i++)
+    {
+        source_t *src = &stream->source_array[i];
+
+        // Only prefix the column names when there is more than one device
+        char prefix[24] = "";
+        if (stream->source_num > 1)
+            snprintf(prefix, sizeof(prefix), "%zu.", src->index);
+
+        AXIS_FOREACH(src->dev, axis)
+            stream_printf(stream, ",%s%s", prefix, axis->name);
+        BUTTON_FOREACH(src->dev, button)
+            stream_printf(stream, ",%sBTN%d", prefix, button->index);
+    }
+
+    stream_putc(stream, '\n');
+    stream_flush(stream);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+//
+// Device Callback Functions
+//
+///////////////////////////////////////////////////////////////////////////////
+
+static void stream_axis(axis_t *axis, void *arg)
+{
+    source_t *src = arg;
+    barray_set(src->axis_changed, axis->index);
+}
+
+static void stream_button(button_t *button, void *arg)
+{
+    source_t *src = arg;
+    barray_set(src->button_changed, button->index);
+}
+
+static void stream_syn(evtime_t time, void *arg)
+{
+    source_t *src = arg;
+    stream_t *stream = src->stream;
+
+    if (barray_is_empty(src->axis_changed) && barray_is_empty(src->button_changed))
+        return;
+
+    // Frames inside the downsampling period keep their changes pending so
+    // the next emitted frame carries them
+    if (time < src->next)
+        return;
+    src->next = time + stream->period;
+
+    if (stream->buf_size - stream->buf_len < stream->record_max)
+        stream_flush(stream);
+
+    if (stream->format == STREAM_JSON)
+        stream_json(stream, src, time);
+    else
+        stream_csv(stream, src, time);
+
+    barray_zero(src->axis_changed);
+    barray_zero(src->button_changed);
+
+    if (stream->frames++ == 0)
+        stream->deadline = now_ns() / 1000000 + STREAM_BATCH_MS;
+
+    if (stream->frames >= STREAM_BATCH_FRAMES)
+        stream_flush(stream);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+//
+// Stream Functions
+//
+///////////////////////////////////////////////////////////////////////////////
+
+bool stream_format(const char *name, stream_format_t *format)
+{
+    for (int i = 0; i < FORMAT_NUM; i++)
+    {
+        if (strcmp(name, format_names[i]) == 0)
+        {
+            *format = i;
+            return true;
+        }
+    }
+
+    return false;
+}
+
+int stream_timeout(stream_t *stream)
+{
+    if (stream->frames == 0)
+        return -1;
+
+    uint64_t now = now_ns() / 1000000;
+    return now >= stream->deadline ? 0 : stream->deadline - now;
+}
+
+void stream_poll(stream_t *stream)
+{
+    if (stream->frames > 0 && now_ns() / 1000000 >= stream->deadline)
+        stream_flush(stream);
+}
+
+stream_t *stream_init(device_t *dev_array[], size_t dev_num, stream_format_t format,
+                      unsigned rate, int fd)
+{
+    stream_t *stream = xalloc(sizeof(stream_t));
+
+    stream->fd = fd;
+    stream->format = format;
+    stream->period = rate ? 1000000 / rate : 0;
+    stream->source_array = xalloc(sizeof(source_t) * dev_num);
+    stream->source_num = dev_num;
+
+    for (size_t i = 0; i < dev_num; i++)
+    {
+        source_t *src = &stream->source_array[i];
+        device_t *dev = dev_array[i];
+
+        src->stream = stream;
+        src->dev = dev;
+        src->index = i;
+        src->column = stream->column_num;
+        src->axis_changed = barray_init(dev->axis_num);
+        src->button_changed = barray_init(dev->button_num);
+
+        stream->column_num += dev->axis_num + dev->button_num;
+
+        device_read_cb(dev, stream_axis, stream_button, src);
+        device_syn_cb(dev, stream_syn, src);
+    }
+
+    stream->record_max = STREAM_RECORD_MAX + STREAM_VALUE_MAX * stream->column_num;
+    stream->buf_size = STREAM_BUF_SIZE;
+    if (stream->buf_size < 2 * stream->record_max)
+        stream->buf_size = 2 * stream->record_max;
+    stream->buf = xalloc(stream->buf_size);
+
+    stream_header(stream);
+
+    return stream;
+}
+
+void stream_free(stream_t *stream)
+{
+    stream_flush(stream);
+
+    for (size_t i = 0; i < stream->source_num; i++)
+    {
+        source_t *src = &stream->source_array[i];
+
+        device_read_cb(src->dev, NULL, NULL, NULL);
+        device_syn_cb(src->dev, NULL, NULL);
+
+        barray_free(src->axis_changed);
+        barray_free(src->button_changed);
+    }
+
+    xfree(stream->source_array);
+    xfree(stream->buf);
+    xfree(stream);
+}
@@ -0,0 +1,42 @@
+//  evjs - Evdev Joystick Utilities
+//  Copyright (C) 2020 Scott Shumate <scott@shumatech.com>
+//
+//  This program is free software: you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation, either version 3 of the License, or
+//  (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+#pragma once
+
+#include <stdlib.h>
+#include <stdbool.h>
+
+#include "device.h"
+
+typedef enum stream_format
+{
+    STREAM_JSON,
+    STREAM_CSV
+} stream_format_t;
+
+typedef struct stream stream_t;
+
+bool stream_format(const char *name, stream_format_t *format);
+
+stream_t *stream_init(device_t *dev_array[], size_t dev_num, stream_format_t format,
+                      unsigned rate, int fd);
+
+void stream_free(stream_t *stream);
+
+int stream_timeout(stream_t *stream);
+
+void stream_poll(stream_t *stream);
+
+void stream_flush(stream_t *stream);
@@ -0,0 +1,199 @@
+//  evjs - Evdev Joystick Utilities
+//  Copyright (C) 2020 Scott Shumate <scott@shumatech.com>
+//
+//  This program is free software: you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation, either version 3 of the License, or
+//  (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+#define _GNU_SOURCE
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <signal.h>
+#include <time.h>
+#include <limits.h>
+
+#include "trace.h"
+#include "util.h"
+
+#if ENABLE_TRACING
+
+// Records kept per thread, the oldest are overwritten when it is full
+#define TRACE_RING_SIZE     32768
+#define TRACE_RING_MASK     (TRACE_RING_SIZE - 1)
+
+#define TRACE_ENV           "EVJS_TRACE"
+
+typedef struct trace_record
+{
+    uint64_t            time;
+    const char          *name;
+    uint64_t            arg;
+    char                phase;
+} trace_record_t;
+
+typedef struct trace_ring
+{
+    trace_record_t      records[TRACE_RING_SIZE];
+    uint64_t            head;
+    pid_t               tid;
+    struct trace_ring   *next;
+} trace_ring_t;
+
+static __thread trace_ring_t    *trace_ring;
+static trace_ring_t             *trace_rings;
+static volatile sig_atomic_t    trace_dump_pending;
+
+///////////////////////////////////////////////////////////////////////////////
+//
+// Recording Functions
+//
+///////////////////////////////////////////////////////////////////////////////
+
+static trace_ring_t *trace_ring_get(void)
+{
+    trace_ring_t *ring = trace_ring;
+    if (ring)
+        return ring;
+
+    ring = xalloc(sizeof(trace_ring_t));
+    ring->tid = gettid();
+
+    // Rings are only ever added so a lock free push is enough
+    ring->next = __atomic_load_n(&trace_rings, __ATOMIC_RELAXED);
+    while (!__atomic_compare_exchange_n(&trace_rings, &ring->next, ring, true,
+                                        __ATOMIC_RELEASE, __ATOMIC_RELAXED))
+        ;
+
+    trace_ring = ring;
+
+    return ring;
+}
+
+static void trace_record(char phase, const char *name, uint64_t arg)
+{
+    trace_ring_t *ring = trace_ring_get();
+
+    // Only the owning thread writes, the head is published for the dump
+    uint64_t head = ring->head;
+    trace_record_t *rec = &ring->records[head & TRACE_RING_MASK];
+    rec->time  = now_ns();
+    rec->name  = name;
+    rec->arg   = arg;
+    rec->phase = phase;
+    __atomic_store_n(&ring->head, head + 1, __ATOMIC_RELEASE);
+
+    // A dump is not signal safe so it is done by the next trace point
+    if (trace_dump_pending)
+    {
+        trace_dump_pending = 0;
+        trace_dump();
+    }
+}
+
+void trace_begin(const char *name, uint64_t arg)
+{
+    trace_record('B', name, arg);
+}
+
+void trace_end(const char *name)
+{
+    trace_record('E', name, 0);
+}
+
+trace_scope_t trace_scope_begin(const char *name)
+{
+    trace_record('B', name, 0);
+    return (trace_scope_t) { .name = name };
+}
+
+void trace_scope_end(trace_scope_t *scope)
+{
+    trace_record('E', scope->name, 0);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+//
+// Output Functions
+//
+///////////////////////////////////////////////////////////////////////////////
+
+static void trace_ring_dump(FILE *file, trace_ring_t *ring, pid_t pid, const char **comma)
+{
+    uint64_t head = __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE);
+    uint64_t tail = head > TRACE_RING_SIZE ? head - TRACE_RING_SIZE : 0;
+
+    for (uint64_t i = tail; i < head; i++)
+    {
+        trace_record_t *rec = &ring->records[i & TRACE_RING_MASK];
+
+        fprintf(file, "%s\n{\"name\":\"%s\",\"ph\":\"%c\",\"ts\":%.3f,\"pid\":%d,\"tid\":%d",
+                *comma, rec->name, rec->phase, rec->time / 1000.0, pid, ring->tid);
+        if (rec->arg)
+            fprintf(file, ",\"args\":{\"arg\":\"0x%llx\"}", (unsigned long long)rec->arg);
+        fputc('}', file);
+
+        *comma = ",";
+    }
+}
+
+// Writes every ring to $EVJS_TRACE or /tmp/PROGRAM-PID.json, replacing the
+// previous dump atomically so that a viewer never loads a partial file
+void trace_dump(void)
+{
+    char path[PATH_MAX];
+    char tmp[PATH_MAX + 4];
+    pid_t pid = getpid();
+
+    const char *env = getenv(TRACE_ENV);
+    if (env)
+        xsnprintf(path, sizeof(path), "%s", env);
+    else
+        xsnprintf(path, sizeof(path), "/tmp/%s-%d.json", program_invocation_short_name, pid);
+    xsnprintf(tmp, sizeof(tmp), "%s.tmp", path);
+
+    FILE *file = fopen(tmp, "w");
+    if (!file)
+        return;
+
+    const char *comma = "";
+    fprintf(file, "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[");
+    for (trace_ring_t *ring = __atomic_load_n(&trace_rings, __ATOMIC_ACQUIRE);
+         ring != NULL; ring = ring->next)
+        trace_ring_dump(file, ring, pid, &comma);
+    fprintf(file, "\n]}\n");
+
+    if (fclose(file) == 0)
+        rename(tmp, path);
+    else
+        unlink(tmp);
+}
+
+static void trace_signal(int signum)
+{
+    trace_dump_pending = 1;
+}
+
+__attribute__((constructor))
+static void trace_init(void)
+{
+    struct sigaction sa = { .sa_handler = trace_signal, .sa_flags = SA_RESTART };
+    sigemptyset(&sa.sa_mask);
+    sigaction(SIGUSR1, &sa, NULL);
+
+    atexit(trace_dump);
+}
+
+#endif // ENABLE_TRACING
@@ -0,0 +1,58 @@
+//  evjs - Evdev Joystick Utilities
+//  Copyright (C) 2020 Scott Shumate <scott@shumatech.com>
+//
+//  This program is free software: you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation, either version 3 of the License, or
+//  (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+#pragma once
+
+#include <stdint.h>
+
+// Trace points compile to nothing unless configured with --enable-tracing.
+// Records go to a ring buffer per thread that is written out as Chrome
+// trace event JSON on exit and on SIGUSR1, see trace.c.
+#if ENABLE_TRACING
+
+typedef struct trace_scope
+{
+    const char  *name;
+} trace_scope_t;
+
+///////////////////////////////////////////////////////////////////////////////
+//
+// Trace Functions
+//
+///////////////////////////////////////////////////////////////////////////////
+void trace_begin(const char *name, uint64_t arg);
+void trace_end(const char *name);
+trace_scope_t trace_scope_begin(const char *name);
+void trace_scope_end(trace_scope_t *scope);
+void trace_dump(void);
+
+// NAME must be a string literal since only the pointer is recorded
+#define TRACE_BEGIN(name)           trace_begin(name, 0)
+#define TRACE_BEGIN_ARG(name, arg)  trace_begin(name, (uint64_t)(arg))
+#define TRACE_END(name)             trace_end(name)
+
+// Traces the rest of the enclosing block, one per block
+#define TRACE_SCOPE(name)           trace_scope_t trace_scope \
+                                        __attribute__((cleanup(trace_scope_end))) = \
+                                        trace_scope_begin(name)
+
+#else
+
+#define TRACE_BEGIN(name)           ((void)0)
+#define TRACE_BEGIN_ARG(name, arg)  ((void)0)
+#define TRACE_END(name)             ((void)0)
+#define TRACE_SCOPE(name)           ((void)0)
+
+#endif
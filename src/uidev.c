@@ -0,0 +1,222 @@
+//  evjs - Evdev Joystick Utilities
+//  Copyright (C) 2020 Scott Shumate <scott@shumatech.com>
+//
+//  This program is free software: you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation, either version 3 of the License, or
+//  (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+#define _GNU_SOURCE
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <time.h>
+#include <dirent.h>
+#include <stdio.h>
+#include <limits.h>
+#include <sys/ioctl.h>
+#include <linux/input.h>
+#include <linux/uinput.h>
+
+#include "util.h"
+#include "uidev.h"
+#include "trace.h"
+
+#define UINPUT_FILE     "/dev/uinput"
+#define SYS_INPUT       "/sys/devices/virtual/input"
+
+// How long udev gets to create the event node of a new device
+#define UIDEV_NODE_WAIT_MS  2000
+
+// Events queued before they are flushed with a single write()
+#define UIDEV_QUEUE_MAX 128
+
+struct uidev
+{
+    int                 fd;
+    bool                created;
+    struct uinput_setup setup;
+    size_t              queue_num;
+    struct input_event  queue[UIDEV_QUEUE_MAX];
+};
+
+///////////////////////////////////////////////////////////////////////////////
+//
+// Setup Functions
+//
+///////////////////////////////////////////////////////////////////////////////
+
+uidev_t *uidev_init(const char *name, const evdev_id_t *id)
+{
+    uidev_t *dev = xalloc(sizeof(uidev_t));
+
+    dev->fd = open(UINPUT_FILE, O_WRONLY | O_NONBLOCK);
+    if (dev->fd < 0)
+        xerr("%s", UINPUT_FILE);
+
+    strncpy(dev->setup.name, name, sizeof(dev->setup.name) - 1);
+    dev->setup.id.bustype = id->bus;
+    dev->setup.id.vendor  = id->vendor;
+    dev->setup.id.product = id->product;
+    dev->setup.id.version = 1;
+
+    // Source timestamps are forwarded as MSC_TIMESTAMP since the kernel
+    // stamps injected events with the time they are written
+    xioctl(dev->fd, UI_SET_EVBIT, (void *)EV_MSC);
+    xioctl(dev->fd, UI_SET_MSCBIT, (void *)MSC_TIMESTAMP);
+
+    return dev;
+}
+
+void uidev_abs_add(uidev_t *dev, evabs_id_t id, const evcal_t *cal)
+{
+    ASSERT(!dev->created);
+
+    struct uinput_abs_setup abs = {
+        .code = id,
+        .absinfo = {
+            .minimum = cal->min,
+            .maximum = cal->max,
+            .fuzz    = cal->fuzz,
+            .flat    = cal->flat,
+        },
+    };
+
+    xioctl(dev->fd, UI_SET_EVBIT, (void *)EV_ABS);
+    xioctl(dev->fd, UI_SET_ABSBIT, (void *)(uintptr_t)id);
+    xioctl(dev->fd, UI_ABS_SETUP, &abs);
+}
+
+void uidev_key_add(uidev_t *dev, evkey_id_t id)
+{
+    ASSERT(!dev->created);
+
+    xioctl(dev->fd, UI_SET_EVBIT, (void *)EV_KEY);
+    xioctl(dev->fd, UI_SET_KEYBIT, (void *)(uintptr_t)id);
+}
+
+void uidev_create(uidev_t *dev)
+{
+    xioctl(dev->fd, UI_DEV_SETUP, &dev->setup);
+    xioctl(dev->fd, UI_DEV_CREATE, NULL);
+    dev->created = true;
+}
+
+void uidev_free(uidev_t *dev)
+{
+    if (dev->fd > 0)
+    {
+        if (dev->created)
+            ioctl(dev->fd, UI_DEV_DESTROY);
+        close(dev->fd);
+    }
+    xfree(dev);
+}
+
+int uidev_fileno(uidev_t *dev)
+{
+    return dev->fd;
+}
+
+static char *uidev_node(uidev_t *dev)
+{
+    char sysname[64];
+    if (ioctl(dev->fd, UI_GET_SYSNAME(sizeof(sysname)), sysname) < 0)
+        xerr("UI_GET_SYSNAME");
+
+    char dir_name[PATH_MAX];
+    xsnprintf(dir_name, sizeof(dir_name), "%s/%s", SYS_INPUT, sysname);
+
+    DIR *dir = opendir(dir_name);
+    if (!dir)
+        return NULL;
+
+    char *file = NULL;
+    struct dirent *dent;
+    while (!file && (dent = readdir(dir)) != NULL)
+    {
+        int num;
+        if (sscanf(dent->d_name, "event%d", &num) == 1)
+            xasprintf(&file, "/dev/input/event%d", num);
+    }
+
+    closedir(dir);
+
+    return file;
+}
+
+// The event device file of a created device, once udev has made it usable
+char *uidev_evdev(uidev_t *dev)
+{
+    ASSERT(dev->created);
+
+    struct timespec delay = { .tv_nsec = 1000000 };
+    for (int ms = 0; ms < UIDEV_NODE_WAIT_MS; ms++)
+    {
+        char *file = uidev_node(dev);
+        if (file && access(file, R_OK | W_OK) == 0)
+            return file;
+
+        xfree(file);
+        nanosleep(&delay, NULL);
+    }
+
+    xerrx("%s: event device was not created", dev->setup.name);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+//
+// Event Functions
+//
+///////////////////////////////////////////////////////////////////////////////
+
+static void uidev_flush(uidev_t *dev)
+{
+    size_t len = dev->queue_num * sizeof(dev->queue[0]);
+
+    dev->queue_num = 0;
+
+    TRACE_BEGIN("uidev_write");
+    if (write(dev->fd, dev->queue, len) != len)
+        xerr("uinput write");
+    TRACE_END("uidev_write");
+}
+
+static void uidev_queue(uidev_t *dev, int type, int code, int value)
+{
+    ASSERT(dev->created);
+
+    if (dev->queue_num == UIDEV_QUEUE_MAX)
+        uidev_flush(dev);
+
+    struct input_event *ev = &dev->queue[dev->queue_num++];
+    ev->type  = type;
+    ev->code  = code;
+    ev->value = value;
+}
+
+void uidev_abs(uidev_t *dev, evabs_id_t id, int value)
+{
+    uidev_queue(dev, EV_ABS, id, value);
+}
+
+void uidev_key(uidev_t *dev, evkey_id_t id, bool value)
+{
+    uidev_queue(dev, EV_KEY, id, value);
+}
+
+void uidev_syn(uidev_t *dev, evtime_t time)
+{
+    // MSC_TIMESTAMP is a free running 32-bit microsecond counter
+    uidev_queue(dev, EV_MSC, MSC_TIMESTAMP, (int)(uint32_t)time);
+    uidev_queue(dev, EV_SYN, SYN_REPORT, 0);
+    uidev_flush(dev);
+}
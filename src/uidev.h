@@ -0,0 +1,45 @@
+//  evjs - Evdev Joystick Utilities
+//  Copyright (C) 2020 Scott Shumate <scott@shumatech.com>
+//
+//  This program is free software: you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation, either version 3 of the License, or
+//  (at your option) any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+#pragma once
+
+#include <stdlib.h>
+#include <stdbool.h>
+
+#include "evdev.h"
+
+typedef struct uidev uidev_t;
+
+///////////////////////////////////////////////////////////////////////////////
+//
+// Setup Functions
+//
+///////////////////////////////////////////////////////////////////////////////
+uidev_t *uidev_init(const char *name, const evdev_id_t *id);
+void uidev_abs_add(uidev_t *dev, evabs_id_t id, const evcal_t *cal);
+void uidev_key_add(uidev_t *dev, evkey_id_t id);
+void uidev_create(uidev_t *dev);
+void uidev_free(uidev_t *dev);
+int uidev_fileno(uidev_t *dev);
+char *uidev_evdev(uidev_t *dev);
+
+///////////////////////////////////////////////////////////////////////////////
+//
+// Event Functions
+//
+///////////////////////////////////////////////////////////////////////////////
+void uidev_abs(uidev_t *dev, evabs_id_t id, int value);
+void uidev_key(uidev_t *dev, evkey_id_t id, bool value);
+void uidev_syn(uidev_t *dev, evtime_t time);
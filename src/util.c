@@ -21,6 +21,7 @@
 #include <unistd.h>
 #include <string.h>
 #include <err.h>
+#include <time.h>
 #include <limits.h>
 #include <sys/ioctl.h>
 #include <sys/types.h>
@@ -28,8 +29,10 @@
 
 #include "config.h"
 #include "util.h"
+#include "trace.h"
 
 #define ERR_STATUS          1
+#define ARENA_BLOCK_MIN     4096
 
 static exit_callback_t exit_callback;
 static void *exit_arg;
@@ -75,6 +78,14 @@ void *xalloc(size_t len)
     return ptr;
 }
 
+void *xrealloc(void *ptr, size_t len)
+{
+    ptr = realloc(ptr, len);
+    if (!ptr)
+        xerrx("memory allocation failed");
+    return ptr;
+}
+
 char *xstrdup(const char *str)
 {
     char *dup = strdup(str);
@@ -119,7 +130,9 @@ int xioctl(int fd, int request, ...)
     void *arg = va_arg(ap, void*);
     va_end(ap);
 
+    TRACE_BEGIN_ARG("ioctl", request);
     int rc = ioctl(fd, request, arg);
+    TRACE_END("ioctl");
     if (rc == -1) {
         if (exit_callback)
             exit_callback(exit_arg);
@@ -161,3 +174,154 @@ char *config_path(const char *file)
 
     return path;
 }
+
+uint64_t now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t) ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+static int compare_u64(const void *a, const void *b)
+{
+    uint64_t x = *(const uint64_t *) a;
+    uint64_t y = *(const uint64_t *) b;
+    return (x > y) - (x < y);
+}
+
+static int compare_i64(const void *a, const void *b)
+{
+    int64_t x = *(const int64_t *) a;
+    int64_t y = *(const int64_t *) b;
+    return (x > y) - (x < y);
+}
+
+static int compare_double(const void *a, const void *b)
+{
+    double x = *(const double *) a;
+    double y = *(const double *) b;
+    return (x > y) - (x < y);
+}
+
+void sort_u64(uint64_t *array, size_t num)
+{
+    qsort(array, num, sizeof(*array), compare_u64);
+}
+
+void sort_i64(int64_t *array, size_t num)
+{
+    qsort(array, num, sizeof(*array), compare_i64);
+}
+
+void sort_double(double *array, size_t num)
+{
+    qsort(array, num, sizeof(*array), compare_double);
+}
+
+size_t percentile(size_t num, double pct)
+{
+    ASSERT(num > 0);
+    size_t index = num * pct / 100;
+    return index < num ? index : num - 1;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+//
+// Arena Functions
+//
+///////////////////////////////////////////////////////////////////////////////
+
+struct arena_block
+{
+    arena_block_t *prev;
+    char          *next;
+    char          *end;
+};
+
+struct arena
+{
+    arena_block_t *block;
+    size_t        size;
+};
+
+#define ARENA_HEADER        ARENA_SIZE(sizeof(arena_t))
+#define ARENA_BLOCK_HEADER  ARENA_SIZE(sizeof(arena_block_t))
+
+static void arena_block_init(arena_block_t *block, arena_block_t *prev, size_t size)
+{
+    block->prev = prev;
+    block->next = (char *) block + ARENA_BLOCK_HEADER;
+    block->end  = block->next + size;
+}
+
+arena_t *arena_init(size_t size)
+{
+    size = ARENA_SIZE(size);
+
+    arena_t *arena = xalloc(ARENA_HEADER + ARENA_BLOCK_HEADER + size);
+    arena->block = (arena_block_t *) ((char *) arena + ARENA_HEADER);
+    arena->size = size;
+    arena_block_init(arena->block, NULL, size);
+
+    return arena;
+}
+
+void *arena_alloc(arena_t *arena, size_t len)
+{
+    len = ARENA_SIZE(len);
+
+    arena_block_t *block = arena->block;
+    if (len > (size_t) (block->end - block->next))
+    {
+        // Chained blocks grow with the arena so a bad guess stays cheap
+        size_t size = arena->size;
+        if (size < ARENA_BLOCK_MIN)
+            size = ARENA_BLOCK_MIN;
+        if (size < len)
+            size = len;
+
+        block = xalloc(ARENA_BLOCK_HEADER + size);
+        arena_block_init(block, arena->block, size);
+        arena->block = block;
+        arena->size += size;
+    }
+
+    void *ptr = block->next;
+    block->next += len;
+
+    // Memory given back by arena_reset() is no longer zero
+    memset(ptr, 0, len);
+
+    return ptr;
+}
+
+arena_mark_t arena_mark(arena_t *arena)
+{
+    return (arena_mark_t) { .block = arena->block, .next = arena->block->next };
+}
+
+void arena_reset(arena_t *arena, arena_mark_t mark)
+{
+    while (arena->block != mark.block)
+    {
+        arena_block_t *prev = arena->block->prev;
+        ASSERT(prev != NULL);
+        arena->size -= arena->block->end - ((char *) arena->block + ARENA_BLOCK_HEADER);
+        xfree(arena->block);
+        arena->block = prev;
+    }
+
+    arena->block->next = mark.next;
+}
+
+void arena_free(arena_t *arena)
+{
+    while (arena->block->prev)
+    {
+        arena_block_t *prev = arena->block->prev;
+        xfree(arena->block);
+        arena->block = prev;
+    }
+
+    xfree(arena);
+}
@@ -16,6 +16,8 @@
 #pragma once
 
 #include <stdlib.h>
+#include <stddef.h>
+#include <stdint.h>
 #include <assert.h>
 
 #define ASSERT(exp) assert(exp)
@@ -24,12 +26,14 @@ typedef void(*exit_callback_t)(void *arg);
 
 void xon_exit(exit_callback_t callback, void *arg);
 
-void xerr(const char *fmt, ...) __attribute__ ((format(printf, 1, 2)));
+void xerr(const char *fmt, ...) __attribute__ ((format(printf, 1, 2), noreturn));
 
-void xerrx(const char *fmt, ...) __attribute__ ((format(printf, 1, 2)));
+void xerrx(const char *fmt, ...) __attribute__ ((format(printf, 1, 2), noreturn));
 
 void *xalloc(size_t len);
 
+void *xrealloc(void *ptr, size_t len);
+
 char *xstrdup(const char *str);
 
 void xasprintf(char **strp, const char *fmt, ...) __attribute__ ((format(printf, 2, 3)));
@@ -41,3 +45,44 @@ void xfree(void *ptr);
 int xioctl(int fd, int request, ...);
 
 char *config_path(const char *file);
+
+// Nanoseconds on the monotonic clock, for timing and pacing
+uint64_t now_ns(void);
+
+void sort_u64(uint64_t *array, size_t num);
+
+void sort_i64(int64_t *array, size_t num);
+
+void sort_double(double *array, size_t num);
+
+// The index of the PCT percentile in a sorted array of NUM entries
+size_t percentile(size_t num, double pct);
+
+// An arena hands out zeroed memory from blocks that are only returned to the
+// system all at once.  The first block is part of the arena allocation so an
+// arena given enough space up front is a single allocation; when it runs out
+// another block is chained on.  A mark taken with arena_mark() is a scope
+// that arena_reset() rolls back to, releasing everything allocated after it.
+typedef struct arena arena_t;
+typedef struct arena_block arena_block_t;
+
+typedef struct arena_mark
+{
+    arena_block_t *block;
+    char          *next;
+} arena_mark_t;
+
+#define ARENA_ALIGN         _Alignof(max_align_t)
+
+// The space an allocation of LEN takes in an arena, for sizing arena_init()
+#define ARENA_SIZE(len)     (((len) + ARENA_ALIGN - 1) & ~(ARENA_ALIGN - 1))
+
+arena_t *arena_init(size_t size);
+
+void *arena_alloc(arena_t *arena, size_t len);
+
+arena_mark_t arena_mark(arena_t *arena);
+
+void arena_reset(arena_t *arena, arena_mark_t mark);
+
+void arena_free(arena_t *arena);
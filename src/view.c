@@ -21,9 +21,12 @@
 #include <signal.h>
 #include <string.h>
 #include <limits.h>
+#include <time.h>
 #include <ncurses.h>
 
 #include "util.h"
+#include "trace.h"
+#include "barray.h"
 #include "view.h"
 #include "device.h"
 
@@ -51,38 +54,348 @@
 #define STATUS_Y            0
 #define STATUS_H            1
 
-struct view
+#define STATS_W             36
+#define STATS_MIN_X         80
+
+#define SCOPE_X             (LABEL_X + LABEL_W + 2)
+#define SCOPE_SPAN_DEFAULT  2000000
+#define SCOPE_SPAN_MIN      250000
+#define SCOPE_SPAN_MAX      16000000
+
+// Dashboard panes drop the calibration row and draw buttons as a strip
+#define COMPACT_AXIS_H      2
+#define COMPACT_BUTTON_W    4
+#define COMPACT_PANE_H      5
+#define COMPACT_PANE_W      60
+
+typedef struct axis_cell
+{
+    int         x;
+    int         max_x;
+    int         max_ch;
+    int         min_x;
+    int         min_ch;
+    char        value[VALUE_W + 8];
+} axis_cell_t;
+
+typedef struct scope_col
+{
+    evtime_t    bucket;
+    int         min;
+    int         max;
+    int         last;
+    int         value;
+    int         count;
+} scope_col_t;
+
+typedef struct pane
 {
+    view_t      *view;
     device_t    *dev;
-    WINDOW      *info_win;
     WINDOW      *axis_box;
     WINDOW      *axis_win;
     axis_t      *axis_select;
     axis_t      *axis_scroll;
     int          axis_rows;
+    int          axis_h;
     WINDOW      *button_box;
     WINDOW      *button_win;
+#if ENABLE_EFFECTS
+    effect_t    *effect_select;
+#endif
+    bool        cursors;
+    barray_t    *axis_dirty;
+    axis_cell_t *axis_cells;
+    barray_t    *button_dirty;
+    evstats_t   stats_prev;
+} pane_t;
+
+typedef struct view_stats
+{
+    double      events;
+    double      reports;
+    double      reads;
+    double      redraws;
+    double      bytes;
+    uint64_t    dropped;
+    evtime_t    latency;
+} view_stats_t;
+
+struct view
+{
+    pane_t      *pane_array;
+    size_t      pane_num;
+    pane_t      *pane;
+    bool        compact;
+    WINDOW      *info_win;
 #if ENABLE_EFFECTS
     WINDOW      *effect_box;
     WINDOW      *effect_win;
-    effect_t    *effect_select;
 #endif
     WINDOW      *status_win;
-    bool        cursors;
     const char  *db_file;
+    bool        dirty;
+    bool        scope;
+    axis_t      *scope_axis;
+    evtime_t    scope_span;
+    evtime_t    scope_bucket;
+    scope_col_t *scope_cols;
+    int         scope_w;
+    size_t      scope_head;
+    uint64_t    term_bytes;
+    uint64_t    term_bytes_prev;
+    uint64_t    frames;
+    uint64_t    frames_prev;
+    uint64_t    stats_time;
+    view_stats_t stats;
 };
 
+#define PANE_FOREACH(view, pane)    for (pane_t *pane = view->pane_array;\
+                                         pane < view->pane_array + view->pane_num; pane++)
+
 static bool resize;
 
+static void view_refresh(view_t *view);
+
+static pane_t *view_axis_pane(view_t *view, axis_t *axis)
+{
+    PANE_FOREACH(view, pane)
+    {
+        device_t *dev = pane->dev;
+        if (axis >= dev->axis_array && axis < dev->axis_array + dev->axis_num)
+            return pane;
+    }
+
+    return view->pane;
+}
+
+static pane_t *view_button_pane(view_t *view, button_t *button)
+{
+    PANE_FOREACH(view, pane)
+    {
+        device_t *dev = pane->dev;
+        if (button >= dev->button_array && button < dev->button_array + dev->button_num)
+            return pane;
+    }
+
+    return view->pane;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+//
+// Scope Window Functions
+//
+///////////////////////////////////////////////////////////////////////////////
+
+static int view_scope_y(axis_t *axis, int rows, int value)
+{
+    int range = axis->cal.max - axis->cal.min;
+    if (range <= 0)
+        range = 1;
+
+    if (value >= axis->cal.max)
+        return 1;
+    else if (value <= axis->cal.min)
+        return rows;
+    else
+        return 1 + (rows - 1) * (axis->cal.max - value) / range;
+}
+
+// Only the axis in the scope keeps a history of its samples, so the ring
+// is allocated when an axis is shown and freed when it no longer is
+static void view_scope_axis(view_t *view, axis_t *axis)
+{
+    if (view->scope_axis == axis)
+        return;
+
+    if (view->scope_axis)
+    {
+        xfree(view->scope_axis->ring);
+        view->scope_axis->ring = NULL;
+    }
+
+    if (axis)
+        axis->ring = xalloc(sizeof(axis_ring_t));
+
+    view->scope_axis = axis;
+}
+
+static void view_scope_reset(view_t *view)
+{
+    WINDOW *w = view->pane->axis_win;
+    axis_t *axis = view->pane->axis_select;
+
+    view_scope_axis(view, axis);
+
+    view->scope_w = getmaxx(w) - SCOPE_X - 1;
+    if (view->scope_w < 1)
+        view->scope_w = 1;
+
+    xfree(view->scope_cols);
+    view->scope_cols = xalloc(sizeof(scope_col_t) * view->scope_w);
+
+    view->scope_bucket = view->scope_span / view->scope_w;
+    if (view->scope_bucket == 0)
+        view->scope_bucket = 1;
+
+    // Replay whatever the ring still holds into the new columns
+    size_t head = axis->ring->head;
+    view->scope_head = head > AXIS_RING_SIZE ? head - AXIS_RING_SIZE : 0;
+}
+
+static void view_scope_update(view_t *view)
+{
+    axis_ring_t *ring = view->pane->axis_select->ring;
+    size_t head = ring->head;
+
+    // Samples older than the ring size have already been overwritten
+    if (head - view->scope_head > AXIS_RING_SIZE)
+        view->scope_head = head - AXIS_RING_SIZE;
+
+    for (size_t n = view->scope_head; n < head; n++)
+    {
+        sample_t *sample = AXIS_RING_SAMPLE(ring, n);
+        evtime_t bucket = sample->time / view->scope_bucket;
+        scope_col_t *col = &view->scope_cols[bucket % view->scope_w];
+
+        if (col->count == 0 || col->bucket != bucket)
+        {
+            col->bucket = bucket;
+            col->min = sample->raw;
+            col->max = sample->raw;
+            col->count = 0;
+        }
+        else if (sample->raw < col->min)
+            col->min = sample->raw;
+        else if (sample->raw > col->max)
+            col->max = sample->raw;
+
+        col->last = sample->raw;
+        col->value = sample->value;
+        col->count++;
+    }
+
+    view->scope_head = head;
+}
+
+static void view_scope_draw(view_t *view)
+{
+    WINDOW *w = view->pane->axis_win;
+    axis_t *axis = view->pane->axis_select;
+    int rows = getmaxy(w) - 1;
+
+    if (view->scope_axis != axis)
+        view_scope_reset(view);
+    view_scope_update(view);
+
+    // Each column is one time bucket ending with the latest device event.
+    // Empty buckets hold the last value dotted so dropouts stand out.
+    evtime_t now = evdev_time(view->pane->dev->evdev) / view->scope_bucket;
+    bool filtered = axis->filter.type != FILTER_NONE;
+    bool held = false;
+    int last = 0;
+    int samples = 0;
+
+    for (int x = 0; x < view->scope_w; x++)
+    {
+        evtime_t bucket = now - (view->scope_w - 1 - x);
+        scope_col_t *col = &view->scope_cols[bucket % view->scope_w];
+        int top = 0, bottom = -1, mark = 0, ch = ' ';
+
+        if (col->count > 0 && col->bucket == bucket)
+        {
+            top = view_scope_y(axis, rows, col->max);
+            bottom = view_scope_y(axis, rows, col->min);
+            if (filtered)
+                mark = view_scope_y(axis, rows, col->value);
+            ch = ACS_CKBOARD;
+            last = col->last;
+            held = true;
+            samples += col->count;
+        }
+        else if (held)
+        {
+            top = bottom = view_scope_y(axis, rows, last);
+            ch = '.';
+        }
+
+        for (int y = 1; y <= rows; y++)
+        {
+            if (y == mark)
+                mvwaddch(w, y, SCOPE_X + x, '*');
+            else if (y >= top && y <= bottom)
+                mvwaddch(w, y, SCOPE_X + x, ch);
+            else
+                mvwaddch(w, y, SCOPE_X + x, ' ');
+        }
+    }
+
+    unsigned rate = (uint64_t) samples * 1000000 / view->scope_span;
+    if (mvwprintw(w, 0, SCOPE_X, "Span:%u.%02us Rate:%uHz Value:%d",
+        (unsigned) (view->scope_span / 1000000),
+        (unsigned) (view->scope_span % 1000000 / 10000),
+        rate, axis->value) == OK)
+        wclrtoeol(w);
+}
+
+static void view_scope_refresh(view_t *view)
+{
+    WINDOW *w = view->pane->axis_win;
+    axis_t *axis = view->pane->axis_select;
+    int rows = getmaxy(w) - 1;
+
+    werase(w);
+
+    view_scope_reset(view);
+
+    wattron(w, A_UNDERLINE);
+    mvwprintw(w, (rows + 1) / 2, LABEL_X, "%*s", LABEL_W, axis->name);
+    wattroff(w, A_UNDERLINE);
+    mvwprintw(w, 1, LABEL_X, "%*d", LABEL_W, axis->cal.max);
+    mvwprintw(w, rows, LABEL_X, "%*d", LABEL_W, axis->cal.min);
+    mvwvline(w, 1, SCOPE_X - 1, ACS_VLINE, rows);
+
+    view_scope_draw(view);
+
+    wnoutrefresh(w);
+}
+
+bool view_scope_get(view_t *view)
+{
+    return view->scope;
+}
+
+void view_scope_set(view_t *view, bool enable)
+{
+    if (!enable)
+        view_scope_axis(view, NULL);
+
+    view->scope = enable;
+    view_refresh(view);
+}
+
+void view_scope_zoom(view_t *view, int dir)
+{
+    if (dir > 0 && view->scope_span > SCOPE_SPAN_MIN)
+        view->scope_span /= 2;
+    else if (dir < 0 && view->scope_span < SCOPE_SPAN_MAX)
+        view->scope_span *= 2;
+    else
+        return;
+
+    if (view->scope)
+        view_scope_refresh(view);
+}
+
 ///////////////////////////////////////////////////////////////////////////////
 //
 // Axis Window Functions
 //
 ///////////////////////////////////////////////////////////////////////////////
 
-static int view_axis_graph_x(view_t *view, axis_t *axis, int value)
+static int view_axis_graph_x(pane_t *pane, axis_t *axis, int value)
 {
-    WINDOW *w = view->axis_win;
+    WINDOW *w = pane->axis_win;
 
     if (value <= axis->cal.min)
         return GRAPH_X + 1;
@@ -93,67 +406,111 @@ static int view_axis_graph_x(view_t *view, axis_t *axis, int value)
             (axis->cal.max - axis->cal.min);
 }
 
-void view_axis_value(view_t *view, axis_t *axis, int value)
+static void view_axis_draw(view_t *view, pane_t *pane, axis_t *axis)
 {
-    WINDOW *w = view->axis_win;
+    WINDOW *w = pane->axis_win;
+    axis_cell_t *cell = &pane->axis_cells[axis->index];
 
-    axis_t *last = view->axis_scroll + view->axis_rows;
-    if (axis < view->axis_scroll || axis >= last)
+    axis_t *last = pane->axis_scroll + pane->axis_rows;
+    if (!w || view->scope || axis < pane->axis_scroll || axis >= last)
         return;
 
-    int y = (axis->index - view->axis_scroll->index) * AXIS_H;
+    int y = (axis->index - pane->axis_scroll->index) * pane->axis_h;
 
-    int x = view_axis_graph_x(view, axis, axis->value);
+    int x = view_axis_graph_x(pane, axis, axis->value);
 
-    wattron(w, A_REVERSE);
-    mvwprintw(w, y + 1, GRAPH_X + 1, "%*s", x - GRAPH_X - 1, "");
-    wattroff(w, A_REVERSE);
+    // Only the columns between the old and the new end of the bar change
+    if (cell->x == 0)
+    {
+        wattron(w, A_REVERSE);
+        mvwprintw(w, y + 1, GRAPH_X + 1, "%*s", x - GRAPH_X - 1, "");
+        wattroff(w, A_REVERSE);
 
-    mvwprintw(w, y + 1, x, "%*s", GRAPH_X + GRAPH_W - x - 1, "");
+        mvwprintw(w, y + 1, x, "%*s", GRAPH_X + GRAPH_W - x - 1, "");
 
-    if (wmove(w, y, GRAPH_X) == OK)
-        wclrtoeol(w);
+        if (wmove(w, y, GRAPH_X) == OK)
+            wclrtoeol(w);
+    }
+    else if (x > cell->x)
+    {
+        wattron(w, A_REVERSE);
+        mvwprintw(w, y + 1, cell->x, "%*s", x - cell->x, "");
+        wattroff(w, A_REVERSE);
+    }
+    else if (x < cell->x)
+    {
+        mvwprintw(w, y + 1, x, "%*s", cell->x - x, "");
+    }
+    cell->x = x;
 
-    if (view->cursors)
+    int max_x = 0, max_ch = 0;
+    int min_x = 0, min_ch = 0;
+    if (pane->cursors)
     {
-        int max_x = view_axis_graph_x(view, axis, axis->maximum);
-        int min_x = view_axis_graph_x(view, axis, axis->minimum) - 1;
+        max_x = view_axis_graph_x(pane, axis, axis->maximum);
+        min_x = view_axis_graph_x(pane, axis, axis->minimum) - 1;
 
-        int max_ch;
         if (axis->maximum <= axis->cal.max)
             max_ch = '<';
         else
             max_ch = '>';
-        mvwaddch(w, y, max_x, max_ch);
 
-        int min_ch;
         if (axis->minimum >= axis->cal.min)
             min_ch = '>';
         else
             min_ch = '<';
+    }
+
+    // The cursors never share a column so erase the stale ones first
+    bool max_moved = (max_x != cell->max_x || max_ch != cell->max_ch);
+    bool min_moved = (min_x != cell->min_x || min_ch != cell->min_ch);
+
+    if (max_moved && cell->max_ch)
+        mvwaddch(w, y, cell->max_x, ' ');
+    if (min_moved && cell->min_ch)
+        mvwaddch(w, y, cell->min_x, ' ');
+    if (max_moved && max_ch)
+        mvwaddch(w, y, max_x, max_ch);
+    if (min_moved && min_ch)
         mvwaddch(w, y, min_x, min_ch);
+
+    cell->max_x = max_x;
+    cell->max_ch = max_ch;
+    cell->min_x = min_x;
+    cell->min_ch = min_ch;
+
+    char value[sizeof(cell->value)];
+    snprintf(value, sizeof(value), "%-*d", VALUE_W, axis->value);
+    if (strcmp(value, cell->value) != 0)
+    {
+        if (mvwaddstr(w, y + 1, VALUE_X, value) == OK)
+            wclrtoeol(w);
+        strcpy(cell->value, value);
     }
+}
 
-    if (mvwprintw(w, y + 1, VALUE_X, "%-*d", VALUE_W, axis->value) == OK)
-        wclrtoeol(w);
+void view_axis_value(view_t *view, axis_t *axis, int value)
+{
+    pane_t *pane = view_axis_pane(view, axis);
 
-    wrefresh(w);
+    barray_set(pane->axis_dirty, axis->index);
+    view->dirty = true;
 }
 
-static void view_axis_scrollbar(view_t *view)
+static void view_axis_scrollbar(pane_t *pane)
 {
-    WINDOW *w = view->axis_box;
+    WINDOW *w = pane->axis_box;
     int x = getmaxx(w) - 1;
     int y = 1;
-    int h = getmaxy(w) - 2;
+    int h = getmaxy(pane->axis_win);
 
     // Draw the scrollbar if any axes are hidden
-    if (view->axis_rows < view->dev->axis_num)
+    if (pane->axis_rows < pane->dev->axis_num)
     {
         for (y = 1; y <= h; y++)
             mvwaddch(w, y, x, ACS_CKBOARD);
 
-        y = 1 + (getmaxy(w) - 3) * view->axis_scroll->index / (view->dev->axis_num - view->axis_rows);
+        y = 1 + (h - 1) * pane->axis_scroll->index / (pane->dev->axis_num - pane->axis_rows);
         mvwaddch(w, y, x, ACS_BLOCK);
     }
     else
@@ -161,162 +518,281 @@ static void view_axis_scrollbar(view_t *view)
         mvwvline(w, y, x, ACS_VLINE, h);
     }
 
-    wrefresh(w);
+    wnoutrefresh(w);
 }
 
-static void view_axis_select(view_t *view, axis_t *axis)
+static void view_axis_pane_refresh(view_t *view, pane_t *pane);
+
+static void view_axis_select(view_t *view, pane_t *pane, axis_t *axis)
 {
-    WINDOW *w = view->axis_win;
+    WINDOW *w = pane->axis_win;
+
+    axis_t *prev = pane->axis_select;
+    pane->axis_select = axis;
 
-    axis_t *prev = view->axis_select;
-    view->axis_select = axis;
+    if (view->scope)
+    {
+        view_scope_refresh(view);
+        return;
+    }
 
-    if (axis < view->axis_scroll)
+    if (axis < pane->axis_scroll)
     {
-        view->axis_scroll = axis;
-        view_axis_refresh(view);
+        pane->axis_scroll = axis;
+        view_axis_pane_refresh(view, pane);
         return;
     }
 
-    axis_t *last = view->axis_scroll + view->axis_rows;
+    axis_t *last = pane->axis_scroll + pane->axis_rows;
     if (axis >= last)
     {
-        view->axis_scroll = axis - view->axis_rows + 1;
-        view_axis_refresh(view);
+        pane->axis_scroll = axis - pane->axis_rows + 1;
+        view_axis_pane_refresh(view, pane);
         return;
     }
 
     int y;
-    if (prev >= view->axis_scroll && prev < last)
+    if (prev >= pane->axis_scroll && prev < last)
     {
-        y = (prev->index - view->axis_scroll->index) * AXIS_H;
+        y = (prev->index - pane->axis_scroll->index) * pane->axis_h;
         mvwprintw(w, y + 1, LABEL_X, "%*s", LABEL_W, prev->name);
     }
 
-    y = (axis->index - view->axis_scroll->index) * AXIS_H;
+    y = (axis->index - pane->axis_scroll->index) * pane->axis_h;
     size_t len = strlen(axis->name);
     wattron(w, A_UNDERLINE);
     mvwprintw(w, y + 1, LABEL_X + LABEL_W - len, "%s", axis->name);
     wattroff(w, A_UNDERLINE);
 
-    wrefresh(w);
+    // Compact panes only show the calibration of the selected axis
+    if (view->compact)
+        view_axis_calibration(view, axis);
+
+    wnoutrefresh(w);
 }
 
-void view_axis_refresh(view_t *view)
+static void view_axis_pane_refresh(view_t *view, pane_t *pane)
 {
-    WINDOW *w = view->axis_win;
+    WINDOW *w = pane->axis_win;
+
+    if (!w)
+        return;
+
+    if (view->scope)
+    {
+        view_scope_refresh(view);
+        return;
+    }
 
     werase(w);
+    memset(pane->axis_cells, 0, sizeof(axis_cell_t) * pane->dev->axis_num);
+
+    if (view->compact)
+        pane->axis_rows = getmaxy(w) / pane->axis_h;
+    else
+        pane->axis_rows = (getmaxy(w) - 1) / pane->axis_h;
+    if (pane->axis_rows > pane->dev->axis_num)
+        pane->axis_rows = pane->dev->axis_num;
+    if (pane->axis_rows < 1)
+        pane->axis_rows = 1;
 
-    view->axis_rows = (getmaxy(w) - 1) / AXIS_H;
-    axis_t *last = view->axis_scroll + view->axis_rows;
+    axis_t *last = pane->axis_scroll + pane->axis_rows;
 
     // If the selection is below the scroll area then shift the scroll area to fit
-    if (view->axis_select >= last)
+    if (pane->axis_select >= last)
     {
-        view->axis_scroll = view->axis_select - view->axis_rows + 1;
-        last = view->axis_scroll + view->axis_rows;
+        pane->axis_scroll = pane->axis_select - pane->axis_rows + 1;
+        last = pane->axis_scroll + pane->axis_rows;
     }
 
     // If the scroll area extends below the end then shift the scroll area to fit
-    axis_t *end = view->dev->axis_array + view->dev->axis_num;
-    if (view->axis_scroll + view->axis_rows >= end)
+    axis_t *end = pane->dev->axis_array + pane->dev->axis_num;
+    if (pane->axis_scroll + pane->axis_rows >= end)
     {
-        view->axis_scroll = end - view->axis_rows;
-        last = view->axis_scroll + view->axis_rows;
+        pane->axis_scroll = end - pane->axis_rows;
+        last = pane->axis_scroll + pane->axis_rows;
     }
 
     // Draw all visible axes
     int y = 0;
-    for (axis_t *axis = view->axis_scroll; axis < last; axis++)
+    for (axis_t *axis = pane->axis_scroll; axis < last; axis++)
     {
         mvwprintw(w, y + 1, LABEL_X, "%*s", LABEL_W, axis->name);
 
         mvwaddch(w, y + 1, GRAPH_X, '[');
         mvwaddch(w, y + 1, GRAPH_X + GRAPH_W - 1, ']');
 
-        view_axis_value(view, axis, axis->value);
+        view_axis_draw(view, pane, axis);
 
-        view_axis_calibration(view, axis);
+        if (!view->compact)
+            view_axis_calibration(view, axis);
 
-        y += AXIS_H;
+        y += pane->axis_h;
     }
 
     // Update the selection indicator
-    view_axis_select(view, view->axis_select);
+    view_axis_select(view, pane, pane->axis_select);
 
     // Update the scrollbar
-    view_axis_scrollbar(view);
+    view_axis_scrollbar(pane);
 
-    wrefresh(w);
+    wnoutrefresh(w);
+}
+
+void view_axis_refresh(view_t *view)
+{
+    PANE_FOREACH(view, pane)
+        view_axis_pane_refresh(view, pane);
 }
 
 axis_t *view_axis_get(view_t *view)
 {
-    return view->axis_select;
+    return view->pane->axis_select;
 }
 
 void view_axis_prev(view_t *view)
 {
-    device_t *dev = view->dev;
-    axis_t *axis = view->axis_select - 1;
-    if (axis >= dev->axis_array)
-        view_axis_select(view, axis);
+    pane_t *pane = view->pane;
+    axis_t *axis = pane->axis_select - 1;
+    if (axis >= pane->dev->axis_array)
+        view_axis_select(view, pane, axis);
 }
 
 void view_axis_next(view_t *view)
 {
-    device_t *dev = view->dev;
-    axis_t *axis = view->axis_select + 1;
+    pane_t *pane = view->pane;
+    device_t *dev = pane->dev;
+    axis_t *axis = pane->axis_select + 1;
     if (axis < &dev->axis_array[dev->axis_num])
-        view_axis_select(view, axis);
+        view_axis_select(view, pane, axis);
 }
 
 void view_axis_pageup(view_t *view)
 {
-    device_t *dev = view->dev;
-    axis_t *axis = view->axis_select - view->axis_rows;
+    pane_t *pane = view->pane;
+    device_t *dev = pane->dev;
+    axis_t *axis = pane->axis_select - pane->axis_rows;
     if (axis < dev->axis_array)
         axis = dev->axis_array;
-    view_axis_select(view, axis);
+    view_axis_select(view, pane, axis);
 }
 
 void view_axis_pagedn(view_t *view)
 {
-    device_t *dev = view->dev;
-    axis_t *axis = view->axis_select + view->axis_rows;
+    pane_t *pane = view->pane;
+    device_t *dev = pane->dev;
+    axis_t *axis = pane->axis_select + pane->axis_rows;
     if (axis >= &dev->axis_array[dev->axis_num])
         axis = &dev->axis_array[dev->axis_num - 1];
-    view_axis_select(view, axis);
+    view_axis_select(view, pane, axis);
 }
 
 bool view_axis_cursors_get(view_t *view)
 {
-    return view->cursors;
+    return view->pane->cursors;
 }
 
 void view_axis_cursors_set(view_t *view, bool enable)
 {
-    device_t *dev = view->dev;
-    view->cursors = enable;
-    AXIS_FOREACH(dev, axis)
+    pane_t *pane = view->pane;
+    pane->cursors = enable;
+    AXIS_FOREACH(pane->dev, axis)
     {
-        view_axis_calibration(view, axis);
-        view_axis_value(view, axis, axis->value);
+        if (!view->compact)
+            view_axis_calibration(view, axis);
+        view_axis_draw(view, pane, axis);
     }
+    if (pane->axis_win)
+        wnoutrefresh(pane->axis_win);
 }
 
 void view_axis_calibration(view_t *view, axis_t *axis)
 {
-    WINDOW *w = view->axis_win;
+    pane_t *pane = view_axis_pane(view, axis);
+    WINDOW *w = pane->axis_win;
 
-    int y = (axis->index - view->axis_scroll->index) * AXIS_H;
+    if (!w || view->scope)
+        return;
 
-    if (mvwprintw(w, y + 2, GRAPH_X, "Calibration Min:%d Max:%d Fuzz:%d Flat:%d",
-        axis->cal.min, axis->cal.max, axis->cal.fuzz, axis->cal.flat) == OK)
+    // Compact panes show the selected axis on the bottom border of the box
+    if (view->compact)
+    {
+        if (axis != pane->axis_select)
+            return;
+
+        w = pane->axis_box;
+        int y = getmaxy(w) - 1;
+        mvwhline(w, y, 1, 0, getmaxx(w) - 2);
+        mvwprintw(w, y, 2, " %s Min:%d Max:%d Fuzz:%d Flat:%d Filter:%s ",
+            axis->name, axis->cal.min, axis->cal.max, axis->cal.fuzz,
+            axis->cal.flat, filter_name(axis->filter.type));
+        wnoutrefresh(w);
+        return;
+    }
+
+    int y = (axis->index - pane->axis_scroll->index) * pane->axis_h;
+
+    if (mvwprintw(w, y + 2, GRAPH_X, "Calibration Min:%d Max:%d Fuzz:%d Flat:%d Filter:%s",
+        axis->cal.min, axis->cal.max, axis->cal.fuzz, axis->cal.flat,
+        filter_name(axis->filter.type)) == OK)
         wclrtoeol(w);
 
-    wrefresh(w);
+    wnoutrefresh(w);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+//
+// Device Focus Functions
+//
+///////////////////////////////////////////////////////////////////////////////
+
+device_t *view_device_get(view_t *view)
+{
+    return view->pane->dev;
+}
+
+static void view_device_focus(view_t *view, pane_t *pane)
+{
+    if (pane == view->pane)
+        return;
+
+    view->pane = pane;
+
+    // Only the compact layout keeps every pane on screen
+    if (view->compact)
+    {
+        PANE_FOREACH(view, pane)
+        {
+            box(pane->axis_box, 0, 0);
+            if (pane == view->pane)
+                wattron(pane->axis_box, A_REVERSE);
+            mvwprintw(pane->axis_box, 0, 1, "%s", pane->dev->name);
+            wattroff(pane->axis_box, A_REVERSE);
+            view_axis_calibration(view, pane->axis_select);
+            wnoutrefresh(pane->axis_box);
+        }
+        view_info_refresh(view);
+    }
+    else
+    {
+        view_refresh(view);
+    }
+}
+
+void view_device_prev(view_t *view)
+{
+    pane_t *pane = view->pane - 1;
+    if (pane < view->pane_array)
+        pane = view->pane_array + view->pane_num - 1;
+    view_device_focus(view, pane);
+}
+
+void view_device_next(view_t *view)
+{
+    pane_t *pane = view->pane + 1;
+    if (pane >= view->pane_array + view->pane_num)
+        pane = view->pane_array;
+    view_device_focus(view, pane);
 }
 
 ///////////////////////////////////////////////////////////////////////////////
@@ -333,11 +809,12 @@ static void view_status(view_t *view)
 
     wbkgdset(w, A_REVERSE);
     if (mvwprintw(w, STATUS_Y, STATUS_X,
-        "Commands: '?':help 'q':quit 'c':calibrate <Enter>:set 'w':write 'r':read") == OK)
+        "Commands: '?':help 'q':quit 'c':calibrate <Enter>:set 'w':write 'r':read%s",
+        view->pane_num > 1 ? " <Tab>:device" : "") == OK)
         wclrtoeol(w);
     wbkgdset(w, A_NORMAL);
 
-    wrefresh(w);
+    wnoutrefresh(w);
 }
 
 static char *view_vprompt(view_t *view, const char *prompt, va_list ap)
@@ -458,16 +935,34 @@ int view_prompt_int(view_t *view, int min, int max, const char *prompt, ...)
     return value;
 }
 
+
 ///////////////////////////////////////////////////////////////////////////////
 //
 // Info Window Functions
 //
 ///////////////////////////////////////////////////////////////////////////////
 
+static void view_stats_draw(view_t *view)
+{
+    WINDOW *w = view->info_win;
+    view_stats_t *stats = &view->stats;
+
+    if (getmaxx(w) < STATS_MIN_X)
+        return;
+
+    int x = getmaxx(w) - STATS_W;
+
+    mvwprintw(w, 0, x, "Events/s:%8.0f Reports/s:%6.0f", stats->events, stats->reports);
+    mvwprintw(w, 1, x, "Reads/event:%5.2f Dropped:%8llu", stats->reads,
+              (unsigned long long) stats->dropped);
+    mvwprintw(w, 2, x, "Redraws/s:%7.0f Bytes/s:%8.0f", stats->redraws, stats->bytes);
+    mvwprintw(w, 3, x, "Latency p99:%9lluus", (unsigned long long) stats->latency);
+}
+
 void view_info_refresh(view_t *view)
 {
     WINDOW *w = view->info_win;
-    device_t *dev = view->dev;
+    device_t *dev = view->pane->dev;
 
     werase(w);
 
@@ -476,12 +971,86 @@ void view_info_refresh(view_t *view)
     if (dev->jsfile)
         wprintw(w, " (%s)", dev->jsfile);
 #endif
+    if (view->pane_num > 1)
+        wprintw(w, " [%zu/%zu]", (size_t) (view->pane - view->pane_array) + 1, view->pane_num);
     mvwprintw(w, 1, 0, "Device Name: %s", dev->name);
     mvwprintw(w, 2, 0, "Device ID:   bus:%04x vendor:%04x product:%04x",
         dev->id.bus, dev->id.vendor, dev->id.product);
     mvwprintw(w, 3, 0, "Database:    %s%s", view->db_file, dev->dirty ? "[+]" : "");
 
-    wrefresh(w);
+    view_stats_draw(view);
+
+    wnoutrefresh(w);
+}
+
+static uint64_t view_term_bytes(void)
+{
+    // Curses writes straight to the terminal file descriptor so count all
+    // bytes written by the process, which outside of a database write is
+    // the terminal output
+    FILE *fp = fopen("/proc/self/io", "r");
+    if (!fp)
+        return 0;
+
+    char line[64];
+    unsigned long long bytes = 0;
+    while (fgets(line, sizeof(line), fp))
+    {
+        if (sscanf(line, "wchar: %llu", &bytes) == 1)
+            break;
+    }
+
+    fclose(fp);
+
+    return bytes;
+}
+
+void view_stats_refresh(view_t *view)
+{
+    uint64_t now = now_ns() / 1000;
+
+    // Rates are taken over the time since the previous refresh and every
+    // pane takes a new snapshot so switching focus shows a full interval
+    double elapsed = (now - view->stats_time) / 1e6;
+    view_stats_t *stats = &view->stats;
+
+    PANE_FOREACH(view, pane)
+    {
+        evdev_stats_enable(pane->dev->evdev);
+
+        const evstats_t *cur = evdev_stats(pane->dev->evdev);
+        evstats_t *prev = &pane->stats_prev;
+
+        if (pane == view->pane && view->stats_time)
+        {
+            uint64_t events = cur->events - prev->events;
+
+            stats->events  = events / elapsed;
+            stats->reports = (cur->reports - prev->reports) / elapsed;
+            stats->reads   = events ? (double)(cur->reads - prev->reads) / events : 0;
+            stats->dropped = cur->dropped;
+            stats->latency = evstats_percentile(cur, prev, 99);
+        }
+
+        *prev = *cur;
+    }
+
+    view->term_bytes = view_term_bytes();
+
+    if (view->stats_time)
+    {
+        stats->redraws = (view->frames - view->frames_prev) / elapsed;
+        stats->bytes   = (view->term_bytes - view->term_bytes_prev) / elapsed;
+    }
+
+    view->frames_prev = view->frames;
+    view->term_bytes_prev = view->term_bytes;
+    view->stats_time = now;
+
+    view_stats_draw(view);
+
+    wnoutrefresh(view->info_win);
+    doupdate();
 }
 
 ///////////////////////////////////////////////////////////////////////////////
@@ -490,58 +1059,82 @@ void view_info_refresh(view_t *view)
 //
 ///////////////////////////////////////////////////////////////////////////////
 
-void view_button_value(view_t *view, button_t *button, int value)
+static void view_button_draw(view_t *view, pane_t *pane, button_t *button)
 {
-    WINDOW *w = view->button_win;
+    WINDOW *w = pane->button_win;
+    int value = button->value;
 
-    button->value = value;
+    if (!w)
+        return;
 
-    int col = (getmaxx(w) - 1) / BUTTON_W;
-    int y = BUTTON_H * (button->index / col) + 1;
-    int x = BUTTON_W * (button->index % col) + 1;
+    int x, y;
+    if (view->compact)
+    {
+        int col = getmaxx(w) / COMPACT_BUTTON_W;
+        y = button->index / col;
+        x = COMPACT_BUTTON_W * (button->index % col);
+    }
+    else
+    {
+        int col = (getmaxx(w) - 1) / BUTTON_W;
+        y = BUTTON_H * (button->index / col) + 2;
+        x = BUTTON_W * (button->index % col) + 2;
+    }
 
     if (value)
         wbkgdset(w, A_REVERSE);
-    mvwprintw(w, y + 1, x + 1, "%2d", button->index);
+    mvwprintw(w, y, x, "%2d", button->index);
     if (value)
         wbkgdset(w, A_NORMAL);
+}
 
-    wrefresh(w);
+void view_button_value(view_t *view, button_t *button, int value)
+{
+    pane_t *pane = view_button_pane(view, button);
+
+    barray_set(pane->button_dirty, button->index);
+    view->dirty = true;
 }
 
-static void view_button_refresh(view_t *view)
+static void view_button_refresh(view_t *view, pane_t *pane)
 {
     int x1 = BUTTON_X;
     int y1 = BUTTON_Y;
 
-    WINDOW *w = view->button_win;
+    WINDOW *w = pane->button_win;
+    if (!w)
+        return;
+
     werase(w);
 
-    BUTTON_FOREACH(view->dev, button)
+    BUTTON_FOREACH(pane->dev, button)
     {
-        int x2 = x1 + BUTTON_W - 2;
-        int y2 = y1 + BUTTON_H - 2;
-
-        mvwhline(w, y1, x1, 0, x2 - x1);
-        mvwhline(w, y2, x1, 0, x2 - x1);
-        mvwvline(w, y1, x1, 0, y2 - y1);
-        mvwvline(w, y1, x2, 0, y2 - y1);
-        mvwaddch(w, y1, x1, ACS_ULCORNER);
-        mvwaddch(w, y2, x1, ACS_LLCORNER);
-        mvwaddch(w, y1, x2, ACS_URCORNER);
-        mvwaddch(w, y2, x2, ACS_LRCORNER);
-
-        view_button_value(view, button, button->value);
-
-        x1 += BUTTON_W;
-        if (x1 > getmaxx(w) - BUTTON_W)
+        if (!view->compact)
         {
-            x1 = BUTTON_X;
-            y1 += BUTTON_H;
+            int x2 = x1 + BUTTON_W - 2;
+            int y2 = y1 + BUTTON_H - 2;
+
+            mvwhline(w, y1, x1, 0, x2 - x1);
+            mvwhline(w, y2, x1, 0, x2 - x1);
+            mvwvline(w, y1, x1, 0, y2 - y1);
+            mvwvline(w, y1, x2, 0, y2 - y1);
+            mvwaddch(w, y1, x1, ACS_ULCORNER);
+            mvwaddch(w, y2, x1, ACS_LLCORNER);
+            mvwaddch(w, y1, x2, ACS_URCORNER);
+            mvwaddch(w, y2, x2, ACS_LRCORNER);
+
+            x1 += BUTTON_W;
+            if (x1 > getmaxx(w) - BUTTON_W)
+            {
+                x1 = BUTTON_X;
+                y1 += BUTTON_H;
+            }
         }
+
+        view_button_draw(view, pane, button);
     }
 
-    wrefresh(w);
+    wnoutrefresh(w);
 }
 
 ///////////////////////////////////////////////////////////////////////////////
@@ -555,8 +1148,11 @@ void view_effect_select(view_t *view, effect_t *effect)
 {
     WINDOW *w = view->effect_win;
 
-    effect_t *prev = view->effect_select;
-    view->effect_select = effect;
+    effect_t *prev = view->pane->effect_select;
+    view->pane->effect_select = effect;
+
+    if (!w)
+        return;
 
     int col = (getmaxx(w) - 1) / EFFECT_W;
     int y = EFFECT_H * (prev->index / col) + 1;
@@ -571,7 +1167,7 @@ void view_effect_select(view_t *view, effect_t *effect)
     mvwprintw(w, y, x, "%s", effect->name);
     wattroff(w, A_UNDERLINE);
 
-    wrefresh(w);
+    wnoutrefresh(w);
 }
 
 static void view_refresh_effect(view_t *view)
@@ -582,7 +1178,7 @@ static void view_refresh_effect(view_t *view)
     WINDOW *w = view->effect_win;
     werase(w);
 
-    EFFECT_FOREACH(view->dev, effect)
+    EFFECT_FOREACH(view->pane->dev, effect)
     {
         mvwprintw(w, y, x, "%s", effect->name);
 
@@ -594,28 +1190,28 @@ static void view_refresh_effect(view_t *view)
         }
     }
 
-    view_effect_select(view, view->effect_select);
+    view_effect_select(view, view->pane->effect_select);
 
-    wrefresh(w);
+    wnoutrefresh(w);
 }
 
 effect_t *view_effect_get(view_t *view)
 {
-    return view->effect_select;
+    return view->pane->effect_select;
 }
 
 void view_effect_prev(view_t *view)
 {
-    device_t *dev = view->dev;
-    effect_t *effect = view->effect_select - 1;
+    device_t *dev = view->pane->dev;
+    effect_t *effect = view->pane->effect_select - 1;
     if (effect >= dev->effect_array)
         view_effect_select(view, effect);
 }
 
 void view_effect_next(view_t *view)
 {
-    device_t *dev = view->dev;
-    effect_t *effect = view->effect_select + 1;
+    device_t *dev = view->pane->dev;
+    effect_t *effect = view->pane->effect_select + 1;
     if (effect < &dev->effect_array[dev->effect_num])
         view_effect_select(view, effect);
 }
@@ -628,16 +1224,31 @@ void view_effect_next(view_t *view)
 //
 ///////////////////////////////////////////////////////////////////////////////
 
-static void view_refresh(view_t *view)
+static void view_pane_delete(pane_t *pane)
 {
-    clear();
+    // Subwindows have to go before the windows they were derived from
+    if (pane->button_win)
+        delwin(pane->button_win);
+    if (pane->axis_win)
+        delwin(pane->axis_win);
+    if (pane->button_box)
+        delwin(pane->button_box);
+    if (pane->axis_box)
+        delwin(pane->axis_box);
+
+    pane->button_win = NULL;
+    pane->axis_win = NULL;
+    pane->button_box = NULL;
+    pane->axis_box = NULL;
+}
 
+static int view_refresh_single(view_t *view, int max_x, int max_y)
+{
     //
     // Calculate Sizes
     //
-    device_t *dev = view->dev;
-    int max_x = getmaxx(stdscr);
-    int max_y = getmaxy(stdscr);
+    pane_t *pane = view->pane;
+    device_t *dev = pane->dev;
 
     int button_h = 0;
     if (dev->button_num > 0)
@@ -658,56 +1269,41 @@ static void view_refresh(view_t *view)
 #endif
 
     int axis_h = dev->axis_num * AXIS_H + 3;
+    if (view->scope)
+        axis_h = max_y - INFO_H - button_h - effect_h - STATUS_H;
     if (INFO_H + axis_h + button_h + effect_h + STATUS_H > max_y)
         axis_h = max_y - INFO_H - button_h - effect_h - STATUS_H;
     if (axis_h < AXIS_H + 3)
         axis_h = AXIS_H + 3;
 
-    //
-    // Info Window
-    //
-    if (view->info_win)
-        delwin(view->info_win);
-    view->info_win = newwin(INFO_H, max_x, 0, 0);
-
-    view_info_refresh(view);
-
     //
     // Axis Window
     //
+    pane->axis_h = AXIS_H;
+    pane->axis_box = newwin(axis_h, max_x, INFO_H, 0);
 
-    if (view->axis_box)
-        delwin(view->axis_box);
-    view->axis_box = newwin(axis_h, max_x, INFO_H, 0);
-
-    box(view->axis_box, 0, 0);
-    mvwprintw(view->axis_box, 0, 1, "Axes");
-    wrefresh(view->axis_box);
+    box(pane->axis_box, 0, 0);
+    mvwprintw(pane->axis_box, 0, 1, view->scope ? "Scope" : "Axes");
+    wnoutrefresh(pane->axis_box);
 
-    if (view->axis_win)
-        delwin(view->axis_win);
-    view->axis_win = derwin(view->axis_box, axis_h - 2, max_x - 2, 1, 1);
+    pane->axis_win = derwin(pane->axis_box, axis_h - 2, max_x - 2, 1, 1);
 
-    view_axis_refresh(view);
+    view_axis_pane_refresh(view, pane);
 
     //
     // Button Window
     //
     if (button_h > 0)
     {
-        if (view->button_box)
-            delwin(view->button_box);
-        view->button_box = newwin(button_h, max_x, INFO_H + axis_h, 0);
+        pane->button_box = newwin(button_h, max_x, INFO_H + axis_h, 0);
 
-        box(view->button_box, 0, 0);
-        mvwprintw(view->button_box, 0, 1, "Buttons");
-        wrefresh(view->button_box);
+        box(pane->button_box, 0, 0);
+        mvwprintw(pane->button_box, 0, 1, "Buttons");
+        wnoutrefresh(pane->button_box);
 
-        if (view->button_win)
-            delwin(view->button_win);
-        view->button_win = derwin(view->button_box, button_h - 2, max_x - 2, 1, 1);
+        pane->button_win = derwin(pane->button_box, button_h - 2, max_x - 2, 1, 1);
 
-        view_button_refresh(view);
+        view_button_refresh(view, pane);
     }
 
     //
@@ -716,33 +1312,215 @@ static void view_refresh(view_t *view)
 #if ENABLE_EFFECTS
     if (effect_h > 0)
     {
-        if (view->effect_box)
-            delwin(view->effect_box);
         view->effect_box = newwin(effect_h, max_x, INFO_H + axis_h + button_h, 0);
 
         box(view->effect_box, 0, 0);
         mvwprintw(view->effect_box, 0, 1, "Effects");
-        wrefresh(view->effect_box);
+        wnoutrefresh(view->effect_box);
 
-        if (view->effect_win)
-            delwin(view->effect_win);
         view->effect_win = derwin(view->effect_box, effect_h - 2, max_x - 2, 1, 1);
 
         view_refresh_effect(view);
     }
 #endif
 
+    return INFO_H + axis_h + button_h + effect_h;
+}
+
+static int view_refresh_compact(view_t *view, int max_x, int max_y)
+{
+    int avail = max_y - INFO_H - STATUS_H;
+
+    int want = COMPACT_PANE_H;
+    PANE_FOREACH(view, pane)
+    {
+        int h = pane->dev->axis_num * COMPACT_AXIS_H + 3;
+        if (h > want)
+            want = h;
+    }
+
+    // Spread the panes over more columns until they fit in full or until
+    // the columns get too narrow, but always far enough to show one axis
+    size_t cols = 1;
+    while (cols < view->pane_num)
+    {
+        size_t rows = (view->pane_num + cols - 1) / cols;
+        if (rows * want <= avail)
+            break;
+        if (rows * COMPACT_PANE_H <= avail && max_x / (int) (cols + 1) < COMPACT_PANE_W)
+            break;
+        cols++;
+    }
+    size_t rows = (view->pane_num + cols - 1) / cols;
+
+    int pane_w = max_x / cols;
+    int x = 0;
+    int y = INFO_H;
+    int bottom = y;
+    size_t n = 0;
+
+    PANE_FOREACH(view, pane)
+    {
+        device_t *dev = pane->dev;
+
+        int button_col = (pane_w - 2) / COMPACT_BUTTON_W;
+        int button_h = (dev->button_num + button_col - 1) / button_col;
+
+        int h = dev->axis_num * COMPACT_AXIS_H + button_h + 2;
+        if (h > avail / (int) rows)
+            h = avail / rows;
+        if (h < COMPACT_PANE_H)
+            h = COMPACT_PANE_H;
+
+        // Buttons never push out the last axis row
+        if (button_h > h - 2 - COMPACT_AXIS_H)
+            button_h = h - 2 - COMPACT_AXIS_H;
+
+        pane->axis_h = COMPACT_AXIS_H;
+        pane->axis_box = newwin(h, pane_w, y, x);
+
+        box(pane->axis_box, 0, 0);
+        if (pane == view->pane)
+            wattron(pane->axis_box, A_REVERSE);
+        mvwprintw(pane->axis_box, 0, 1, "%s", dev->name);
+        wattroff(pane->axis_box, A_REVERSE);
+
+        pane->axis_win = derwin(pane->axis_box, h - 2 - button_h, pane_w - 2, 1, 1);
+        if (button_h > 0)
+            pane->button_win = derwin(pane->axis_box, button_h, pane_w - 2, h - 1 - button_h, 1);
+
+        wnoutrefresh(pane->axis_box);
+
+        view_axis_pane_refresh(view, pane);
+        view_button_refresh(view, pane);
+
+        y += h;
+        if (y > bottom)
+            bottom = y;
+
+        if (++n % rows == 0)
+        {
+            x += pane_w;
+            y = INFO_H;
+        }
+    }
+
+    return bottom;
+}
+
+static void view_refresh(view_t *view)
+{
+    TRACE_SCOPE("view_refresh");
+
+    clear();
+
+    int max_x = getmaxx(stdscr);
+    int max_y = getmaxy(stdscr);
+
+    PANE_FOREACH(view, pane)
+        view_pane_delete(pane);
+
+#if ENABLE_EFFECTS
+    if (view->effect_win)
+        delwin(view->effect_win);
+    if (view->effect_box)
+        delwin(view->effect_box);
+    view->effect_win = NULL;
+    view->effect_box = NULL;
+#endif
+
+    // Several devices share the screen as compact panes unless one of them
+    // is being looked at through the scope
+    view->compact = view->pane_num > 1 && !view->scope;
+
+    //
+    // Info Window
+    //
+    if (view->info_win)
+        delwin(view->info_win);
+    view->info_win = newwin(INFO_H, max_x, 0, 0);
+
+    view_info_refresh(view);
+
+    int status_y;
+    if (view->compact)
+        status_y = view_refresh_compact(view, max_x, max_y);
+    else
+        status_y = view_refresh_single(view, max_x, max_y);
+
     //
     // Status Window
     //
     if (view->status_win)
         delwin(view->status_win);
 
-    view->status_win = newwin(STATUS_H, max_x, INFO_H + button_h + effect_h + axis_h, 0);
+    view->status_win = newwin(STATUS_H, max_x, status_y, 0);
     nodelay(view->status_win, TRUE);
     keypad(view->status_win, TRUE);
 
     view_status(view);
+
+    doupdate();
+}
+
+static void view_frame_axis(bit_t index, void *arg)
+{
+    pane_t *pane = arg;
+
+    view_axis_draw(pane->view, pane, &pane->dev->axis_array[index]);
+}
+
+static void view_frame_button(bit_t index, void *arg)
+{
+    pane_t *pane = arg;
+
+    view_button_draw(pane->view, pane, &pane->dev->button_array[index]);
+}
+
+bool view_frame(view_t *view)
+{
+    TRACE_SCOPE("view_frame");
+
+    bool dirty = view->dirty;
+
+    // Draw everything that changed since the last frame and push all
+    // windows to the terminal with a single update. Panes that are not
+    // on screen just drop their dirty bits.
+    if (dirty)
+    {
+        PANE_FOREACH(view, pane)
+        {
+            barray_foreach_set(pane->axis_dirty, view_frame_axis, pane);
+            barray_zero(pane->axis_dirty);
+            if (pane->axis_win)
+                wnoutrefresh(pane->axis_win);
+
+            barray_foreach_set(pane->button_dirty, view_frame_button, pane);
+            barray_zero(pane->button_dirty);
+            if (pane->button_win)
+                wnoutrefresh(pane->button_win);
+        }
+
+        if (view->scope)
+        {
+            view_scope_draw(view);
+            wnoutrefresh(view->pane->axis_win);
+        }
+
+        view->dirty = false;
+        view->frames++;
+    }
+
+    TRACE_BEGIN("doupdate");
+    doupdate();
+    TRACE_END("doupdate");
+
+    return dirty;
+}
+
+bool view_dirty(view_t *view)
+{
+    return view->dirty;
 }
 
 void view_help(view_t *view)
@@ -760,12 +1538,16 @@ void view_help(view_t *view)
         "  <left> of h  : move effect selection left\n"
         "  <right> or l : move effect selection right\n"
 #endif
+        "  <tab>        : move device focus to the next device\n"
         "General:\n"
         "  q            : Quit application\n"
         "  c            : Toggle calibration cursors\n"
         "  <ENTER>      : Set calibration from current cursors \n"
         "  f            : Set fuzz factor for selected axis\n"
         "  t            : Set flatness for selected axis\n"
+        "  i            : Cycle jitter filter for selected axis\n"
+        "  s            : Toggle scope for selected axis\n"
+        "  + or -       : Shorten or lengthen the scope time span\n"
 #if ENABLE_EFFECTS
         "  e            : Activate selected effect\n"
 #endif
@@ -810,7 +1592,7 @@ static void view_winch(int in)
     resize = true;
 }
 
-view_t *view_init(device_t *dev, const char *db_file)
+view_t *view_init(device_t *dev_array[], size_t dev_num, const char *db_file)
 {
     view_t *view;
 
@@ -823,13 +1605,28 @@ view_t *view_init(device_t *dev, const char *db_file)
     noecho();
     curs_set(FALSE);
 
-    view->dev = dev;
+    view->pane_array = xalloc(sizeof(pane_t) * dev_num);
+    view->pane_num = dev_num;
+    view->pane = view->pane_array;
     view->db_file = db_file;
-    view->axis_select = dev->axis_array;
-    view->axis_scroll = dev->axis_array;
+    view->scope_span = SCOPE_SPAN_DEFAULT;
+
+    for (size_t i = 0; i < dev_num; i++)
+    {
+        pane_t *pane = &view->pane_array[i];
+        device_t *dev = dev_array[i];
+
+        pane->view = view;
+        pane->dev = dev;
+        pane->axis_dirty = barray_init(dev->axis_num);
+        pane->axis_cells = xalloc(sizeof(axis_cell_t) * dev->axis_num);
+        pane->button_dirty = barray_init(dev->button_num);
+        pane->axis_select = dev->axis_array;
+        pane->axis_scroll = dev->axis_array;
 #if ENABLE_EFFECTS
-    view->effect_select = dev->effect_array;
+        pane->effect_select = dev->effect_array;
 #endif
+    }
 
     view_refresh(view);
 
@@ -838,24 +1635,40 @@ view_t *view_init(device_t *dev, const char *db_file)
 
 void view_free(view_t *view)
 {
+    view_scope_axis(view, NULL);
+
+    PANE_FOREACH(view, pane)
+        view_pane_delete(pane);
+
     if (view->info_win)
         delwin(view->info_win);
 
-    if (view->axis_box)
-        delwin(view->axis_box);
+#if ENABLE_EFFECTS
+    if (view->effect_win)
+        delwin(view->effect_win);
 
-    if (view->axis_win)
-        delwin(view->axis_win);
+    if (view->effect_box)
+        delwin(view->effect_box);
+#endif
 
     if (view->status_win)
         delwin(view->status_win);
 
     endwin();
 
+    PANE_FOREACH(view, pane)
+    {
+        barray_free(pane->axis_dirty);
+        xfree(pane->axis_cells);
+        barray_free(pane->button_dirty);
+    }
+
+    xfree(view->pane_array);
+    xfree(view->scope_cols);
     xfree(view);
 }
 
 int view_key(view_t *view)
 {
     return wgetch(view->status_win);
-}
\ No newline at end of file
+}
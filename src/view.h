@@ -38,6 +38,14 @@ void view_axis_cursors_set(view_t *view, bool enable);
 
 void view_axis_refresh(view_t *view);
 
+bool view_scope_get(view_t *view);
+void view_scope_set(view_t *view, bool enable);
+void view_scope_zoom(view_t *view, int dir);
+
+device_t *view_device_get(view_t *view);
+void view_device_prev(view_t *view);
+void view_device_next(view_t *view);
+
 void view_button_value(view_t *view, button_t *button, int value);
 
 #if ENABLE_EFFECTS
@@ -54,12 +62,18 @@ bool view_confirm(view_t *view, const char *prompt);
 
 void view_info_refresh(view_t *view);
 
+void view_stats_refresh(view_t *view);
+
 void view_help(view_t *view);
 
-view_t *view_init(device_t *dev, const char *db_file);
+view_t *view_init(device_t *dev_array[], size_t dev_num, const char *db_file);
 
 void view_free(view_t *view);
 
 void view_resize(view_t *view);
 
+bool view_frame(view_t *view);
+
+bool view_dirty(view_t *view);
+
 int view_key(view_t *view);